@@ -0,0 +1,353 @@
+/**
+ * @file Benchmark.cpp
+ * @brief Headless engine benchmarks (solver, kernel precision and memory layout)
+ */
+
+#include "Benchmark.h"
+#include "SimulationEngine.h"
+#include "FlowSolverRegistry.h"
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+#include <cmath>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace Benchmark
+{
+
+namespace
+{
+
+/// One kernel configuration of the comparison
+struct Configuration {
+    QString solver;
+    KernelPrecision precision;
+    KernelLayout layout;
+};
+
+struct Options {
+    int steps = 100;
+    double duration = 0.0;          ///< Simulated time (s), 0 = steps x 1 s
+    double maxTimeStep = 1.0;       ///< Upper bound of the solver time step (s)
+    double rainfallRate = 2.8e-5;   ///< m/s (~100 mm/h)
+    double resolution = 0.0;        ///< 0 = keep the DEM / engine default
+    int tileSize = 64;              ///< Tile side of the tiled layout
+    int threads = 0;                ///< Tiled kernel threads, 0 = one per core
+    double stormDuration = 0.0;     ///< Rain stops after this time (s), 0 = rain throughout
+    QString precision = "both";     ///< double, float or both
+    QString layout = "both";        ///< row, tiled or both
+    QString solver = "all";         ///< Registered solver name or all
+    QString storage = "double";     ///< DEM storage: double, int32 or int16
+    double storagePrecision = 0.01; ///< Elevation quantum of the integer storages (m)
+    QStringList demFiles;
+};
+
+struct RunResult {
+    bool ok = false;
+    qint64 cells = 0;
+    int steps = 0;
+    double msTotal = 0.0;
+    double msPerStep = 0.0;
+    double drainage = 0.0;
+    double stored = 0.0;
+    double maxDepth = 0.0;
+    double massError = 0.0;
+    int activeTiles = 0;
+    QString storage;                ///< DEM storage actually used
+    double demMB = 0.0;             ///< DEM elevations
+    double networkMB = 0.0;         ///< Drainage network
+    double peakMB = 0.0;            ///< Process peak resident memory so far
+};
+
+/**
+ * @brief Peak resident memory of the process (bytes), 0 if unknown
+ *
+ * A high-water mark over the whole process lifetime, so runs compared on
+ * memory should each use their own process.
+ */
+double peakMemoryBytes()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return double(counters.PeakWorkingSetSize);
+    return 0.0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0.0;
+#ifdef Q_OS_MACOS
+    return double(usage.ru_maxrss);          // bytes on macOS
+#else
+    return double(usage.ru_maxrss) * 1024.0; // kilobytes on Linux
+#endif
+#endif
+}
+
+QString storageName(ElevationStorage storage)
+{
+    switch (storage) {
+    case ElevationStorage::Int16:
+        return "int16";
+    case ElevationStorage::Int32:
+        return "int32";
+    default:
+        return "double";
+    }
+}
+
+RunResult runOnce(const Options &options, const QString &demFile, const Configuration &configuration)
+{
+    RunResult result;
+    SimulationEngine engine;
+    engine.setVerboseLogging(false);
+    if (options.storage == "int16")
+        engine.setElevationStorage(ElevationStorage::Int16, options.storagePrecision);
+    else if (options.storage == "int32")
+        engine.setElevationStorage(ElevationStorage::Int32, options.storagePrecision);
+    if (options.resolution > 0.0)
+        engine.setCellResolution(options.resolution);
+    if (!engine.loadDEM(demFile))
+        return result;
+    engine.setRainfallRate(options.rainfallRate);
+    if (options.stormDuration > 0.0) {
+        QVector<QPair<double, double>> schedule;
+        schedule.append(qMakePair(0.0, options.rainfallRate));
+        schedule.append(qMakePair(options.stormDuration, 0.0));
+        engine.setRainfallSchedule(schedule);
+        engine.setTimeVaryingRainfall(true);
+    }
+    const double duration = options.duration > 0.0 ? options.duration : double(options.steps);
+    engine.setTotalTime(duration);
+    engine.setFlowSolver(configuration.solver);
+    engine.setMaxTimeStep(options.maxTimeStep);
+    engine.setPrecision(configuration.precision);
+    engine.setKernelLayout(configuration.layout, options.tileSize);
+    engine.setThreadCount(options.threads);
+    if (!engine.initSimulation())
+        return result;
+
+    // Solvers choose their own steps, so every run covers the same simulated time
+    QElapsedTimer timer;
+    timer.start();
+    while (engine.getCurrentTime() < duration && !engine.isSimulationFinished()) {
+        engine.stepSimulation();
+        result.steps++;
+    }
+    qint64 ns = timer.nsecsElapsed();
+
+    result.ok = true;
+    result.cells = qint64(engine.getRowCount()) * engine.getColumnCount();
+    result.msTotal = ns / 1.0e6;
+    result.msPerStep = result.msTotal / std::max(1, result.steps);
+    result.drainage = engine.getTotalDrainage();
+    result.stored = engine.getStoredWaterVolume();
+    result.maxDepth = engine.getMaxWaterDepth();
+    result.massError = engine.getNetSourceVolume() - result.stored - result.drainage;
+    result.activeTiles = engine.getActiveTileCount();
+    result.storage = storageName(engine.getElevationStorage());
+    result.demMB = engine.getElevationMemoryBytes() / 1048576.0;
+    result.networkMB = engine.getDrainageNetworkMemoryBytes() / 1048576.0;
+    result.peakMB = peakMemoryBytes() / 1048576.0;
+    return result;
+}
+
+double relativeDifference(double value, double reference)
+{
+    if (reference == 0.0)
+        return value == 0.0 ? 0.0 : 1.0;
+    return std::abs(value - reference) / std::abs(reference);
+}
+
+bool parse(const QStringList &arguments, Options &options, QTextStream &err)
+{
+    for (int k = 1; k < arguments.size(); ++k) {
+        const QString &arg = arguments[k];
+        auto nextValue = [&](double &value) {
+            bool ok = false;
+            if (k + 1 < arguments.size())
+                value = arguments[++k].toDouble(&ok);
+            if (!ok)
+                err << "Missing or invalid value for " << arg << "\n";
+            return ok;
+        };
+
+        double value = 0.0;
+        if (arg == "--benchmark") {
+            continue;
+        } else if (arg == "--steps") {
+            if (!nextValue(value) || value < 1)
+                return false;
+            options.steps = int(value);
+        } else if (arg == "--duration") {
+            if (!nextValue(value) || value <= 0.0)
+                return false;
+            options.duration = value;
+        } else if (arg == "--max-dt") {
+            if (!nextValue(value) || value <= 0.0)
+                return false;
+            options.maxTimeStep = value;
+        } else if (arg == "--solver") {
+            QString choice = (k + 1 < arguments.size()) ? arguments[++k] : QString();
+            if (choice != "all" && !FlowSolverRegistry::instance().contains(choice)) {
+                err << "Invalid value for --solver, expected all|" << FlowSolverRegistry::instance().names().join("|") << "\n";
+                return false;
+            }
+            options.solver = choice;
+        } else if (arg == "--rainfall") {
+            if (!nextValue(value))
+                return false;
+            options.rainfallRate = value;
+        } else if (arg == "--resolution") {
+            if (!nextValue(value) || value <= 0.0)
+                return false;
+            options.resolution = value;
+        } else if (arg == "--tile-size") {
+            if (!nextValue(value) || value < 8)
+                return false;
+            options.tileSize = int(value);
+        } else if (arg == "--threads") {
+            if (!nextValue(value) || value < 0)
+                return false;
+            options.threads = int(value);
+        } else if (arg == "--storm-duration") {
+            if (!nextValue(value) || value < 0.0)
+                return false;
+            options.stormDuration = value;
+        } else if (arg == "--storage-precision") {
+            if (!nextValue(value) || value <= 0.0)
+                return false;
+            options.storagePrecision = value;
+        } else if (arg == "--precision" || arg == "--layout" || arg == "--storage") {
+            QString choice = (k + 1 < arguments.size()) ? arguments[++k] : QString();
+            QStringList allowed = (arg == "--precision") ? QStringList{"double", "float", "both"}
+                                  : (arg == "--layout")  ? QStringList{"row", "tiled", "both"}
+                                                         : QStringList{"double", "int32", "int16"};
+            if (!allowed.contains(choice)) {
+                err << "Invalid value for " << arg << ", expected " << allowed.join("|") << "\n";
+                return false;
+            }
+            if (arg == "--precision")
+                options.precision = choice;
+            else if (arg == "--layout")
+                options.layout = choice;
+            else
+                options.storage = choice;
+        } else if (arg.startsWith("--")) {
+            err << "Unknown benchmark option " << arg << "\n";
+            return false;
+        } else {
+            options.demFiles << arg;
+        }
+    }
+    if (options.demFiles.isEmpty()) {
+        err << "Usage: BTP_GUI --benchmark [--steps N | --duration s] [--max-dt s] [--solver name|all] "
+               "[--rainfall m/s] [--resolution m] [--precision double|float|both] [--layout row|tiled|both] [--tile-size N] [--threads N] "
+               "[--storm-duration s] [--storage double|int32|int16] [--storage-precision m] dem [dem ...]\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool isRequested(int argc, char *argv[])
+{
+    for (int k = 1; k < argc; ++k) {
+        if (qstrcmp(argv[k], "--benchmark") == 0)
+            return true;
+    }
+    return false;
+}
+
+int run(const QStringList &arguments)
+{
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    Options options;
+    if (!parse(arguments, options, err))
+        return 2;
+
+    // The first configuration is the reference of the speedup and difference columns
+    const FlowSolverRegistry &registry = FlowSolverRegistry::instance();
+    QVector<Configuration> configurations;
+    for (const QString &solver : registry.names()) {
+        if (options.solver != "all" && solver != options.solver)
+            continue;
+        for (KernelLayout layout : {KernelLayout::RowMajor, KernelLayout::Tiled}) {
+            if (options.layout != "both" && (layout == KernelLayout::Tiled) != (options.layout == "tiled"))
+                continue;
+            if (layout == KernelLayout::Tiled && !registry.supportsTiled(solver))
+                continue;
+            for (KernelPrecision precision : {KernelPrecision::Double, KernelPrecision::Float}) {
+                if (options.precision != "both" && (precision == KernelPrecision::Float) != (options.precision == "float"))
+                    continue;
+                configurations.append({solver, precision, layout});
+            }
+        }
+    }
+    if (configurations.isEmpty()) {
+        err << "No solver supports the selected configuration\n";
+        return 2;
+    }
+
+    const double duration = options.duration > 0.0 ? options.duration : double(options.steps);
+    out << "Kernel benchmark: " << duration << " s simulated, max step " << options.maxTimeStep
+        << " s, rainfall " << options.rainfallRate << " m/s";
+    if (options.stormDuration > 0.0)
+        out << " for " << options.stormDuration << " s";
+    out << ", tile size " << options.tileSize << "\n";
+    out << "dem,solver,precision,layout,storage,cells,active_tiles,steps,ms_total,ms_per_step,speedup,drainage_m3,stored_m3,"
+           "max_depth_m,mass_error_m3,drainage_rel_diff,stored_rel_diff,max_depth_rel_diff,dem_mb,network_mb,peak_mb\n";
+
+    int failures = 0;
+    for (const QString &demFile : options.demFiles) {
+        const QString name = QFileInfo(demFile).completeBaseName();
+        RunResult reference;
+        for (int c = 0; c < configurations.size(); c++) {
+            const Configuration &configuration = configurations[c];
+            RunResult r = runOnce(options, demFile, configuration);
+            if (!r.ok) {
+                err << "Could not run " << demFile << "\n";
+                failures++;
+                break;
+            }
+            if (c == 0)
+                reference = r;
+
+            out << name << ","
+                << configuration.solver << ","
+                << (configuration.precision == KernelPrecision::Float ? "float" : "double") << ","
+                << (configuration.layout == KernelLayout::Tiled ? "tiled" : "row") << ","
+                << r.storage << ","
+                << r.cells << ","
+                << r.activeTiles << ","
+                << r.steps << ","
+                << QString::number(r.msTotal, 'f', 1) << ","
+                << QString::number(r.msPerStep, 'f', 3) << ","
+                << QString::number(reference.msTotal / r.msTotal, 'f', 2) << ","
+                << QString::number(r.drainage, 'g', 12) << ","
+                << QString::number(r.stored, 'g', 12) << ","
+                << QString::number(r.maxDepth, 'g', 8) << ","
+                << QString::number(r.massError, 'g', 4) << ","
+                << QString::number(relativeDifference(r.drainage, reference.drainage), 'g', 3) << ","
+                << QString::number(relativeDifference(r.stored, reference.stored), 'g', 3) << ","
+                << QString::number(relativeDifference(r.maxDepth, reference.maxDepth), 'g', 3) << ","
+                << QString::number(r.demMB, 'f', 1) << ","
+                << QString::number(r.networkMB, 'f', 1) << ","
+                << QString::number(r.peakMB, 'f', 1) << "\n";
+            out.flush();
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+} // namespace Benchmark
@@ -0,0 +1,58 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QStringList>
+
+/**
+ * @brief Headless performance and accuracy benchmarks of the simulation engine
+ *
+ * Started from the command line instead of the main window, under a
+ * QCoreApplication so no display is needed. Engines run with the per-step
+ * log off and nothing connected to simulationStepCompleted(), so no depth
+ * images are rendered and the timed loop covers the solver step and the
+ * engine's bookkeeping only:
+ *
+ *     BTP_GUI --benchmark [--steps N | --duration S] [--max-dt S] [--solver name|all]
+ *             [--rainfall R] [--resolution M]
+ *             [--precision double|float|both] [--layout row|tiled|both]
+ *             [--tile-size N] [--threads N] [--storm-duration S]
+ *             [--storage double|int32|int16] [--storage-precision M] dem.tif [dem2.csv ...]
+ *
+ * Every DEM is run once per kernel configuration (solver x layout x
+ * precision, solvers from FlowSolverRegistry) over the same simulated time
+ * with identical inputs; --steps N means N seconds. Solvers choose their
+ * own steps up to --max-dt, so speedup compares the wall time of whole
+ * runs. The first configuration (diffusive, double, row-major unless
+ * filtered out) is the reference; the table reports step count and time,
+ * the mass balance error (net sources - stored - drained) and the deviation
+ * of drainage, stored volume and max depth from the reference. Selecting a
+ * single configuration lets hardware counters (e.g. perf stat -e
+ * cache-misses) be attributed to one layout. --storm-duration stops the
+ * rain after S seconds so drying tiles drop out of the tiled kernel's
+ * schedule; active_tiles reports the tiles stepped in the last step.
+ * --storage loads the DEMs quantized (setElevationStorage()); dem_mb and
+ * network_mb report the DEM grid and drainage network, peak_mb the process
+ * peak resident memory so far, so memory is compared with one storage and
+ * one configuration per process.
+ */
+namespace Benchmark
+{
+
+/**
+ * @brief Tells whether the command line asks for a benchmark run
+ *
+ * Takes the raw argv so main() can decide before creating an application
+ * object; benchmarks only need a QCoreApplication.
+ */
+bool isRequested(int argc, char *argv[]);
+
+/**
+ * @brief Parses the benchmark options and runs all DEMs
+ * @param arguments Application arguments (including --benchmark)
+ * @return Process exit code
+ */
+int run(const QStringList &arguments);
+
+} // namespace Benchmark
+
+#endif // BENCHMARK_H
@@ -0,0 +1,246 @@
+/**
+ * @class DepthFrameWriter
+ * @brief Streams water depth snapshots to an ENVI band-sequential stack
+ *
+ * The writer owns a small pool of frame buffers. The simulation thread copies
+ * the depth grid into a free buffer and queues it; this thread appends queued
+ * frames to the raw file and recycles the buffers. Disk latency therefore never
+ * reaches the solver unless the queue is full.
+ */
+
+#include "DepthFrameWriter.h"
+#include <QDebug>
+#include <QTextStream>
+#include <QSysInfo>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+
+DepthFrameWriter::DepthFrameWriter(QObject *parent)
+    : QThread(parent),
+    noData(-9999.0f),
+    nRows(0),
+    nCols(0),
+    capacity(0),
+    opened(false),
+    stopRequested(false),
+    failed(false),
+    bandsWritten(0)
+{
+    for (int k = 0; k < 6; ++k)
+        transform[k] = 0.0;
+}
+
+DepthFrameWriter::~DepthFrameWriter()
+{
+    close();
+}
+
+bool DepthFrameWriter::open(const QString &path, int rows, int cols, const double geoTransform[6],
+                            const QString &projectionWkt, float noDataValue, int queueCapacity)
+{
+    close();
+
+    if (rows <= 0 || cols <= 0 || path.isEmpty()) {
+        qDebug() << "DepthFrameWriter: invalid output configuration" << path << rows << cols;
+        return false;
+    }
+
+    rawPath = path;
+    wkt = projectionWkt;
+    noData = noDataValue;
+    nRows = rows;
+    nCols = cols;
+    capacity = std::max(1, queueCapacity);
+    for (int k = 0; k < 6; ++k)
+        transform[k] = geoTransform[k];
+
+    rawFile.setFileName(rawPath);
+    if (!rawFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "DepthFrameWriter: cannot create" << rawPath << rawFile.errorString();
+        return false;
+    }
+    timesFile.setFileName(rawPath + ".times");
+    if (!timesFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qDebug() << "DepthFrameWriter: cannot create" << timesFile.fileName();
+        rawFile.close();
+        return false;
+    }
+    QTextStream(&timesFile) << "band,step,time_s\n";
+
+    // One buffer per queue slot plus the one the solver is currently filling
+    pool.assign(capacity + 1, std::vector<float>(size_t(rows) * size_t(cols), noData));
+    freeFrames.clear();
+    for (auto &buffer : pool)
+        freeFrames.append(buffer.data());
+    queue.clear();
+
+    stopRequested = false;
+    failed = false;
+    lastError.clear();
+    bandsWritten = 0;
+
+    if (!writeHeader(0)) {
+        rawFile.close();
+        timesFile.close();
+        return false;
+    }
+
+    opened = true;
+    start();
+    qDebug() << "DepthFrameWriter: streaming" << rows << "x" << cols << "frames to" << rawPath;
+    return true;
+}
+
+float *DepthFrameWriter::acquireFrame()
+{
+    QMutexLocker locker(&mutex);
+    if (!opened || failed)
+        return nullptr;
+
+    // Back-pressure: only wait when every buffer is queued for the disk
+    while (freeFrames.isEmpty() && !failed)
+        frameReleased.wait(&mutex);
+    if (failed)
+        return nullptr;
+
+    float *frame = freeFrames.last();
+    freeFrames.removeLast();
+    return frame;
+}
+
+void DepthFrameWriter::submitFrame(float *frame, qint64 step, double simTime)
+{
+    if (!frame)
+        return;
+
+    QMutexLocker locker(&mutex);
+    if (!opened || failed) {
+        freeFrames.append(frame);
+        return;
+    }
+    queue.push_back({frame, step, simTime});
+    frameQueued.wakeOne();
+}
+
+void DepthFrameWriter::close()
+{
+    if (!opened)
+        return;
+
+    {
+        QMutexLocker locker(&mutex);
+        stopRequested = true;
+        frameQueued.wakeAll();
+    }
+    wait();
+
+    writeHeader(bandsWritten);
+    rawFile.close();
+    timesFile.close();
+    opened = false;
+
+    // Release the pooled buffers; a writer is usually opened once per run
+    pool.clear();
+    freeFrames.clear();
+
+    qDebug() << "DepthFrameWriter: closed" << rawPath << "with" << bandsWritten << "frames";
+}
+
+bool DepthFrameWriter::hasFailed() const
+{
+    QMutexLocker locker(&mutex);
+    return failed;
+}
+
+QString DepthFrameWriter::errorString() const
+{
+    QMutexLocker locker(&mutex);
+    return lastError;
+}
+
+int DepthFrameWriter::framesWritten() const
+{
+    QMutexLocker locker(&mutex);
+    return bandsWritten;
+}
+
+/**
+ * @brief Writer thread loop
+ *
+ * Pops queued frames, appends them to the raw file outside the lock and
+ * returns their buffers to the pool. Exits once stop is requested and the
+ * queue has been drained, so no submitted frame is lost on close().
+ */
+void DepthFrameWriter::run()
+{
+    const qint64 frameBytes = qint64(nRows) * qint64(nCols) * qint64(sizeof(float));
+
+    while (true) {
+        PendingFrame pending;
+        {
+            QMutexLocker locker(&mutex);
+            while (queue.empty() && !stopRequested)
+                frameQueued.wait(&mutex);
+            if (queue.empty())
+                break;
+            pending = queue.front();
+            queue.pop_front();
+        }
+
+        bool ok = rawFile.write(reinterpret_cast<const char *>(pending.data), frameBytes) == frameBytes;
+        if (ok) {
+            QTextStream times(&timesFile);
+            times.setRealNumberPrecision(10);
+            times << bandsWritten << "," << pending.step << "," << pending.time << "\n";
+        }
+
+        QMutexLocker locker(&mutex);
+        freeFrames.append(pending.data);
+        if (ok) {
+            bandsWritten++;
+        } else if (!failed) {
+            failed = true;
+            lastError = QString("Failed writing depth frame to %1: %2").arg(rawPath, rawFile.errorString());
+            qDebug() << "DepthFrameWriter:" << lastError;
+        }
+        frameReleased.wakeAll();
+    }
+}
+
+/**
+ * @brief Writes the ENVI header describing the frame stack
+ * @param bands Number of frames currently in the raw file
+ * @return true if the header was written
+ *
+ * ENVI "map info" stores the upper-left corner and pixel size, which is the
+ * DEM geotransform without rotation terms (DEMs used here are north-up).
+ */
+bool DepthFrameWriter::writeHeader(int bands)
+{
+    QFile header(rawPath + ".hdr");
+    if (!header.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        qDebug() << "DepthFrameWriter: cannot write header" << header.fileName();
+        return false;
+    }
+
+    QTextStream out(&header);
+    out.setRealNumberPrecision(15);
+    out << "ENVI\n";
+    out << "description = {BTP_GUI water depth frames (m)}\n";
+    out << "samples = " << nCols << "\n";
+    out << "lines = " << nRows << "\n";
+    out << "bands = " << bands << "\n";
+    out << "header offset = 0\n";
+    out << "file type = ENVI Standard\n";
+    out << "data type = 4\n";
+    out << "interleave = bsq\n";
+    out << "byte order = " << (QSysInfo::ByteOrder == QSysInfo::LittleEndian ? 0 : 1) << "\n";
+    out << "data ignore value = " << noData << "\n";
+    out << "map info = {Arbitrary, 1, 1, " << transform[0] << ", " << transform[3] << ", "
+        << transform[1] << ", " << std::abs(transform[5]) << "}\n";
+    if (!wkt.isEmpty())
+        out << "coordinate system string = {" << wkt << "}\n";
+    header.close();
+    return true;
+}
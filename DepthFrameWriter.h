@@ -0,0 +1,117 @@
+#ifndef DEPTHFRAMEWRITER_H
+#define DEPTHFRAMEWRITER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QString>
+#include <QFile>
+#include <QVector>
+#include <deque>
+#include <vector>
+
+/**
+ * @brief Background writer for water depth raster frames
+ *
+ * Streams snapshots of the water depth grid to disk on a dedicated thread so
+ * that the simulation loop only pays for a memory copy. Frames travel through a
+ * bounded queue of pooled float buffers:
+ * 1. The solver calls acquireFrame() to borrow a buffer from the pool
+ * 2. It fills the buffer and hands it over with submitFrame()
+ * 3. The writer thread appends the frame to disk and returns the buffer
+ *
+ * acquireFrame() only blocks when every pooled buffer is still queued, i.e.
+ * when the disk cannot keep up with the configured output interval.
+ *
+ * Output format (ENVI band-sequential, readable by GDAL):
+ * - <path>      Raw float32 frames appended one after another (one band each)
+ * - <path>.hdr  Text header with grid size, band count, geotransform and
+ *               projection; rewritten on close() with the final band count
+ * - <path>.times CSV sidecar with step index and simulated time per frame
+ */
+class DepthFrameWriter : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit DepthFrameWriter(QObject *parent = nullptr);
+    ~DepthFrameWriter() override;
+
+    /**
+     * @brief Opens the output files and starts the writer thread
+     * @param path Path of the raw frame file (.bin recommended)
+     * @param rows Number of grid rows
+     * @param cols Number of grid columns
+     * @param geoTransform GDAL-style geotransform of the DEM (6 values)
+     * @param projectionWkt Projection of the DEM as WKT (may be empty)
+     * @param noDataValue Value written for cells outside the DEM
+     * @param queueCapacity Maximum number of frames waiting for the disk
+     * @return true if the files were created and the thread started
+     */
+    bool open(const QString &path, int rows, int cols, const double geoTransform[6],
+              const QString &projectionWkt, float noDataValue, int queueCapacity = 4);
+
+    /**
+     * @brief Borrows an empty frame buffer of rows*cols floats from the pool
+     * @return Pointer to the buffer, or nullptr if the writer is not open
+     *
+     * Blocks only while all pooled buffers are queued for writing.
+     */
+    float *acquireFrame();
+
+    /**
+     * @brief Queues a filled buffer for writing
+     * @param frame Buffer previously returned by acquireFrame()
+     * @param step Simulation step index of the snapshot
+     * @param simTime Simulated time of the snapshot (s)
+     */
+    void submitFrame(float *frame, qint64 step, double simTime);
+
+    /**
+     * @brief Drains the queue, finalizes the header and stops the thread
+     */
+    void close();
+
+    bool isOpen() const { return opened; }
+    bool hasFailed() const;
+    QString errorString() const;
+    int framesWritten() const;
+
+protected:
+    void run() override;
+
+private:
+    struct PendingFrame {
+        float *data;
+        qint64 step;
+        double time;
+    };
+
+    bool writeHeader(int bands);
+
+    QString rawPath;
+    QString wkt;
+    double transform[6];
+    float noData;
+    int nRows;
+    int nCols;
+    int capacity;
+    bool opened;
+
+    QFile rawFile;
+    QFile timesFile;
+
+    std::vector<std::vector<float>> pool;  ///< Owned frame buffers
+    QVector<float *> freeFrames;           ///< Buffers ready for the solver
+    std::deque<PendingFrame> queue;        ///< Buffers waiting for the disk
+
+    mutable QMutex mutex;
+    QWaitCondition frameQueued;
+    QWaitCondition frameReleased;
+    bool stopRequested;
+    bool failed;
+    QString lastError;
+    int bandsWritten;
+};
+
+#endif // DEPTHFRAMEWRITER_H
@@ -0,0 +1,568 @@
+/**
+ * @class DrainageNetwork
+ * @brief Depression filling, D8 routing and catchment labeling
+ *
+ * Depression filling uses Priority-Flood (Barnes, Lehman & Mulla, 2014):
+ * cells are flooded inward from the grid edge in elevation order. On double
+ * DEMs every pit cell is raised just above the cell that reached it
+ * (+epsilon), so the filled surface drains everywhere without flat areas; on
+ * quantized DEMs pits are raised to that cell's level and drain towards it.
+ */
+
+#include "DrainageNetwork.h"
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <queue>
+
+const int DrainageNetwork::DI[8] = {-1, -1, 0, 1, 1, 1, 0, -1};
+const int DrainageNetwork::DJ[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+
+DrainageNetwork::DrainageNetwork()
+    : nRows(0),
+    nCols(0),
+    built(false),
+    labeled(false),
+    quantized(false),
+    levelOffset(0.0),
+    levelScale(1.0)
+{
+}
+
+void DrainageNetwork::clear()
+{
+    nRows = nCols = 0;
+    built = labeled = quantized = false;
+    filled.clear();
+    filledLevels.clear();
+    direction.clear();
+    accumulation.clear();
+    order.clear();
+    outletCell.clear();
+    basin.clear();
+    basinCells.clear();
+}
+
+void DrainageNetwork::build(std::vector<double> elevations, int rows, int cols)
+{
+    clear();
+    if (rows <= 0 || cols <= 0 || elevations.size() != size_t(rows) * size_t(cols))
+        return;
+
+    nRows = rows;
+    nCols = cols;
+    filled = std::move(elevations);
+    direction.assign(filled.size(), -1);
+    fillDepressions();
+    finishBuild();
+}
+
+void DrainageNetwork::buildQuantized(std::vector<int32_t> levels, int rows, int cols, double offset, double scale)
+{
+    clear();
+    if (rows <= 0 || cols <= 0 || scale <= 0.0 || levels.size() != size_t(rows) * size_t(cols))
+        return;
+
+    nRows = rows;
+    nCols = cols;
+    quantized = true;
+    levelOffset = offset;
+    levelScale = scale;
+    filledLevels = std::move(levels);
+    direction.assign(filledLevels.size(), -1);
+    fillDepressionLevels();
+    finishBuild();
+}
+
+void DrainageNetwork::finishBuild()
+{
+    computeDirections();
+    computeAccumulation();
+    built = true;
+
+    qDebug() << "Drainage network built for" << nRows << "x" << nCols << "grid," << order.size() << "valid cells,"
+             << memoryBytes() / (1024 * 1024) << "MB";
+}
+
+size_t DrainageNetwork::memoryBytes() const
+{
+    size_t bytes = filled.capacity() * sizeof(double) + filledLevels.capacity() * sizeof(int32_t)
+        + direction.capacity() * sizeof(int8_t) + accumulation.capacity() * sizeof(uint32_t)
+        + order.capacity() * sizeof(int) + outletCell.capacity() * sizeof(int) + basin.capacity() * sizeof(int);
+    for (const std::vector<int> &cells : basinCells)
+        bytes += cells.capacity() * sizeof(int);
+    return bytes;
+}
+
+int DrainageNetwork::downstream(int index) const
+{
+    int k = direction[index];
+    if (k < 0)
+        return -1;
+    return (index / nCols + DI[k]) * nCols + (index % nCols + DJ[k]);
+}
+
+namespace
+{
+
+/// Largest level range handled by the bucket queue (buckets are 24 bytes each)
+const qint64 MAX_BUCKET_LEVELS = qint64(1) << 20;
+
+/**
+ * @brief Min-heap of open cells keyed by elevation or level
+ */
+template <typename Key>
+class HeapQueue
+{
+public:
+    explicit HeapQueue(const std::vector<Key> &keys) : keys(keys) {}
+
+    bool empty() const { return open.empty(); }
+    void push(int idx) { open.push(Entry(keys[idx], idx)); }
+    int pop()
+    {
+        int idx = open.top().second;
+        open.pop();
+        return idx;
+    }
+
+private:
+    typedef std::pair<Key, int> Entry;
+    const std::vector<Key> &keys;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+};
+
+/**
+ * @brief Bucket queue of open cells keyed by integer elevation level
+ *
+ * One FIFO bucket per level pops cells in elevation order in O(1). The flood
+ * never pushes below the level being drained.
+ */
+class BucketQueue
+{
+public:
+    BucketQueue(const std::vector<int32_t> &levels, int32_t base, int count)
+        : levels(levels), base(base), buckets(count), level(0), position(0), count(0) {}
+
+    bool empty() const { return count == 0; }
+    void push(int idx)
+    {
+        qint64 key = qint64(levels[idx]) - base;
+        key = std::clamp(key, qint64(level), qint64(buckets.size()) - 1);
+        buckets[key].push_back(idx);
+        count++;
+    }
+    int pop()
+    {
+        while (position == buckets[level].size()) {
+            std::vector<int>().swap(buckets[level]);
+            level++;
+            position = 0;
+        }
+        count--;
+        return buckets[level][position++];
+    }
+
+private:
+    const std::vector<int32_t> &levels;
+    int32_t base;
+    std::vector<std::vector<int>> buckets;
+    int level;          ///< Level being drained
+    size_t position;    ///< Next cell of the current bucket
+    size_t count;       ///< Queued cells
+};
+
+} // namespace
+
+/**
+ * @brief Priority-Flood+epsilon depression filling of a double DEM
+ *
+ * Seeds are valid cells on the grid edge or next to NoData. Cells that would
+ * be lower than the cell flooding them are pits: they are raised to the next
+ * representable value above it and processed from a FIFO queue, which avoids
+ * queue operations inside depressions.
+ */
+void DrainageNetwork::fillDepressions()
+{
+    HeapQueue<double> open(filled);
+    qint64 raised = priorityFlood(open);
+    qDebug() << "Priority-Flood raised" << raised << "depression cells";
+}
+
+/**
+ * @brief Priority-Flood filling of a quantized DEM on its levels
+ *
+ * Level ranges of at most MAX_BUCKET_LEVELS use the O(1) bucket queue,
+ * larger int32 ranges a binary heap of levels.
+ */
+void DrainageNetwork::fillDepressionLevels()
+{
+    int32_t minLevel = INT32_MAX;
+    int32_t maxLevel = INT32_MIN;
+    for (int32_t level : filledLevels) {
+        if (level == NO_DATA_LEVEL)
+            continue;
+        minLevel = std::min(minLevel, level);
+        maxLevel = std::max(maxLevel, level);
+    }
+
+    const qint64 levels = (maxLevel >= minLevel) ? qint64(maxLevel) - minLevel + 1 : 0;
+    qint64 raised;
+    if (levels > 0 && levels <= MAX_BUCKET_LEVELS) {
+        BucketQueue open(filledLevels, minLevel, int(levels));
+        raised = priorityFloodLevels(open);
+        qDebug() << "Priority-Flood (bucket queue," << levels << "levels) raised" << raised << "depression cells";
+    } else {
+        HeapQueue<int32_t> open(filledLevels);
+        raised = priorityFloodLevels(open);
+        qDebug() << "Priority-Flood (levels) raised" << raised << "depression cells";
+    }
+}
+
+/**
+ * @brief Closes and queues the valid cells on the grid edge or next to NoData
+ */
+template <typename OpenQueue>
+void DrainageNetwork::seedBorder(OpenQueue &open, std::vector<uint8_t> &closed) const
+{
+    for (int i = 0; i < nRows; ++i) {
+        for (int j = 0; j < nCols; ++j) {
+            int idx = i * nCols + j;
+            if (!isValid(idx))
+                continue;
+            bool seed = (i == 0 || i == nRows - 1 || j == 0 || j == nCols - 1);
+            for (int k = 0; k < 8 && !seed; ++k) {
+                if (!isValid((i + DI[k]) * nCols + (j + DJ[k])))
+                    seed = true;
+            }
+            if (seed) {
+                closed[idx] = 1;
+                open.push(idx);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Floods the grid inward from its border in the order given by open
+ * @return Number of cells raised out of depressions
+ */
+template <typename OpenQueue>
+qint64 DrainageNetwork::priorityFlood(OpenQueue &open)
+{
+    std::deque<int> pit;
+    std::vector<uint8_t> closed(filled.size(), 0);
+    seedBorder(open, closed);
+
+    qint64 raised = 0;
+    while (!open.empty() || !pit.empty()) {
+        int c;
+        if (!pit.empty()) {
+            c = pit.front();
+            pit.pop_front();
+        } else {
+            c = open.pop();
+        }
+
+        int ci = c / nCols;
+        int cj = c % nCols;
+        double spill = std::nextafter(filled[c], std::numeric_limits<double>::infinity());
+        for (int k = 0; k < 8; ++k) {
+            int ni = ci + DI[k];
+            int nj = cj + DJ[k];
+            if (ni < 0 || ni >= nRows || nj < 0 || nj >= nCols)
+                continue;
+            int n = ni * nCols + nj;
+            if (closed[n] || !isValid(n))
+                continue;
+            closed[n] = 1;
+            if (filled[n] <= spill) {
+                if (filled[n] < filled[c])
+                    raised++;
+                filled[n] = spill;
+                pit.push_back(n);
+            } else {
+                open.push(n);
+            }
+        }
+    }
+    return raised;
+}
+
+/**
+ * @brief Priority-Flood on integer levels, resolving flats by flood order
+ * @return Number of cells raised out of depressions
+ *
+ * Levels cannot be raised by an epsilon, so a pit or flat cell takes the
+ * level of the cell that reached it and its flow direction points back at
+ * that cell. Following these directions through a flat only visits cells
+ * closed earlier, so they end at a lower cell or the border; every cell
+ * reached from the open queue has a strictly lower neighbour and gets its
+ * direction from steepest descent.
+ */
+template <typename OpenQueue>
+qint64 DrainageNetwork::priorityFloodLevels(OpenQueue &open)
+{
+    std::deque<int> pit;
+    std::vector<uint8_t> closed(filledLevels.size(), 0);
+    seedBorder(open, closed);
+
+    qint64 raised = 0;
+    while (!open.empty() || !pit.empty()) {
+        int c;
+        if (!pit.empty()) {
+            c = pit.front();
+            pit.pop_front();
+        } else {
+            c = open.pop();
+        }
+
+        int ci = c / nCols;
+        int cj = c % nCols;
+        for (int k = 0; k < 8; ++k) {
+            int ni = ci + DI[k];
+            int nj = cj + DJ[k];
+            if (ni < 0 || ni >= nRows || nj < 0 || nj >= nCols)
+                continue;
+            int n = ni * nCols + nj;
+            if (closed[n] || !isValid(n))
+                continue;
+            closed[n] = 1;
+            if (filledLevels[n] <= filledLevels[c]) {
+                if (filledLevels[n] < filledLevels[c])
+                    raised++;
+                filledLevels[n] = filledLevels[c];
+                direction[n] = int8_t((k + 4) % 8);
+                pit.push_back(n);
+            } else {
+                open.push(n);
+            }
+        }
+    }
+    return raised;
+}
+
+/**
+ * @brief D8 steepest descent on the filled surface
+ *
+ * Cells already given a direction by the level flood (flats of a quantized
+ * DEM) keep it.
+ */
+void DrainageNetwork::computeDirections()
+{
+    const double diagonal = std::sqrt(2.0);
+
+    for (int i = 0; i < nRows; ++i) {
+        for (int j = 0; j < nCols; ++j) {
+            int idx = i * nCols + j;
+            if (!isValid(idx) || direction[idx] >= 0)
+                continue;
+
+            double maxSlope = 0.0;
+            int best = -1;
+            for (int k = 0; k < 8; ++k) {
+                int ni = i + DI[k];
+                int nj = j + DJ[k];
+                if (ni < 0 || ni >= nRows || nj < 0 || nj >= nCols)
+                    continue;
+                int n = ni * nCols + nj;
+                if (!isValid(n))
+                    continue;
+                // Resolution cancels out of the comparison, only the diagonal factor matters
+                double drop = quantized ? double(filledLevels[idx]) - double(filledLevels[n]) : filled[idx] - filled[n];
+                double slope = drop / ((k % 2 == 0) ? 1.0 : diagonal);
+                if (slope > maxSlope) {
+                    maxSlope = slope;
+                    best = k;
+                }
+            }
+            direction[idx] = int8_t(best);
+        }
+    }
+}
+
+/**
+ * @brief Orders cells upstream-first (Kahn's algorithm) and accumulates flow
+ *
+ * accumulation[c] is the number of cells upstream of c, matching the previous
+ * flow accumulation grid used for visualization.
+ */
+void DrainageNetwork::computeAccumulation()
+{
+    const int cellCount = nRows * nCols;
+    std::vector<uint8_t> inflow(cellCount, 0);
+    for (int c = 0; c < cellCount; ++c) {
+        int d = isValid(c) ? downstream(c) : -1;
+        if (d >= 0)
+            inflow[d]++;
+    }
+
+    order.clear();
+    for (int c = 0; c < cellCount; ++c) {
+        if (isValid(c) && inflow[c] == 0)
+            order.push_back(c);
+    }
+    for (size_t k = 0; k < order.size(); ++k) {
+        int d = downstream(order[k]);
+        if (d >= 0 && --inflow[d] == 0)
+            order.push_back(d);
+    }
+
+    accumulation.assign(cellCount, 0);
+    for (int c : order) {
+        int d = downstream(c);
+        if (d >= 0)
+            accumulation[d] += 1 + accumulation[c];
+    }
+}
+
+/**
+ * @brief Labels all catchments with one multi-source reverse BFS
+ *
+ * Outlets are seeded with their own ID; the search walks from each labeled
+ * cell to the neighbours whose D8 direction points at it. An upstream outlet
+ * keeps its own label and therefore shields its basin from the one below.
+ */
+void DrainageNetwork::labelCatchments(const std::vector<int> &outlets)
+{
+    labeled = false;
+    if (!built)
+        return;
+
+    const int cellCount = nRows * nCols;
+    basin.assign(cellCount, -1);
+    outletCell = outlets;
+    basinCells.assign(outlets.size(), std::vector<int>());
+
+    std::deque<int> queue;
+    for (size_t id = 0; id < outlets.size(); ++id) {
+        int o = outlets[id];
+        if (o < 0 || o >= cellCount || !isValid(o) || basin[o] >= 0)
+            continue;
+        basin[o] = int(id);
+        queue.push_back(o);
+    }
+
+    while (!queue.empty()) {
+        int c = queue.front();
+        queue.pop_front();
+        int ci = c / nCols;
+        int cj = c % nCols;
+        for (int k = 0; k < 8; ++k) {
+            int ni = ci + DI[k];
+            int nj = cj + DJ[k];
+            if (ni < 0 || ni >= nRows || nj < 0 || nj >= nCols)
+                continue;
+            int n = ni * nCols + nj;
+            // n drains into c if its direction is the reverse of k
+            if (basin[n] < 0 && direction[n] == (k + 4) % 8) {
+                basin[n] = basin[c];
+                queue.push_back(n);
+            }
+        }
+    }
+
+    for (int c = 0; c < cellCount; ++c) {
+        if (basin[c] >= 0)
+            basinCells[basin[c]].push_back(c);
+    }
+    labeled = true;
+}
+
+/**
+ * @brief Relabels the upstream tree of seed from one catchment to another
+ *
+ * Stops at cells carrying a different label, i.e. at the basins of outlets
+ * further upstream.
+ */
+void DrainageNetwork::relabelUpstream(int seed, int fromId, int toId)
+{
+    std::vector<int> &cells = basinCells[toId];
+    std::deque<int> queue;
+    basin[seed] = toId;
+    queue.push_back(seed);
+    cells.push_back(seed);
+
+    while (!queue.empty()) {
+        int c = queue.front();
+        queue.pop_front();
+        int ci = c / nCols;
+        int cj = c % nCols;
+        for (int k = 0; k < 8; ++k) {
+            int ni = ci + DI[k];
+            int nj = cj + DJ[k];
+            if (ni < 0 || ni >= nRows || nj < 0 || nj >= nCols)
+                continue;
+            int n = ni * nCols + nj;
+            if (basin[n] == fromId && n != seed && direction[n] == (k + 4) % 8) {
+                basin[n] = toId;
+                queue.push_back(n);
+                cells.push_back(n);
+            }
+        }
+    }
+    std::sort(cells.begin(), cells.end());
+}
+
+void DrainageNetwork::rebuildCellList(int id)
+{
+    std::vector<int> &cells = basinCells[id];
+    cells.erase(std::remove_if(cells.begin(), cells.end(),
+                               [this, id](int c) { return basin[c] != id; }),
+                cells.end());
+}
+
+int DrainageNetwork::addOutlet(int cell)
+{
+    if (!labeled || cell < 0 || cell >= nRows * nCols)
+        return -1;
+
+    int id = int(outletCell.size());
+    int fromId = basin[cell];
+    outletCell.push_back(cell);
+    basinCells.push_back(std::vector<int>());
+
+    if (!isValid(cell))
+        return id;
+
+    relabelUpstream(cell, fromId, id);
+    if (fromId >= 0)
+        rebuildCellList(fromId);
+    return id;
+}
+
+void DrainageNetwork::removeOutlet(int id)
+{
+    if (!labeled || id < 0 || id >= int(outletCell.size()))
+        return;
+
+    // The basin merges into whatever catchment its outlet drains into
+    int cell = outletCell[id];
+    int below = isValid(cell) ? downstream(cell) : -1;
+    int toId = (below >= 0) ? basin[below] : -1;
+
+    std::vector<int> &cells = basinCells[id];
+    for (int c : cells)
+        basin[c] = toId;
+    if (toId >= 0) {
+        std::vector<int> &target = basinCells[toId];
+        size_t middle = target.size();
+        target.insert(target.end(), cells.begin(), cells.end());
+        std::inplace_merge(target.begin(), target.begin() + middle, target.end());
+    }
+    cells.clear();
+
+    // Swap-remove: the last catchment takes over the freed ID
+    int last = int(outletCell.size()) - 1;
+    if (id != last) {
+        for (int c : basinCells[last])
+            basin[c] = id;
+        basinCells[id].swap(basinCells[last]);
+        outletCell[id] = outletCell[last];
+    }
+    basinCells.pop_back();
+    outletCell.pop_back();
+}
@@ -0,0 +1,174 @@
+#ifndef DRAINAGENETWORK_H
+#define DRAINAGENETWORK_H
+
+#include <QtGlobal>
+#include <vector>
+#include <cstdint>
+
+/**
+ * @brief D8 drainage network and outlet catchments of a DEM
+ *
+ * Built once per DEM:
+ * 1. Priority-Flood depression filling, so every valid cell drains to the
+ *    grid edge or a NoData border
+ * 2. D8 steepest-descent flow directions on the filled surface
+ * 3. Topological (upstream-first) cell order and flow accumulation
+ *
+ * Double DEMs are filled with Priority-Flood+epsilon, which raises flats
+ * by one ulp per cell so steepest descent resolves them. Quantized DEMs are
+ * filled on their integer levels (bucket queue, binary heap for very large
+ * level ranges) and keep the filled surface as int32 levels, half the
+ * double copy; pits and flats are raised to the level of the cell that
+ * reached them and drain back towards it, the direction the epsilon
+ * gradient would give. Either way the network holds, per cell, the filled
+ * surface (8 or 4 bytes), a direction (1), the accumulation (4) and the
+ * topological order (4), plus 8 bytes once catchments are labeled.
+ *
+ * On top of the network, catchments are labeled per outlet with a reverse
+ * breadth-first search from all outlets at once. Single outlet insertions and
+ * removals relabel only the affected basins.
+ *
+ * All grids are flat, row-major, rows*cols in size (index = i * cols + j).
+ * Direction codes 0..7 follow N, NE, E, SE, S, SW, W, NW; -1 means the cell
+ * has no lower neighbour (it drains off the grid).
+ */
+class DrainageNetwork
+{
+public:
+    DrainageNetwork();
+
+    /**
+     * @brief Builds filled DEM, flow directions and accumulation
+     * @param elevations Row-major elevations; values <= -999998 are NoData
+     * @param rows Number of grid rows
+     * @param cols Number of grid columns
+     */
+    void build(std::vector<double> elevations, int rows, int cols);
+
+    /**
+     * @brief Builds the network of a quantized DEM from its integer levels
+     * @param levels Row-major levels, elevation = offset + scale * level; NO_DATA_LEVEL is NoData
+     * @param rows Number of grid rows
+     * @param cols Number of grid columns
+     * @param offset Elevation of level 0 (m)
+     * @param scale Elevation quantum (m)
+     */
+    void buildQuantized(std::vector<int32_t> levels, int rows, int cols, double offset, double scale);
+
+    /**
+     * @brief Drops the network and all catchment labels
+     */
+    void clear();
+
+    bool isBuilt() const { return built; }
+    int rowCount() const { return nRows; }
+    int columnCount() const { return nCols; }
+
+    /**
+     * @brief Labels the catchment of every outlet
+     * @param outlets Outlet cell indices; catchment IDs equal positions in this list
+     */
+    void labelCatchments(const std::vector<int> &outlets);
+
+    /**
+     * @brief Adds one outlet and relabels only the cells it captures
+     * @param cell Outlet cell index
+     * @return New catchment ID (== previous catchmentCount())
+     */
+    int addOutlet(int cell);
+
+    /**
+     * @brief Removes one outlet, merging its basin into the downstream basin
+     * @param id Catchment ID to remove
+     *
+     * The last catchment takes over the freed ID (swap-remove), mirroring how
+     * callers remove the outlet from their own index list.
+     */
+    void removeOutlet(int id);
+
+    bool hasCatchments() const { return labeled; }
+    int catchmentCount() const { return int(basinCells.size()); }
+
+    /**
+     * @brief Catchment ID of a cell, or -1 if it drains to no outlet
+     */
+    int catchmentAt(int index) const { return labeled ? basin[index] : -1; }
+
+    /**
+     * @brief Cells draining to one outlet (including the outlet itself)
+     */
+    const std::vector<int> &catchmentCells(int id) const { return basinCells[id]; }
+
+    const std::vector<int> &catchmentLabels() const { return basin; }
+    const std::vector<int8_t> &flowDirections() const { return direction; }
+
+    /**
+     * @brief Number of upstream cells per cell
+     */
+    const std::vector<uint32_t> &flowAccumulation() const { return accumulation; }
+
+    /**
+     * @brief Depression-filled elevation of a valid cell (m)
+     */
+    double filledElevation(int index) const
+    {
+        return quantized ? levelOffset + levelScale * filledLevels[index] : filled[index];
+    }
+
+    /**
+     * @brief Valid cells ordered so that every cell precedes its downstream cell
+     */
+    const std::vector<int> &topologicalOrder() const { return order; }
+
+    /**
+     * @brief Index of the D8 downstream neighbour, or -1
+     */
+    int downstream(int index) const;
+
+    bool isValid(int index) const
+    {
+        return quantized ? filledLevels[index] != NO_DATA_LEVEL : filled[index] > -999998.0;
+    }
+
+    /**
+     * @brief Bytes held by the network and its catchment labels
+     */
+    size_t memoryBytes() const;
+
+    static constexpr int32_t NO_DATA_LEVEL = INT32_MIN;
+
+    static const int DI[8];
+    static const int DJ[8];
+
+private:
+    void finishBuild();
+    void fillDepressions();
+    void fillDepressionLevels();
+    template <typename OpenQueue> qint64 priorityFlood(OpenQueue &open);
+    template <typename OpenQueue> qint64 priorityFloodLevels(OpenQueue &open);
+    template <typename OpenQueue> void seedBorder(OpenQueue &open, std::vector<uint8_t> &closed) const;
+    void computeDirections();
+    void computeAccumulation();
+    void relabelUpstream(int seed, int fromId, int toId);
+    void rebuildCellList(int id);
+
+    int nRows;
+    int nCols;
+    bool built;
+    bool labeled;
+    bool quantized;                   ///< Filled surface kept as filledLevels
+    double levelOffset;               ///< Elevation of level 0 (m)
+    double levelScale;                ///< Elevation quantum (m)
+
+    std::vector<double> filled;       ///< Priority-Flood+epsilon filled elevations of a double DEM
+    std::vector<int32_t> filledLevels; ///< Filled levels of a quantized DEM
+    std::vector<int8_t> direction;    ///< D8 code per cell, -1 = none
+    std::vector<uint32_t> accumulation; ///< Number of upstream cells
+    std::vector<int> order;           ///< Upstream-first topological order
+
+    std::vector<int> outletCell;               ///< Outlet cell per catchment ID
+    std::vector<int> basin;                    ///< Catchment ID per cell, -1 = none
+    std::vector<std::vector<int>> basinCells;  ///< Cells per catchment ID
+};
+
+#endif // DRAINAGENETWORK_H
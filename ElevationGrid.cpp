@@ -0,0 +1,143 @@
+/**
+ * @class ElevationGrid
+ * @brief DEM elevations stored as double or as quantized int16/int32 levels
+ */
+
+#include "ElevationGrid.h"
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+ElevationGrid::ElevationGrid()
+    : requestedStorage(ElevationStorage::Double),
+    requestedPrecision(0.01),
+    activeStorage(ElevationStorage::Double),
+    elevationOffset(0.0),
+    elevationScale(1.0),
+    nRows(0),
+    nCols(0)
+{
+}
+
+void ElevationGrid::setStorage(ElevationStorage storage, double precision)
+{
+    requestedStorage = storage;
+    requestedPrecision = precision > 0.0 ? precision : 0.01;
+}
+
+/**
+ * The offset is the range midpoint so that levels are centred on zero and
+ * the full signed range of the integer type is usable. Int16 keeps the
+ * requested precision only if the range fits 65534 levels; otherwise the
+ * grid falls back to Int32, which covers any terrain at millimetre precision.
+ */
+void ElevationGrid::allocate(int rows, int cols, double minElevation, double maxElevation)
+{
+    clear();
+    nRows = rows;
+    nCols = cols;
+
+    activeStorage = requestedStorage;
+    elevationScale = requestedPrecision;
+    if (maxElevation < minElevation)
+        minElevation = maxElevation = 0.0;
+    elevationOffset = 0.5 * (minElevation + maxElevation);
+    double halfRange = 0.5 * (maxElevation - minElevation) / elevationScale;
+
+    if (activeStorage == ElevationStorage::Int16 && halfRange > INT16_MAX - 1) {
+        qDebug() << "Elevation range" << minElevation << "-" << maxElevation << "needs"
+                 << qint64(2 * halfRange) << "levels at" << elevationScale << "m, using int32 storage";
+        activeStorage = ElevationStorage::Int32;
+    }
+    if (activeStorage == ElevationStorage::Int32 && halfRange > INT32_MAX - 1) {
+        qDebug() << "Elevation range too large for int32 at" << elevationScale << "m, using double storage";
+        activeStorage = ElevationStorage::Double;
+    }
+
+    switch (activeStorage) {
+    case ElevationStorage::Int16:
+        levels16.assign(rows, cols, NO_DATA_16, NO_DATA_16);
+        break;
+    case ElevationStorage::Int32:
+        levels32.assign(rows, cols, NO_DATA_32, NO_DATA_32);
+        break;
+    default:
+        elevationOffset = 0.0;
+        elevationScale = 1.0;
+        values.assign(rows, cols, NO_DATA, NO_DATA);
+        break;
+    }
+}
+
+void ElevationGrid::set(int i, int j, double value)
+{
+    const bool noData = value <= -999998.0;
+    switch (activeStorage) {
+    case ElevationStorage::Int16: {
+        double level = std::round((value - elevationOffset) / elevationScale);
+        levels16[i][j] = noData ? NO_DATA_16 : int16_t(std::clamp(level, double(INT16_MIN + 1), double(INT16_MAX)));
+        break;
+    }
+    case ElevationStorage::Int32: {
+        double level = std::round((value - elevationOffset) / elevationScale);
+        levels32[i][j] = noData ? NO_DATA_32 : int32_t(std::clamp(level, double(INT32_MIN + 1), double(INT32_MAX)));
+        break;
+    }
+    default:
+        values[i][j] = noData ? NO_DATA : value;
+        break;
+    }
+}
+
+void ElevationGrid::crop(int row, int col, int rows, int cols)
+{
+    switch (activeStorage) {
+    case ElevationStorage::Int16: {
+        PaddedGrid<int16_t> cropped;
+        cropped.assign(rows, cols, NO_DATA_16, NO_DATA_16);
+        for (int i = 0; i < rows; i++)
+            std::copy(levels16[row + i] + col, levels16[row + i] + col + cols, cropped[i]);
+        levels16.swap(cropped);
+        break;
+    }
+    case ElevationStorage::Int32: {
+        PaddedGrid<int32_t> cropped;
+        cropped.assign(rows, cols, NO_DATA_32, NO_DATA_32);
+        for (int i = 0; i < rows; i++)
+            std::copy(levels32[row + i] + col, levels32[row + i] + col + cols, cropped[i]);
+        levels32.swap(cropped);
+        break;
+    }
+    default: {
+        PaddedGrid<double> cropped;
+        cropped.assign(rows, cols, NO_DATA, NO_DATA);
+        for (int i = 0; i < rows; i++)
+            std::copy(values[row + i] + col, values[row + i] + col + cols, cropped[i]);
+        values.swap(cropped);
+        break;
+    }
+    }
+    nRows = rows;
+    nCols = cols;
+}
+
+void ElevationGrid::clear()
+{
+    values.clear();
+    levels32.clear();
+    levels16.clear();
+    nRows = nCols = 0;
+}
+
+size_t ElevationGrid::memoryBytes() const
+{
+    size_t padded = size_t(nRows + 2) * size_t(nCols + 2);
+    switch (activeStorage) {
+    case ElevationStorage::Int16:
+        return padded * sizeof(int16_t);
+    case ElevationStorage::Int32:
+        return padded * sizeof(int32_t);
+    default:
+        return padded * sizeof(double);
+    }
+}
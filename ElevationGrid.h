@@ -0,0 +1,161 @@
+#ifndef ELEVATIONGRID_H
+#define ELEVATIONGRID_H
+
+#include "PaddedGrid.h"
+#include <cstdint>
+
+/// Storage format of DEM elevations
+enum class ElevationStorage {
+    Double,     ///< 8 bytes per cell, exact
+    Int32,      ///< 4 bytes per cell, offset + scale * level
+    Int16       ///< 2 bytes per cell, offset + scale * level
+};
+
+/**
+ * @brief DEM elevation grid with optional integer quantization
+ *
+ * Quantized modes store elevation = offset + scale * level with one offset
+ * and scale per raster, chosen from the value range and the requested
+ * precision (e.g. 0.01 m). A 20k x 20k raster takes 0.8 GB as int16 instead
+ * of 3.2 GB as double. Only the loaded DEM (and the drainage network built
+ * from its levels) stays this compact: solver kernels, Fill-Spill-Merge and
+ * the multigrid levels expand the elevations again, at 8-32 bytes per cell.
+ * NoData cells hold the smallest level of the integer
+ * type and decode to -999999.0, the engine's NoData sentinel. If the range
+ * does not fit int16 at the requested precision, Int32 is used instead.
+ *
+ * Reads keep the nested-array syntax (grid[i][j] returns the decoded value);
+ * writes go through set(). Like PaddedGrid, the grid has a one-cell NoData
+ * halo, so neighbour reads need no bounds checks.
+ */
+class ElevationGrid
+{
+public:
+    static constexpr double NO_DATA = -999999.0;
+
+    /// Read-only row view returned by operator[]
+    class Row
+    {
+    public:
+        Row(const ElevationGrid &grid, int row) : grid(grid), row(row) {}
+        double operator[](int j) const { return grid.at(row, j); }
+
+    private:
+        const ElevationGrid &grid;
+        int row;
+    };
+
+    ElevationGrid();
+
+    /**
+     * @brief Selects the storage used by the next allocate()
+     * @param storage Storage format
+     * @param precision Quantum of the integer modes (m)
+     */
+    void setStorage(ElevationStorage storage, double precision);
+
+    /**
+     * @brief Allocates a NoData-filled grid and fixes the quantization
+     * @param rows Interior rows
+     * @param cols Interior columns
+     * @param minElevation Lowest valid elevation that will be stored
+     * @param maxElevation Highest valid elevation that will be stored
+     */
+    void allocate(int rows, int cols, double minElevation, double maxElevation);
+
+    /**
+     * @brief Stores one elevation (values <= -999998 are NoData)
+     */
+    void set(int i, int j, double value);
+
+    /**
+     * @brief Decoded elevation of cell (i, j); i and j may address the halo
+     */
+    double at(int i, int j) const
+    {
+        switch (activeStorage) {
+        case ElevationStorage::Int16: {
+            int16_t level = levels16[i][j];
+            return level == NO_DATA_16 ? NO_DATA : elevationOffset + elevationScale * level;
+        }
+        case ElevationStorage::Int32: {
+            int32_t level = levels32[i][j];
+            return level == NO_DATA_32 ? NO_DATA : elevationOffset + elevationScale * level;
+        }
+        default:
+            return values[i][j];
+        }
+    }
+
+    Row operator[](int i) const { return Row(*this, i); }
+
+    bool isValid(int i, int j) const { return at(i, j) > -999998.0; }
+
+    /**
+     * @brief Elevation difference at(i, j) - at(ni, nj) of two valid cells
+     *
+     * Quantized modes subtract the integer levels before scaling, so the
+     * difference is exact and independent of the offset.
+     */
+    double difference(int i, int j, int ni, int nj) const
+    {
+        switch (activeStorage) {
+        case ElevationStorage::Int16:
+            return elevationScale * (int32_t(levels16[i][j]) - int32_t(levels16[ni][nj]));
+        case ElevationStorage::Int32:
+            return elevationScale * (int64_t(levels32[i][j]) - int64_t(levels32[ni][nj]));
+        default:
+            return values[i][j] - values[ni][nj];
+        }
+    }
+
+    /**
+     * @brief Integer level of a cell in a quantized mode
+     * @return offset() + scale() * level is the elevation; NoData cells return INT32_MIN
+     */
+    int32_t level(int i, int j) const
+    {
+        if (activeStorage == ElevationStorage::Int16) {
+            int16_t level = levels16[i][j];
+            return level == NO_DATA_16 ? NO_DATA_32 : int32_t(level);
+        }
+        return levels32[i][j];
+    }
+
+    /**
+     * @brief Keeps only the sub-grid [row, row + rows) x [col, col + cols)
+     */
+    void crop(int row, int col, int rows, int cols);
+
+    void clear();
+
+    int rows() const { return nRows; }
+    int cols() const { return nCols; }
+    ElevationStorage storage() const { return activeStorage; }
+    bool isQuantized() const { return activeStorage != ElevationStorage::Double; }
+    double offset() const { return elevationOffset; }
+    double scale() const { return elevationScale; }
+
+    /**
+     * @brief Bytes held by the elevation storage
+     */
+    size_t memoryBytes() const;
+
+private:
+    static constexpr int16_t NO_DATA_16 = INT16_MIN;
+    static constexpr int32_t NO_DATA_32 = INT32_MIN;
+
+    ElevationStorage requestedStorage;
+    double requestedPrecision;
+    ElevationStorage activeStorage;
+    double elevationOffset;
+    double elevationScale;
+    int nRows;
+    int nCols;
+
+    PaddedGrid<double> values;      ///< Double storage
+    PaddedGrid<int32_t> levels32;   ///< Int32 storage
+    PaddedGrid<int16_t> levels16;   ///< Int16 storage
+};
+
+#endif // ELEVATIONGRID_H
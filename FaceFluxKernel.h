@@ -0,0 +1,273 @@
+#ifndef FACEFLUXKERNEL_H
+#define FACEFLUXKERNEL_H
+
+#include "FlowKernel.h"
+#include "Reduction.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * @brief Per-run stencils shared by all face-flux kernels and layouts
+ * @tparam Real float or double
+ *
+ * Each function processes the flat cell range [first, last) of one grid
+ * block whose 4-neighbours are at the given offsets (N, E, S, W).
+ *
+ * A face-flux scheme derives from this and adds the outflow rule:
+ * - setTerrain(resolution, manningN): caches terrain-only terms
+ * - computeOutflow(hp, bedDrop, Q_out, Q_total_out, first, last, offset, params):
+ *   writes every cell's outflow per face and its total (m³/s), mass-limited
+ *   so a cell never sends more than it holds; reads Q_total_out of the
+ *   previous step before overwriting it; returns the fastest flow velocity
+ *   of the range (m/s), 0 if the scheme does not need it
+ * - stableTimeStep(maxVelocity): longest stable step (s) given the fastest
+ *   velocity of the last step, infinity if unlimited
+ * The outflow rule is const during a pass, so threads share one instance.
+ */
+template <typename Real>
+struct FaceFluxStencil
+{
+    /// Bed height of faces leaving the domain: their gradient is never positive
+    static constexpr Real WALL_ELEVATION = Real(1.0e30);
+
+    /**
+     * @brief Adds the source depth delta, clamped at zero
+     * @return Depth sum of the run after the sources (m), in double
+     */
+    static double applySources(Real *hp, size_t first, size_t last, Real delta)
+    {
+        double runDepth = 0.0;
+        for (size_t c = first; c < last; c++) {
+            Real depth = hp[c] + delta;
+            if (depth < 0) depth = 0;
+            hp[c] = depth;
+            runDepth += double(depth);
+        }
+        return runDepth;
+    }
+
+    /**
+     * @brief Depth of cell c after the flux divergence, clamped at zero
+     */
+    static Real updatedDepth(const Real *hp, const std::array<Real, 4> *Q_out, const Real *Q_total_out,
+                             size_t c, const ptrdiff_t offset[4], Real dtOverArea)
+    {
+        // Scaled inflows TO cell c: each neighbour's face pointing back at c
+        Real inflow = 0;
+        for (int k = 0; k < 4; k++)
+            inflow += Q_out[c + offset[k]][(k + 2) % 4];
+
+        Real depth = hp[c] + (inflow - Q_total_out[c]) * dtOverArea;
+        return depth < 0 ? Real(0) : depth;
+    }
+};
+
+/**
+ * @brief Row-major flow kernel of a face-flux scheme, templated on the storage type
+ * @tparam Real float or double
+ * @tparam Stencil Outflow rule derived from FaceFluxStencil<Real>, e.g.
+ *         DiffusiveWaveStencil (diffusive-wave Manning) or WeightedCAStencil
+ *
+ * Depths, face coefficients and fluxes are stored and processed in Real, so
+ * the float instantiation halves the memory traffic of every sweep. Terrain
+ * enters only as per-face bed drops: a float elevation of a few hundred
+ * metres resolves only ~3e-5 m, but the drop between neighbours is small and
+ * keeps full relative precision. Volume totals are accumulated per
+ * reduction segment into a ReproducibleSum.
+ *
+ * Sweep 1 applies sources one row ahead of the outflow computation (outflow
+ * of row r needs the sourced depths of rows r-1..r+1). Outflows are stored
+ * already scaled by the mass-conservation factor of their source cell, so
+ * sweep 2 reads no neighbour depths and updates depths in place.
+ */
+template <typename Real, typename Stencil>
+class FaceFluxKernel : public FlowKernel
+{
+    static_assert(std::is_floating_point<Real>::value, "FaceFluxKernel needs a floating point type");
+
+public:
+    static constexpr Real WALL_ELEVATION = FaceFluxStencil<Real>::WALL_ELEVATION;
+
+    FaceFluxKernel() : maxVelocity(0) {}
+
+    KernelPrecision precision() const override
+    {
+        return std::is_same<Real, float>::value ? KernelPrecision::Float : KernelPrecision::Double;
+    }
+
+    KernelLayout layout() const override { return KernelLayout::RowMajor; }
+
+    void reset(int rows, int cols) override
+    {
+        depthGrid.assign(rows, cols, Real(0), Real(0));
+        spans.clear();
+        rowSpans.assign(rows + 1, 0);
+    }
+
+    /**
+     * Cells outside the domain are never written by the sweeps, so clearing
+     * the scratch grids here gives them zero outflow for the whole run.
+     */
+    void setDomain(const std::vector<CellSpan> &domainSpans, const std::vector<int> &domainRowSpans) override
+    {
+        spans = domainSpans;
+        rowSpans = domainRowSpans;
+        const std::array<Real, 4> noFlow = {Real(0), Real(0), Real(0), Real(0)};
+        outflow.assign(depthGrid.rows(), depthGrid.cols(), noFlow, noFlow);
+        totalOutflow.assign(depthGrid.rows(), depthGrid.cols(), Real(0), Real(0));
+    }
+
+    /**
+     * For each domain cell and face (N, E, S, W), faceBedDrop holds
+     * dem[cell] - dem[neighbour]. Faces towards inactive cells or the halo get
+     * -WALL_ELEVATION, which folds the validity test into the drop. Terms
+     * depending only on resolution and n are cached by the stencil.
+     */
+    void buildFaceCoefficients(const ElevationGrid &dem, const PaddedGrid<uint8_t> &mask,
+                               double resolution, double manningN) override
+    {
+        const std::array<Real, 4> wall = {-WALL_ELEVATION, -WALL_ELEVATION, -WALL_ELEVATION, -WALL_ELEVATION};
+        faceBedDrop.assign(depthGrid.rows(), depthGrid.cols(), wall, wall);
+
+        const int di[4] = {-1, 0, 1, 0}; // N, E, S, W
+        const int dj[4] = {0, 1, 0, -1};
+        for (const CellSpan &span : spans) {
+            const int i = span.row;
+            for (int j = span.begin; j < span.end; j++) {
+                std::array<Real, 4> &drop = faceBedDrop[i][j];
+                for (int k = 0; k < 4; k++) {
+                    int ni = i + di[k];
+                    int nj = j + dj[k];
+                    if (mask[ni][nj] != DOMAIN_INACTIVE)
+                        drop[k] = Real(dem.difference(i, j, ni, nj));
+                }
+            }
+        }
+        stencil.setTerrain(resolution, manningN);
+    }
+
+    double applySourcesAndOutflow(const KernelStepParameters &params) override
+    {
+        const int rows = depthGrid.rows();
+        ReproducibleSum systemDepth;
+        maxVelocity = 0;
+        for (int row = 0; row <= rows; row++) {
+            if (row < rows)
+                applySources(row, params, systemDepth);
+            if (row > 0)
+                computeOutflow(row - 1, params);
+        }
+        return systemDepth.value() * params.cellArea;
+    }
+
+    KernelStatistics updateDepths(const KernelStepParameters &params,
+                                  const std::function<double(int, int, double)> &drainOutlet) override
+    {
+        Real *hp = depthGrid.data();
+        const std::array<Real, 4> *Q_out = outflow.data();
+        const Real *Q_total_out = totalOutflow.data();
+        const ptrdiff_t stride = depthGrid.stride();
+        const ptrdiff_t offset[4] = {-stride, 1, stride, -1}; // N, E, S, W
+        const Real dtOverArea = Real(params.dt / params.cellArea);
+        const Real minDepth = Real(params.minDepth);
+
+        ReproducibleSum storedDepth;
+        qint64 wetCells = 0;
+        Real maxDepth = 0;
+        Real maxChange = 0;
+        for (const CellSpan &span : spans) {
+            const Real source = Real(spanSourceDepth(span, params));
+            for (int j = span.begin; j < span.end;) {
+                const int end = reductionSegmentEnd(j, span.end);
+                const size_t first = depthGrid.index(span.row, j);
+                const size_t last = first + size_t(end - j);
+                // Depth sum of the segment, in double so float storage does not lose volume
+                double segmentDepth = 0.0;
+                for (size_t c = first; c < last; c++) {
+                    const Real sourced = hp[c];
+                    Real depth = FaceFluxStencil<Real>::updatedDepth(hp, Q_out, Q_total_out, c, offset, dtOverArea);
+                    // Outlet spans are single cells split off by the domain builder
+                    if (span.outlet)
+                        depth = Real(drainOutlet(span.row, span.begin, double(depth)));
+                    hp[c] = depth;
+                    segmentDepth += double(depth);
+                    wetCells += (depth > minDepth);
+                    maxDepth = std::max(maxDepth, depth);
+                    maxChange = std::max(maxChange, stepDepthChange(depth, sourced, source));
+                }
+                storedDepth.add(segmentDepth);
+                j = end;
+            }
+        }
+        return {storedDepth.value() * params.cellArea, wetCells, double(maxDepth), 0, double(maxChange)};
+    }
+
+    double stableTimeStep() const override { return stencil.stableTimeStep(double(maxVelocity)); }
+
+    double depth(int i, int j) const override { return double(depthGrid[i][j]); }
+
+    void copyDepthRow(int i, float *out) const override
+    {
+        const Real *row = depthGrid[i];
+        for (int j = 0; j < depthGrid.cols(); j++)
+            out[j] = float(row[j]);
+    }
+
+    void loadDepthRow(int i, const float *in) override
+    {
+        Real *row = depthGrid[i];
+        for (int j = 0; j < depthGrid.cols(); j++)
+            row[j] = Real(in[j]);
+    }
+
+private:
+    /**
+     * @brief Rainfall and infiltration on one row; halo cells get no rain
+     */
+    void applySources(int row, const KernelStepParameters &params, ReproducibleSum &systemDepth)
+    {
+        Real *hp = depthGrid.data();
+        for (int s = rowSpans[row]; s < rowSpans[row + 1]; s++) {
+            const CellSpan &span = spans[s];
+            double rain = (span.role == DOMAIN_ACTIVE) ? params.rainfallRate : 0.0;
+            const Real delta = Real((rain - params.infiltrationRate) * params.dt);
+            for (int j = span.begin; j < span.end;) {
+                const int end = reductionSegmentEnd(j, span.end);
+                const size_t first = depthGrid.index(span.row, j);
+                systemDepth.add(FaceFluxStencil<Real>::applySources(hp, first, first + size_t(end - j), delta));
+                j = end;
+            }
+        }
+    }
+
+    /**
+     * @brief Mass-limited outflow per face for one row
+     */
+    void computeOutflow(int row, const KernelStepParameters &params)
+    {
+        const ptrdiff_t stride = depthGrid.stride();
+        const ptrdiff_t offset[4] = {-stride, 1, stride, -1}; // N, E, S, W
+        for (int s = rowSpans[row]; s < rowSpans[row + 1]; s++) {
+            const CellSpan &span = spans[s];
+            const size_t first = depthGrid.index(span.row, span.begin);
+            const size_t last = first + size_t(span.end - span.begin);
+            Real velocity = stencil.computeOutflow(depthGrid.data(), faceBedDrop.data(), outflow.data(),
+                                                   totalOutflow.data(), first, last, offset, params);
+            maxVelocity = std::max(maxVelocity, velocity);
+        }
+    }
+
+    PaddedGrid<Real> depthGrid;                     ///< Water depth (m), zero halo
+    PaddedGrid<std::array<Real, 4>> faceBedDrop;    ///< dem[cell] - dem[neighbour] per face (m)
+    Stencil stencil;                                ///< Outflow rule and its terrain terms
+    Real maxVelocity;                               ///< Fastest flow of the current step (m/s)
+    PaddedGrid<std::array<Real, 4>> outflow;        ///< Mass-limited outflow per face (m³/s)
+    PaddedGrid<Real> totalOutflow;                  ///< Sum of outflow per cell (m³/s)
+    std::vector<CellSpan> spans;                    ///< Domain spans, row-major
+    std::vector<int> rowSpans;                      ///< First span of each row
+};
+
+#endif // FACEFLUXKERNEL_H
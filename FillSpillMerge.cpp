@@ -0,0 +1,395 @@
+/**
+ * @class FillSpillMerge
+ * @brief Depression hierarchy (Barnes, Callaghan & Wickert 2020) and analytic depression storage
+ *
+ * Volumes are kept in m × cells (depth summed over cells) and scaled by the
+ * cell area only in the result, so the hierarchy does not depend on the
+ * resolution.
+ */
+
+#include "FillSpillMerge.h"
+#include "DrainageNetwork.h"
+#include <QDebug>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+
+FillSpillMerge::FillSpillMerge()
+    : built(false),
+    nRows(0),
+    nCols(0),
+    leafCount(0)
+{
+}
+
+void FillSpillMerge::clear()
+{
+    built = false;
+    nRows = nCols = leafCount = 0;
+    elevation.clear();
+    label.clear();
+    leafStart.clear();
+    leafCells.clear();
+    nodes.clear();
+    topLevel.clear();
+}
+
+/**
+ * @brief Seeds, floods and labels the DEM, then merges the saddles
+ */
+void FillSpillMerge::build(const std::vector<double> &elevations, int rows, int cols)
+{
+    clear();
+    if (rows <= 0 || cols <= 0 || elevations.size() != size_t(rows) * size_t(cols))
+        return;
+
+    nRows = rows;
+    nCols = cols;
+    elevation = elevations;
+    const int cellCount = rows * cols;
+    label.assign(cellCount, NONE);
+    auto valid = [&](int i, int j) {
+        return i >= 0 && i < rows && j >= 0 && j < cols && elevation[size_t(i) * cols + j] > -999998.0;
+    };
+
+    typedef std::pair<double, int> Entry;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+
+    // Ocean: valid cells on the grid edge or next to NoData
+    std::vector<char> pit(cellCount, 0);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            const int c = i * cols + j;
+            if (!valid(i, j))
+                continue;
+            bool border = false, lower = false;
+            for (int k = 0; k < 8; k++) {
+                const int ni = i + DrainageNetwork::DI[k];
+                const int nj = j + DrainageNetwork::DJ[k];
+                if (!valid(ni, nj))
+                    border = true;
+                else if (elevation[size_t(ni) * cols + nj] < elevation[c])
+                    lower = true;
+            }
+            if (border) {
+                label[c] = OCEAN;
+                open.push(Entry(elevation[c], c));
+            } else if (!lower) {
+                pit[c] = 1;
+            }
+        }
+    }
+
+    // Leaves: connected flats of pit cells, one label each
+    nodes.assign(1, Depression());
+    std::vector<int> flat;
+    for (int c = 0; c < cellCount; c++) {
+        if (!pit[c] || label[c] != NONE)
+            continue;
+        const int leaf = ++leafCount;
+        nodes.push_back(Depression());
+        label[c] = leaf;
+        flat.assign(1, c);
+        while (!flat.empty()) {
+            const int p = flat.back();
+            flat.pop_back();
+            open.push(Entry(elevation[p], p));
+            for (int k = 0; k < 8; k++) {
+                const int n = (p / cols + DrainageNetwork::DI[k]) * cols + (p % cols + DrainageNetwork::DJ[k]);
+                if (pit[n] && label[n] == NONE && elevation[n] == elevation[p]) {
+                    label[n] = leaf;
+                    flat.push_back(n);
+                }
+            }
+        }
+    }
+
+    // Flood from all seeds; differently labeled neighbours are saddles
+    std::vector<Saddle> saddles;
+    while (!open.empty()) {
+        const int c = open.top().second;
+        open.pop();
+        const int i = c / cols;
+        const int j = c % cols;
+        for (int k = 0; k < 8; k++) {
+            const int ni = i + DrainageNetwork::DI[k];
+            const int nj = j + DrainageNetwork::DJ[k];
+            if (!valid(ni, nj))
+                continue;
+            const int n = ni * cols + nj;
+            if (label[n] == NONE) {
+                label[n] = label[c];
+                open.push(Entry(elevation[n], n));
+            } else if (label[n] != label[c]) {
+                saddles.push_back({std::max(elevation[c], elevation[n]), std::min(c, n), std::max(c, n)});
+            }
+        }
+    }
+
+    // Cells grouped by leaf (counting sort), ocean cells excluded
+    leafStart.assign(leafCount + 2, 0);
+    for (int c = 0; c < cellCount; c++) {
+        if (label[c] > OCEAN)
+            leafStart[label[c] + 1]++;
+    }
+    for (int l = 1; l <= leafCount + 1; l++)
+        leafStart[l] += leafStart[l - 1];
+    leafCells.resize(leafStart[leafCount + 1]);
+    std::vector<int> fill(leafStart.begin(), leafStart.end() - 1);
+    for (int c = 0; c < cellCount; c++) {
+        if (label[c] > OCEAN)
+            leafCells[fill[label[c]]++] = c;
+    }
+
+    mergeSaddles(saddles);
+    built = true;
+    qDebug() << "Depression hierarchy:" << leafCount << "depressions," << nodes.size() - 1 - leafCount
+             << "merges," << topLevel.size() << "spilling off the DEM";
+}
+
+/**
+ * @brief Kruskal's algorithm over the saddles, with depression volumes
+ *
+ * Cells are added to their current root before every saddle above them, so
+ * at a depression's spill level e its root holds the count N and elevation
+ * sum S of its cells below e, and its capacity is N e - S. Merged roots add
+ * up their children's sums and keep counting from there.
+ */
+void FillSpillMerge::mergeSaddles(std::vector<Saddle> &saddles)
+{
+    std::sort(saddles.begin(), saddles.end());
+    saddles.erase(std::unique(saddles.begin(), saddles.end(), [](const Saddle &a, const Saddle &b) {
+        return a.cellA == b.cellA && a.cellB == b.cellB;
+    }), saddles.end());
+
+    std::vector<std::pair<double, int>> byElevation;
+    byElevation.reserve(leafCells.size());
+    for (int c : leafCells)
+        byElevation.push_back(std::make_pair(elevation[c], c));
+    std::sort(byElevation.begin(), byElevation.end());
+
+    std::vector<int> root(nodes.size());
+    for (size_t n = 0; n < root.size(); n++)
+        root[n] = int(n);
+    auto find = [&root](int node) {
+        while (root[node] != node) {
+            root[node] = root[root[node]];
+            node = root[node];
+        }
+        return node;
+    };
+    std::vector<double> count(nodes.size(), 0.0), sum(nodes.size(), 0.0);
+
+    auto setSpill = [&](int node, int parent, double level, int exitCell) {
+        Depression &d = nodes[node];
+        d.parent = parent;
+        d.spill = level;
+        d.exitCell = exitCell;
+        d.geolink = (exitCell != NONE) ? label[exitCell] : NONE;
+        d.capacity = std::max(0.0, count[node] * level - sum[node]);
+        d.ownCapacity = d.capacity;
+        if (d.child[0] != NONE)
+            d.ownCapacity = std::max(0.0, d.capacity - nodes[d.child[0]].capacity - nodes[d.child[1]].capacity);
+    };
+
+    size_t next = 0;
+    for (const Saddle &saddle : saddles) {
+        for (; next < byElevation.size() && byElevation[next].first < saddle.level; next++) {
+            const int r = find(label[byElevation[next].second]);
+            if (r != OCEAN) {
+                count[r] += 1.0;
+                sum[r] += byElevation[next].first;
+            }
+        }
+
+        const int a = find(label[saddle.cellA]);
+        const int b = find(label[saddle.cellB]);
+        if (a == b)
+            continue;
+        if (a == OCEAN || b == OCEAN) {
+            const int spilling = (a == OCEAN) ? b : a;
+            setSpill(spilling, OCEAN, saddle.level, (a == OCEAN) ? saddle.cellA : saddle.cellB);
+            root[spilling] = OCEAN;
+            topLevel.push_back(spilling);
+            continue;
+        }
+
+        const int merged = int(nodes.size());
+        nodes.push_back(Depression());
+        nodes[merged].child[0] = a;
+        nodes[merged].child[1] = b;
+        root.push_back(merged);
+        count.push_back(count[a] + count[b]);
+        sum.push_back(sum[a] + sum[b]);
+        setSpill(a, merged, saddle.level, saddle.cellB);
+        setSpill(b, merged, saddle.level, saddle.cellA);
+        root[a] = root[b] = merged;
+    }
+
+    // Depressions no saddle connects to the ocean hold water up to the highest cell
+    for (; next < byElevation.size(); next++) {
+        const int r = find(label[byElevation[next].second]);
+        if (r != OCEAN) {
+            count[r] += 1.0;
+            sum[r] += byElevation[next].first;
+        }
+    }
+    for (int n = 1; n < int(nodes.size()); n++) {
+        if (nodes[n].parent != NONE || find(n) != n)
+            continue;
+        qDebug() << "Depression" << n << "has no spill point, storing up to the highest cell";
+        setSpill(n, OCEAN, byElevation.back().first + 1.0, NONE);
+        topLevel.push_back(n);
+    }
+}
+
+void FillSpillMerge::subtreeCells(int node, std::vector<int> &cells) const
+{
+    cells.clear();
+    std::vector<int> stack(1, node);
+    while (!stack.empty()) {
+        const Depression &d = nodes[stack.back()];
+        const int n = stack.back();
+        stack.pop_back();
+        if (d.child[0] != NONE) {
+            stack.push_back(d.child[0]);
+            stack.push_back(d.child[1]);
+        } else {
+            cells.insert(cells.end(), leafCells.begin() + leafStart[n], leafCells.begin() + leafStart[n + 1]);
+        }
+    }
+}
+
+/**
+ * @brief Flat water level storing a volume over cells, at most the spill level
+ *
+ * With the k lowest cells (elevation sum S) flooded, a level L stores
+ * k L - S; the first k whose level stays below the next cell is the answer.
+ */
+double FillSpillMerge::waterLevel(const std::vector<int> &cells, double spill, double volume) const
+{
+    std::vector<double> z;
+    z.reserve(cells.size());
+    for (int c : cells) {
+        if (elevation[c] < spill)
+            z.push_back(elevation[c]);
+    }
+    std::sort(z.begin(), z.end());
+    double sum = 0.0;
+    for (size_t k = 0; k < z.size(); k++) {
+        sum += z[k];
+        const double level = (volume + sum) / double(k + 1);
+        if (k + 1 == z.size() || level <= z[k + 1])
+            return std::min(level, spill);
+    }
+    return spill;
+}
+
+/**
+ * @brief Fills the leaves and passes overflow along the hierarchy
+ */
+FillSpillMergeResult FillSpillMerge::route(double runoffDepth, double cellArea, const DrainageNetwork &network,
+                                           const std::vector<int> &outlets) const
+{
+    FillSpillMergeResult result;
+    result.outletVolume.assign(outlets.size(), 0.0);
+    if (!built)
+        return result;
+    result.depth.assign(elevation.size(), 0.0f);
+    if (runoffDepth <= 0.0 || cellArea <= 0.0)
+        return result;
+
+    const bool routed = network.hasCatchments() && network.rowCount() == nRows && network.columnCount() == nCols;
+    auto spillOff = [&](int cell, double volume) {
+        const int k = (routed && cell != NONE) ? network.catchmentAt(cell) : -1;
+        if (k >= 0 && k < int(outlets.size()))
+            result.outletVolume[k] += volume * cellArea;
+        else
+            result.offGridVolume += volume * cellArea;
+    };
+
+    // A leaf holding an outlet drains through it
+    std::vector<int> sink(nodes.size(), NONE);
+    for (size_t k = 0; k < outlets.size(); k++) {
+        const int c = outlets[k];
+        if (c >= 0 && c < int(label.size()) && label[c] > OCEAN && sink[label[c]] == NONE)
+            sink[label[c]] = int(k);
+    }
+
+    std::vector<double> stored(nodes.size(), 0.0);
+    std::vector<char> full(nodes.size(), 0);
+    auto addWater = [&](int node, double volume) {
+        while (true) {
+            if (sink[node] != NONE) {
+                result.outletVolume[sink[node]] += volume * cellArea;
+                return;
+            }
+            const Depression &d = nodes[node];
+            if (!full[node]) {
+                const double room = d.ownCapacity - stored[node];
+                if (volume <= room) {
+                    stored[node] += volume;
+                    return;
+                }
+                stored[node] = d.ownCapacity;
+                volume -= room;
+                full[node] = 1;
+            }
+            if (d.parent == OCEAN || d.parent == NONE) {
+                if (d.geolink == OCEAN || d.geolink == NONE) {
+                    spillOff(d.exitCell, volume);
+                    return;
+                }
+                node = d.geolink;
+                continue;
+            }
+            // Across the saddle into the sibling, or up once both are full
+            const Depression &p = nodes[d.parent];
+            const int sibling = (p.child[0] == node) ? p.child[1] : p.child[0];
+            node = full[sibling] ? d.parent : d.geolink;
+        }
+    };
+
+    for (size_t c = 0; c < label.size(); c++) {
+        if (label[c] == OCEAN)
+            spillOff(int(c), runoffDepth);
+    }
+    for (int leaf = 1; leaf <= leafCount; leaf++)
+        addWater(leaf, runoffDepth * double(leafStart[leaf + 1] - leafStart[leaf]));
+
+    // Levels from the top: a full depression or one holding water of its own
+    // sets a flat level over its whole subtree, otherwise its children do
+    std::vector<int> stack(topLevel.begin(), topLevel.end());
+    std::vector<int> cells;
+    while (!stack.empty()) {
+        const int node = stack.back();
+        stack.pop_back();
+        const Depression &d = nodes[node];
+        double level;
+        if (full[node]) {
+            level = d.spill;
+        } else if (stored[node] > 0.0) {
+            subtreeCells(node, cells);
+            level = waterLevel(cells, d.spill, stored[node] + d.capacity - d.ownCapacity);
+        } else {
+            if (d.child[0] != NONE) {
+                stack.push_back(d.child[0]);
+                stack.push_back(d.child[1]);
+            }
+            continue;
+        }
+        if (full[node])
+            subtreeCells(node, cells);
+        for (int c : cells) {
+            if (elevation[c] >= level)
+                continue;
+            result.depth[c] = float(level - elevation[c]);
+            result.maxDepth = std::max(result.maxDepth, double(result.depth[c]));
+        }
+    }
+
+    for (size_t n = 1; n < nodes.size(); n++)
+        result.pondedVolume += stored[n] * cellArea;
+    return result;
+}
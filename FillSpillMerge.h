@@ -0,0 +1,129 @@
+#ifndef FILLSPILLMERGE_H
+#define FILLSPILLMERGE_H
+
+#include <vector>
+
+class DrainageNetwork;
+
+/**
+ * @brief Ponded depths and outlet volumes of one Fill-Spill-Merge run
+ */
+struct FillSpillMergeResult
+{
+    std::vector<float> depth;           ///< Ponded water depth per cell (m), row-major
+    std::vector<double> outletVolume;   ///< Volume reaching each outlet (m³)
+    double offGridVolume = 0.0;         ///< Volume leaving the grid past every outlet (m³)
+    double pondedVolume = 0.0;          ///< Volume held in depressions (m³)
+    double maxDepth = 0.0;              ///< Deepest ponded water (m)
+};
+
+/**
+ * @brief Depression hierarchy and Fill-Spill-Merge routing (Barnes et al. 2020)
+ *
+ * Built once per DEM, on the raw (unfilled) elevations:
+ * 1. Every local minimum (a flat of cells with no lower 8-neighbour) seeds a
+ *    leaf depression; grid edge cells and cells next to NoData seed the
+ *    "ocean", where water leaves the DEM
+ * 2. A Priority-Flood from all seeds at once labels every cell with the
+ *    depression (or ocean) whose flood reaches it first and records the
+ *    saddle elevation max(z_a, z_b) of every pair of differently labeled
+ *    neighbours
+ * 3. Saddles are merged in ascending elevation with a union-find, which is
+ *    Kruskal's algorithm on the depressions: the first saddle that touches a
+ *    depression is its spill point. Two depressions spilling over the same
+ *    saddle merge into a parent that fills above it; a depression whose
+ *    spill point leads into a tree already draining to the ocean becomes a
+ *    top-level depression. Interleaving the saddles with the cells sorted by
+ *    elevation gives every depression its volume below the spill point.
+ *
+ * Routing then moves volumes, not cells: each leaf collects the runoff of
+ * its cells and, once full, overflows across its spill saddle into the leaf
+ * on the other side. When both children of a parent are full, further water
+ * fills the parent; a full top-level depression spills into the tree
+ * beyond its saddle or, across the border, into the outlet catchment of the
+ * cell there. One walk per leaf up the hierarchy, so a run costs a pass
+ * over the cells plus the depth of the tree per leaf. Water levels are
+ * flat per depression and solved exactly from the cells' elevations.
+ *
+ * Outlets inside a depression act as sinks: every drop reaching the leaf
+ * that holds the outlet leaves through it. Infiltration, timing and flow
+ * depths outside the depressions are not modelled; the result is the end
+ * state of a storage-dominated event.
+ */
+class FillSpillMerge
+{
+public:
+    FillSpillMerge();
+
+    /**
+     * @brief Builds the depression hierarchy of a DEM
+     * @param elevations Row-major raw elevations; values <= -999998 are NoData
+     * @param rows Number of grid rows
+     * @param cols Number of grid columns
+     */
+    void build(const std::vector<double> &elevations, int rows, int cols);
+
+    /**
+     * @brief Drops the hierarchy, e.g. when the DEM changes
+     */
+    void clear();
+
+    bool isBuilt() const { return built; }
+    int depressionCount() const { return leafCount; }
+
+    /**
+     * @brief Routes a uniform runoff depth through the depressions
+     * @param runoffDepth Runoff depth on every valid cell (m)
+     * @param cellArea Cell area (m²)
+     * @param network Network of the same DEM; water spilling out of the depressions
+     *        follows its catchments to the outlets
+     * @param outlets Outlet cells, in catchment ID order
+     */
+    FillSpillMergeResult route(double runoffDepth, double cellArea, const DrainageNetwork &network,
+                               const std::vector<int> &outlets) const;
+
+private:
+    static constexpr int NONE = -1;
+    static constexpr int OCEAN = 0;     ///< Node of everything draining off the DEM
+
+    /// One node of the hierarchy: a leaf depression or a merge of two
+    struct Depression {
+        int parent = NONE;              ///< Merged parent, OCEAN if top-level, NONE before the spill
+        int child[2] = {NONE, NONE};    ///< Children of a merged depression
+        int geolink = NONE;             ///< Label beyond the spill saddle: a leaf, or OCEAN
+        int exitCell = NONE;            ///< Cell beyond the spill saddle
+        double spill = 0.0;             ///< Spill elevation (m)
+        double capacity = 0.0;          ///< Volume below the spill over the whole subtree (m × cells)
+        double ownCapacity = 0.0;       ///< capacity minus the children's (m × cells)
+    };
+
+    /// Pair of neighbouring cells with different labels
+    struct Saddle {
+        double level;                   ///< max of the two elevations (m)
+        int cellA;
+        int cellB;
+        bool operator<(const Saddle &other) const
+        {
+            if (level != other.level) return level < other.level;
+            if (cellA != other.cellA) return cellA < other.cellA;
+            return cellB < other.cellB;
+        }
+    };
+
+    void mergeSaddles(std::vector<Saddle> &saddles);
+    void subtreeCells(int node, std::vector<int> &cells) const;
+    double waterLevel(const std::vector<int> &cells, double spill, double volume) const;
+
+    bool built;
+    int nRows;
+    int nCols;
+    int leafCount;
+    std::vector<double> elevation;      ///< Raw elevations (m)
+    std::vector<int> label;             ///< Leaf node or OCEAN per cell, NONE for NoData
+    std::vector<int> leafStart;         ///< First entry of each leaf in leafCells, leafCount+2 entries
+    std::vector<int> leafCells;         ///< Cells grouped by leaf node
+    std::vector<Depression> nodes;      ///< OCEAN, leaves 1..leafCount, then merged depressions
+    std::vector<int> topLevel;          ///< Depressions spilling towards the ocean
+};
+
+#endif // FILLSPILLMERGE_H
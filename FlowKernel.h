@@ -0,0 +1,177 @@
+#ifndef FLOWKERNEL_H
+#define FLOWKERNEL_H
+
+#include "ElevationGrid.h"
+#include <QtGlobal>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+class DrainageNetwork;
+
+/// Role of a cell in the computational domain
+enum DomainRole : uint8_t {
+    DOMAIN_INACTIVE = 0,           ///< NoData or outside the contributing area
+    DOMAIN_ACTIVE = 1,             ///< Receives rain and exchanges flow
+    DOMAIN_HALO = 2                ///< Flow-only buffer around the contributing area
+};
+
+/// Run of consecutive cells of one row sharing a non-inactive DomainRole
+struct CellSpan {
+    int row;
+    int begin;                     ///< First column
+    int end;                       ///< One past the last column
+    uint8_t role;                  ///< DOMAIN_ACTIVE or DOMAIN_HALO
+    bool outlet;                   ///< Single outlet cell, drained by the update sweep
+};
+
+/// Per-step inputs of a flow kernel
+struct KernelStepParameters {
+    double rainfallRate;           ///< Rainfall on active cells (m/s)
+    double infiltrationRate;       ///< Infiltration on all domain cells (m/s)
+    double minDepth;               ///< Depth below which a cell does not flow (m)
+    double dt;                     ///< Time step (s)
+    double cellArea;               ///< Cell area (m²)
+};
+
+/// Water state gathered by the update sweep
+struct KernelStatistics {
+    double storedVolume;           ///< Water stored on the grid (m³)
+    qint64 wetCells;               ///< Cells deeper than minDepth
+    double maxDepth;               ///< Deepest water (m)
+    int activeTiles;               ///< Tiles stepped by a tiled kernel, 0 for untiled kernels
+    double maxDepthChange;         ///< Largest depth change of a domain cell over the step (m)
+};
+
+/**
+ * @brief Rain minus infiltration added to the cells of a span in one step (m)
+ */
+inline double spanSourceDepth(const CellSpan &span, const KernelStepParameters &params)
+{
+    const double rain = (span.role == DOMAIN_ACTIVE) ? params.rainfallRate : 0.0;
+    return (rain - params.infiltrationRate) * params.dt;
+}
+
+/**
+ * @brief Depth change of a cell over a whole step, for the steady-state metric
+ * @param updated Depth after the update sweep
+ * @param sourced Depth after sweep 1, which added the step's source
+ * @param source spanSourceDepth() of the cell
+ *
+ * Sweep 1 clips depths at zero, so a cell that is dry after it is taken to
+ * have been dry before it.
+ */
+template <typename Real>
+inline Real stepDepthChange(Real updated, Real sourced, Real source)
+{
+    return std::abs(updated - sourced + (sourced > Real(0) ? source : Real(0)));
+}
+
+/// Storage and arithmetic precision of the flow kernel
+enum class KernelPrecision {
+    Double,
+    Float
+};
+
+/// Memory layout of the kernel grids
+enum class KernelLayout {
+    RowMajor,                      ///< One padded row-major grid per field
+    Tiled                          ///< Square tiles with halos, only domain tiles allocated
+};
+
+/**
+ * @brief Runtime interface of the grid flow kernel (a hydraulic solver)
+ *
+ * Implementations are created by name through FlowSolverRegistry.
+ *
+ * The kernel owns the water depth grid and everything the per-step stencils
+ * touch, stored in the kernel's real type. SimulationEngine owns the DEM, the
+ * domain definition, outlets and bookkeeping, and drives a step as:
+ * 1. applySourcesAndOutflow() - rain/infiltration and face outflows
+ * 2. updateDepths() - divergence, outlet drainage (callback) and statistics
+ *
+ * Volume totals are returned in double, accumulated in a ReproducibleSum
+ * whatever the storage precision, so they do not depend on the order in
+ * which cells or tiles are processed.
+ */
+class FlowKernel
+{
+public:
+    virtual ~FlowKernel() {}
+
+    virtual KernelPrecision precision() const = 0;
+    virtual KernelLayout layout() const = 0;
+
+    /**
+     * @brief Resizes the kernel to a grid and sets all depths to zero
+     */
+    virtual void reset(int rows, int cols) = 0;
+
+    /**
+     * @brief Sets the cells stepped by the kernel and clears the flux scratch
+     * @param spans Row-major domain spans
+     * @param rowSpans First span of each row, rows+1 entries
+     */
+    virtual void setDomain(const std::vector<CellSpan> &spans, const std::vector<int> &rowSpans) = 0;
+
+    /**
+     * @brief Hands the kernel the engine's D8 network, valid for the kernel's lifetime
+     *
+     * Read by routing kernels in buildFaceCoefficients(); grid solvers ignore it.
+     */
+    virtual void setDrainageNetwork(const DrainageNetwork *) {}
+
+    /**
+     * @brief Rebuilds the static per-face coefficients
+     * @param dem Ground elevation (m)
+     * @param mask DomainRole per cell
+     * @param resolution Cell size (m)
+     * @param manningN Manning's roughness coefficient
+     */
+    virtual void buildFaceCoefficients(const ElevationGrid &dem, const PaddedGrid<uint8_t> &mask,
+                                       double resolution, double manningN) = 0;
+
+    /**
+     * @brief Sweep 1: applies rain and infiltration and computes face outflows
+     * @return Water volume on the grid after the source terms (m³)
+     */
+    virtual double applySourcesAndOutflow(const KernelStepParameters &params) = 0;
+
+    /**
+     * @brief Sweep 2: applies the flux divergence and drains outlet spans
+     * @param drainOutlet Called once per outlet cell with (row, column, depth),
+     *        returns the depth left after drainage
+     */
+    virtual KernelStatistics updateDepths(const KernelStepParameters &params,
+                                          const std::function<double(int, int, double)> &drainOutlet) = 0;
+
+    /**
+     * @brief Longest time step the kernel is stable for in its current state (s)
+     *
+     * Infinite for kernels without a stability limit.
+     */
+    virtual double stableTimeStep() const { return std::numeric_limits<double>::infinity(); }
+
+    /**
+     * @brief Water depth of one cell (m)
+     */
+    virtual double depth(int i, int j) const = 0;
+
+    /**
+     * @brief Copies one row of water depths
+     * @param i Row index
+     * @param out Receives cols() values
+     */
+    virtual void copyDepthRow(int i, float *out) const = 0;
+
+    /**
+     * @brief Overwrites one row of water depths, e.g. with a warm start
+     * @param i Row index
+     * @param in cols() values, zero outside the domain
+     */
+    virtual void loadDepthRow(int i, const float *in) = 0;
+};
+
+#endif // FLOWKERNEL_H
@@ -0,0 +1,112 @@
+/**
+ * @class FlowSolverRegistry
+ * @brief Named factories of the hydraulic solvers
+ */
+
+#include "FlowSolverRegistry.h"
+#include "FaceFluxKernel.h"
+#include "TiledFaceFluxKernel.h"
+#include "DiffusiveWaveStencil.h"
+#include "WeightedCAStencil.h"
+#include "LocalInertialKernel.h"
+#include "KinematicWaveKernel.h"
+#include "QuadtreeKernel.h"
+
+namespace
+{
+
+template <typename Real> using DiffusiveWaveKernel = FaceFluxKernel<Real, DiffusiveWaveStencil<Real>>;
+template <typename Real> using TiledDiffusiveWaveKernel = TiledFaceFluxKernel<Real, DiffusiveWaveStencil<Real>>;
+template <typename Real> using WeightedCAKernel = FaceFluxKernel<Real, WeightedCAStencil<Real>>;
+template <typename Real> using TiledWeightedCAKernel = TiledFaceFluxKernel<Real, WeightedCAStencil<Real>>;
+
+/// Instantiates a kernel template in the requested precision
+template <template <typename> class Kernel, typename... Args>
+std::unique_ptr<FlowKernel> makeKernel(KernelPrecision precision, Args... args)
+{
+    if (precision == KernelPrecision::Float)
+        return std::unique_ptr<FlowKernel>(new Kernel<float>(args...));
+    return std::unique_ptr<FlowKernel>(new Kernel<double>(args...));
+}
+
+} // namespace
+
+FlowSolverRegistry &FlowSolverRegistry::instance()
+{
+    static FlowSolverRegistry registry;
+    return registry;
+}
+
+FlowSolverRegistry::FlowSolverRegistry()
+{
+    add("diffusive", "Diffusive-wave Manning flux with mass-limited outflow (fixed step)", true,
+        [](const KernelOptions &options) {
+            if (options.layout == KernelLayout::Tiled)
+                return makeKernel<TiledDiffusiveWaveKernel>(options.precision, options.tileSize, options.threads);
+            return makeKernel<DiffusiveWaveKernel>(options.precision);
+        });
+    add("inertial", "Local inertial shallow water (Bates 2010), CFL-limited steps", false,
+        [](const KernelOptions &options) {
+            return makeKernel<LocalInertialKernel>(options.precision, options.threads);
+        });
+    add("ca", "Weighted cellular automaton (WCA2D), fast screening with velocity-limited steps", true,
+        [](const KernelOptions &options) {
+            if (options.layout == KernelLayout::Tiled)
+                return makeKernel<TiledWeightedCAKernel>(options.precision, options.tileSize, options.threads);
+            return makeKernel<WeightedCAKernel>(options.precision);
+        });
+    add("kinematic", "Kinematic-wave routing along the D8 network, fast outlet hydrographs", false,
+        [](const KernelOptions &options) {
+            return makeKernel<KinematicWaveKernel>(options.precision);
+        });
+    add("quadtree", "Diffusive-wave Manning flux on an adaptive quadtree, coarse on flat or dry ground", false,
+        [](const KernelOptions &options) {
+            return makeKernel<QuadtreeKernel>(options.precision);
+        });
+}
+
+bool FlowSolverRegistry::add(const QString &name, const QString &description, bool supportsTiled,
+                             const Factory &factory)
+{
+    if (name.isEmpty() || !factory || contains(name))
+        return false;
+    entries.push_back({name, description, supportsTiled, factory});
+    return true;
+}
+
+QStringList FlowSolverRegistry::names() const
+{
+    QStringList result;
+    for (const Entry &entry : entries)
+        result << entry.name;
+    return result;
+}
+
+QString FlowSolverRegistry::description(const QString &name) const
+{
+    const Entry *entry = find(name);
+    return entry ? entry->description : QString();
+}
+
+bool FlowSolverRegistry::supportsTiled(const QString &name) const
+{
+    const Entry *entry = find(name);
+    return entry && entry->supportsTiled;
+}
+
+std::unique_ptr<FlowKernel> FlowSolverRegistry::create(const QString &name, const KernelOptions &options) const
+{
+    const Entry *entry = find(name);
+    if (!entry)
+        return nullptr;
+    return entry->factory(options);
+}
+
+const FlowSolverRegistry::Entry *FlowSolverRegistry::find(const QString &name) const
+{
+    for (const Entry &entry : entries) {
+        if (entry.name == name)
+            return &entry;
+    }
+    return nullptr;
+}
@@ -0,0 +1,87 @@
+#ifndef FLOWSOLVERREGISTRY_H
+#define FLOWSOLVERREGISTRY_H
+
+#include "FlowKernel.h"
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/// Construction options handed to a solver factory
+struct KernelOptions {
+    KernelPrecision precision;     ///< Storage type of depths and fluxes
+    KernelLayout layout;           ///< Requested layout, ignored by row-major-only solvers
+    int tileSize;                  ///< Tile side of the tiled layout (cells)
+    int threads;                   ///< Worker threads, 0 = one per core
+};
+
+/**
+ * @brief Named factories of the hydraulic solvers (FlowKernel implementations)
+ *
+ * The engine, the GUI and the benchmark select solvers by name through this
+ * registry, so a new solver is added by implementing FlowKernel and
+ * registering a factory; nothing else needs to know its type. The built-in
+ * solvers are registered by the constructor in a fixed order; the first
+ * one ("diffusive") is the default and the benchmark reference.
+ */
+class FlowSolverRegistry
+{
+public:
+    typedef std::function<std::unique_ptr<FlowKernel>(const KernelOptions &)> Factory;
+
+    /**
+     * @brief The process-wide registry with the built-in solvers
+     */
+    static FlowSolverRegistry &instance();
+
+    /**
+     * @brief Registers a solver
+     * @param name Unique lower-case name used on the command line and in the GUI
+     * @param description One-line description for tooltips and usage text
+     * @param supportsTiled True if the factory honours KernelLayout::Tiled
+     * @return false if the name is taken or the factory is empty
+     */
+    bool add(const QString &name, const QString &description, bool supportsTiled, const Factory &factory);
+
+    /**
+     * @brief Names of all solvers, in registration order
+     */
+    QStringList names() const;
+
+    bool contains(const QString &name) const { return find(name) != nullptr; }
+
+    /**
+     * @brief Description of a solver, empty if unknown
+     */
+    QString description(const QString &name) const;
+
+    /**
+     * @brief Tells whether a solver has a tiled implementation
+     */
+    bool supportsTiled(const QString &name) const;
+
+    /**
+     * @brief Creates a solver kernel
+     * @return The kernel, or nullptr if the name is unknown
+     */
+    std::unique_ptr<FlowKernel> create(const QString &name, const KernelOptions &options) const;
+
+private:
+    struct Entry {
+        QString name;
+        QString description;
+        bool supportsTiled;
+        Factory factory;
+    };
+
+    FlowSolverRegistry();
+    FlowSolverRegistry(const FlowSolverRegistry &) = delete;
+    FlowSolverRegistry &operator=(const FlowSolverRegistry &) = delete;
+
+    const Entry *find(const QString &name) const;
+
+    std::vector<Entry> entries;
+};
+
+#endif // FLOWSOLVERREGISTRY_H
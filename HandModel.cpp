@@ -0,0 +1,128 @@
+/**
+ * @class HandModel
+ * @brief HAND (Rennó et al. 2008, Nobre et al. 2011) and flat-stage inundation
+ */
+
+#include "HandModel.h"
+#include "DrainageNetwork.h"
+#include <QDebug>
+#include <algorithm>
+#include <utility>
+
+HandModel::HandModel()
+    : built(false),
+    builtThreshold(0.0)
+{
+}
+
+void HandModel::clear()
+{
+    built = false;
+    height.clear();
+    byHeight.clear();
+}
+
+/**
+ * @brief Walks the network downstream-first, inheriting the nearest channel cell
+ *
+ * Cells draining off the grid count as drainage, so every valid cell gets a
+ * HAND; the rest of the grid stays at -1.
+ */
+void HandModel::build(const DrainageNetwork &network, double channelThreshold)
+{
+    clear();
+    if (!network.isBuilt())
+        return;
+
+    const int cellCount = network.rowCount() * network.columnCount();
+    const std::vector<int> &order = network.topologicalOrder();
+    const std::vector<uint32_t> &accumulation = network.flowAccumulation();
+
+    std::vector<int> channel(cellCount, -1);
+    height.assign(cellCount, -1.0f);
+    for (auto it = order.rbegin(); it != order.rend(); ++it) {
+        const int c = *it;
+        const int down = network.downstream(c);
+        channel[c] = (down < 0 || accumulation[c] >= channelThreshold) ? c : channel[down];
+        height[c] = float(network.filledElevation(c) - network.filledElevation(channel[c]));
+    }
+
+    std::vector<std::pair<float, int>> sorted;
+    sorted.reserve(order.size());
+    for (int c : order)
+        sorted.push_back(std::make_pair(height[c], c));
+    std::sort(sorted.begin(), sorted.end());
+    byHeight.resize(sorted.size());
+    for (size_t k = 0; k < sorted.size(); k++)
+        byHeight[k] = sorted[k].second;
+
+    built = true;
+    builtThreshold = channelThreshold;
+    qDebug() << "HAND raster of" << byHeight.size() << "cells, channels from" << channelThreshold << "upstream cells";
+}
+
+double HandModel::mapStage(double stage, std::vector<float> &depth) const
+{
+    depth.assign(height.size(), 0.0f);
+    double maxDepth = 0.0;
+    for (size_t c = 0; c < height.size(); c++) {
+        if (height[c] < 0.0f || height[c] >= stage)
+            continue;
+        depth[c] = float(stage - height[c]);
+        maxDepth = std::max(maxDepth, double(depth[c]));
+    }
+    return maxDepth;
+}
+
+/**
+ * @brief Finds each catchment's stage in one walk over the cells by HAND
+ *
+ * With the n lowest cells of a catchment flooded (HAND sum S), a stage s
+ * stores A (n s - S). The walk stops raising a catchment's stage at the
+ * first cell whose HAND would already store more than its volume; the stage
+ * is then (V / A + S) / n, exact for the flat water surface.
+ */
+double HandModel::mapVolumes(const DrainageNetwork &network, const std::vector<double> &volume, double cellArea,
+                             std::vector<float> &depth) const
+{
+    depth.assign(height.size(), 0.0f);
+    const int catchments = std::min(int(volume.size()), network.catchmentCount());
+    if (!built || !network.hasCatchments() || catchments == 0 || cellArea <= 0.0)
+        return 0.0;
+
+    std::vector<double> target(catchments), flooded(catchments, 0.0), heightSum(catchments, 0.0);
+    std::vector<double> stage(catchments, -1.0);
+    std::vector<char> done(catchments, 0);
+    for (int k = 0; k < catchments; k++) {
+        target[k] = volume[k] / cellArea;
+        done[k] = target[k] <= 0.0;
+    }
+
+    for (int c : byHeight) {
+        const int k = network.catchmentAt(c);
+        if (k < 0 || k >= catchments || done[k])
+            continue;
+        const double h = height[c];
+        if (flooded[k] * h - heightSum[k] >= target[k]) {
+            stage[k] = (target[k] + heightSum[k]) / flooded[k];
+            done[k] = 1;
+            continue;
+        }
+        flooded[k] += 1.0;
+        heightSum[k] += h;
+    }
+    for (int k = 0; k < catchments; k++) {
+        if (!done[k] && flooded[k] > 0.0)
+            stage[k] = (target[k] + heightSum[k]) / flooded[k];
+    }
+
+    double maxDepth = 0.0;
+    for (size_t c = 0; c < height.size(); c++) {
+        const int k = height[c] >= 0.0f ? network.catchmentAt(int(c)) : -1;
+        if (k < 0 || k >= catchments || height[c] >= stage[k])
+            continue;
+        depth[c] = float(stage[k] - height[c]);
+        maxDepth = std::max(maxDepth, double(depth[c]));
+    }
+    return maxDepth;
+}
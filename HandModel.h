@@ -0,0 +1,79 @@
+#ifndef HANDMODEL_H
+#define HANDMODEL_H
+
+#include <vector>
+
+class DrainageNetwork;
+
+/**
+ * @brief Height Above Nearest Drainage (HAND) raster and inundation maps
+ *
+ * Channel cells are those whose flow accumulation reaches a threshold. Every
+ * other cell follows its D8 path on the filled DEM to the first channel
+ * cell, and its HAND is its filled elevation minus that channel cell's.
+ * Paths that leave the grid before meeting a channel are measured from the
+ * cell where they leave it.
+ *
+ * Built once per DEM and threshold: one pass over the network in reverse
+ * topological order, plus a sort of the cells by HAND. Inundation maps then
+ * need no time stepping:
+ * - stage: depth = max(0, stage - HAND) everywhere
+ * - volume per catchment: the stage of each outlet catchment is the one that
+ *   stores the given volume over its cells. One walk over the sorted cells
+ *   finds every catchment's stage exactly, a second pass writes the depths.
+ *
+ * Like the time-area surrogate this is a screening tool: it assumes the
+ * water surface is flat per catchment, relative to the drainage.
+ */
+class HandModel
+{
+public:
+    HandModel();
+
+    /**
+     * @brief Computes HAND for every cell
+     * @param network Built D8 network of the DEM
+     * @param channelThreshold Upstream cells at which a cell becomes a channel
+     */
+    void build(const DrainageNetwork &network, double channelThreshold);
+
+    /**
+     * @brief Drops the raster, e.g. when the DEM changes
+     */
+    void clear();
+
+    bool isBuilt() const { return built; }
+    bool isBuiltFor(double channelThreshold) const { return built && channelThreshold == builtThreshold; }
+
+    /**
+     * @brief HAND of a cell (m), negative for NoData cells
+     */
+    float heightAt(int index) const { return height[index]; }
+
+    /**
+     * @brief Maps inundation for one water stage above the drainage
+     * @param stage Water level above the nearest drainage (m)
+     * @param depth Receives the depth per cell (m), row-major
+     * @return Deepest water (m)
+     */
+    double mapStage(double stage, std::vector<float> &depth) const;
+
+    /**
+     * @brief Maps inundation that stores a given volume in each catchment
+     * @param network Network with labeled catchments
+     * @param volume Water volume per catchment ID (m³)
+     * @param cellArea Cell area (m²)
+     * @param depth Receives the depth per cell (m), row-major; zero outside catchments
+     * @return Deepest water (m)
+     */
+    double mapVolumes(const DrainageNetwork &network, const std::vector<double> &volume, double cellArea,
+                      std::vector<float> &depth) const;
+
+private:
+    bool built;
+    double builtThreshold;
+    std::vector<float> height;        ///< HAND per cell (m), -1 = NoData
+    std::vector<int> byHeight;        ///< Valid cells in ascending HAND order
+};
+
+#endif // HANDMODEL_H
@@ -0,0 +1,260 @@
+#ifndef KINEMATICWAVEKERNEL_H
+#define KINEMATICWAVEKERNEL_H
+
+#include "FlowKernel.h"
+#include "DrainageNetwork.h"
+#include "PaddedGrid.h"
+#include "Reduction.h"
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+/**
+ * @brief 1D kinematic-wave routing along the D8 drainage network
+ * @tparam Real float or double
+ *
+ * Each domain cell is a nonlinear reservoir that drains into its D8
+ * downstream cell with the Manning discharge of a sheet of width res,
+ *
+ *     Q = res h^(5/3) sqrt(S) / n
+ *
+ * where S is the slope of the Priority-Flood filled surface along the flow
+ * direction (at least MIN_SLOPE). The continuity equation is implicit in the
+ * outflow,
+ *
+ *     h' + k h'^(5/3) = h,    k = dt sqrt(S) / (n res)
+ *
+ * with h already holding this step's rain, infiltration and inflow. The
+ * sweep visits cells in topological (upstream-first) order, so every cell's
+ * inflow is final before the cell is solved and the outflow h - h' is added
+ * straight to the downstream depth: one pass per step, no face fluxes, and
+ * no stability limit on the step. The reservoir equation is a polynomial in
+ * h'^(1/3), solved by Newton's method in a few iterations.
+ *
+ * Outlet cells are sinks: they keep what reaches them and are drained by the
+ * engine's outlet callback during the sweep. Cells without a downstream
+ * domain cell (grid edge, NoData, inactive area) hold their water, like the
+ * walls of the grid solvers. Water only moves downhill along the tree, so
+ * depression storage and backwater are not modelled; the depth field is a
+ * by-product, the outlet hydrographs are the result.
+ *
+ * Per cell the kernel stores a depth, the depth after the step's sources
+ * (for the steady-state metric) and a route entry (cell, downstream cell,
+ * Manning factor). The sweep is sequential.
+ */
+template <typename Real>
+class KinematicWaveKernel : public FlowKernel
+{
+    static_assert(std::is_floating_point<Real>::value, "KinematicWaveKernel needs a floating point type");
+
+public:
+    static constexpr double MIN_SLOPE = 1.0e-4;     ///< Slope floor on filled flats
+    static constexpr double NEWTON_TOLERANCE = 1.0e-6;  ///< Relative change of h'^(1/3) that ends the solve
+    static constexpr int MAX_NEWTON_ITERATIONS = 20;
+
+    KinematicWaveKernel() : nRows(0), nCols(0), network(nullptr) {}
+
+    KernelPrecision precision() const override
+    {
+        return std::is_same<Real, float>::value ? KernelPrecision::Float : KernelPrecision::Double;
+    }
+
+    KernelLayout layout() const override { return KernelLayout::RowMajor; }
+
+    void reset(int rows, int cols) override
+    {
+        nRows = rows;
+        nCols = cols;
+        depthGrid.assign(size_t(rows) * size_t(cols), Real(0));
+        sourcedDepth.assign(size_t(rows) * size_t(cols), Real(0));
+        spans.clear();
+        route.clear();
+    }
+
+    void setDomain(const std::vector<CellSpan> &domainSpans, const std::vector<int> &) override
+    {
+        spans = domainSpans;
+    }
+
+    void setDrainageNetwork(const DrainageNetwork *drainageNetwork) override { network = drainageNetwork; }
+
+    /**
+     * Builds the route list: domain cells in topological order with their
+     * downstream domain cell and Manning factor sqrt(S) / (n res).
+     */
+    void buildFaceCoefficients(const ElevationGrid &, const PaddedGrid<uint8_t> &mask,
+                               double resolution, double manningN) override
+    {
+        route.clear();
+        if (!network || !network->isBuilt() || network->rowCount() != nRows || network->columnCount() != nCols) {
+            qDebug() << "Kinematic-wave routing needs the drainage network of the DEM; water will not move";
+            return;
+        }
+
+        std::vector<uint8_t> outlet(depthGrid.size(), 0);
+        for (const CellSpan &span : spans) {
+            if (span.outlet)
+                outlet[size_t(span.row) * nCols + span.begin] = 1;
+        }
+
+        const double diagonal = std::sqrt(2.0);
+        const double factor = 1.0 / (manningN * resolution);
+        for (int cell : network->topologicalOrder()) {
+            const int i = cell / nCols;
+            const int j = cell % nCols;
+            if (mask[i][j] == DOMAIN_INACTIVE)
+                continue;
+
+            RouteCell entry = {cell, -1, Real(0), outlet[cell] != 0};
+            const int down = network->downstream(cell);
+            if (!entry.outlet && down >= 0 && mask[down / nCols][down % nCols] != DOMAIN_INACTIVE) {
+                const int code = network->flowDirections()[cell];
+                const double length = (code % 2) ? resolution * diagonal : resolution;
+                const double slope = std::max(MIN_SLOPE, (network->filledElevation(cell) - network->filledElevation(down)) / length);
+                entry.downstream = down;
+                entry.manningFactor = Real(std::sqrt(slope) * factor);
+            }
+            route.push_back(entry);
+        }
+    }
+
+    double applySourcesAndOutflow(const KernelStepParameters &params) override
+    {
+        Real *hp = depthGrid.data();
+        ReproducibleSum systemDepth;
+        for (const CellSpan &span : spans) {
+            double rain = (span.role == DOMAIN_ACTIVE) ? params.rainfallRate : 0.0;
+            const Real delta = Real((rain - params.infiltrationRate) * params.dt);
+            for (int j = span.begin; j < span.end;) {
+                const int end = reductionSegmentEnd(j, span.end);
+                const size_t first = size_t(span.row) * nCols + j;
+                double segmentDepth = 0.0;
+                for (size_t c = first; c < first + size_t(end - j); c++) {
+                    Real depth = hp[c] + delta;
+                    if (depth < 0) depth = 0;
+                    hp[c] = depth;
+                    sourcedDepth[c] = depth;
+                    segmentDepth += double(depth);
+                }
+                systemDepth.add(segmentDepth);
+                j = end;
+            }
+        }
+        return systemDepth.value() * params.cellArea;
+    }
+
+    /**
+     * The routing sweep, then a row-major statistics pass with the same
+     * segment sums as the grid solvers. The sweep changes depths downstream
+     * of the cell it solves, so the statistics compare against a copy of the
+     * depths taken after the sources.
+     */
+    KernelStatistics updateDepths(const KernelStepParameters &params,
+                                  const std::function<double(int, int, double)> &drainOutlet) override
+    {
+        Real *hp = depthGrid.data();
+        const Real minDepth = Real(params.minDepth);
+        const Real dt = Real(params.dt);
+
+        for (const RouteCell &entry : route) {
+            const Real h = hp[entry.cell];
+            if (entry.outlet) {
+                hp[entry.cell] = Real(drainOutlet(entry.cell / nCols, entry.cell % nCols, double(h)));
+                continue;
+            }
+            // Dry cells are skipped even with minDepth = 0: the Newton step is 0/0 at h = 0
+            if (entry.downstream < 0 || h <= Real(0) || h < minDepth)
+                continue;
+            const Real remaining = reservoirDepth(h, dt * entry.manningFactor);
+            hp[entry.cell] = remaining;
+            hp[entry.downstream] += h - remaining;
+        }
+
+        ReproducibleSum storedDepth;
+        qint64 wetCells = 0;
+        Real maxDepth = 0;
+        Real maxChange = 0;
+        for (const CellSpan &span : spans) {
+            const Real source = Real(spanSourceDepth(span, params));
+            for (int j = span.begin; j < span.end;) {
+                const int end = reductionSegmentEnd(j, span.end);
+                const size_t first = size_t(span.row) * nCols + j;
+                double segmentDepth = 0.0;
+                for (size_t c = first; c < first + size_t(end - j); c++) {
+                    const Real depth = hp[c];
+                    segmentDepth += double(depth);
+                    wetCells += (depth > minDepth);
+                    maxDepth = std::max(maxDepth, depth);
+                    maxChange = std::max(maxChange, stepDepthChange(depth, sourcedDepth[c], source));
+                }
+                storedDepth.add(segmentDepth);
+                j = end;
+            }
+        }
+        return {storedDepth.value() * params.cellArea, wetCells, double(maxDepth), 0, double(maxChange)};
+    }
+
+    double depth(int i, int j) const override { return double(depthGrid[size_t(i) * nCols + j]); }
+
+    void copyDepthRow(int i, float *out) const override
+    {
+        const Real *row = depthGrid.data() + size_t(i) * nCols;
+        for (int j = 0; j < nCols; j++)
+            out[j] = float(row[j]);
+    }
+
+    void loadDepthRow(int i, const float *in) override
+    {
+        Real *row = depthGrid.data() + size_t(i) * nCols;
+        for (int j = 0; j < nCols; j++)
+            row[j] = Real(in[j]);
+    }
+
+private:
+    /// One domain cell of the routing sweep
+    struct RouteCell {
+        int cell;                   ///< Row-major cell index
+        int downstream;             ///< Downstream domain cell, -1 if the cell holds its water
+        Real manningFactor;         ///< sqrt(S) / (n res) (1/(m^(2/3) s))
+        bool outlet;                ///< Drained by the engine instead of routed
+    };
+
+    /**
+     * @brief Root of x + k x^(5/3) = h
+     *
+     * Solved for y = x^(1/3), where the equation becomes the polynomial
+     * y^3 + k y^5 = h and Newton steps need no pow. Both h^(1/3) and
+     * (h/k)^(1/5) bound the root from above (the second is the smaller one when
+     * k h^(2/3) > 1) and the polynomial is convex, so Newton's method from the
+     * smaller bound decreases monotonically towards the root. Requires h > 0.
+     */
+    static Real reservoirDepth(Real h, Real k)
+    {
+        const Real tolerance = Real(NEWTON_TOLERANCE);
+        Real y = std::cbrt(h);
+        if (k * y * y > Real(1))
+            y = std::pow(h / k, Real(0.2)); // Smaller bound: outflow dominates
+        for (int iteration = 0; iteration < MAX_NEWTON_ITERATIONS; iteration++) {
+            const Real y2 = y * y;
+            const Real ky4 = k * y2 * y2;
+            const Real step = (y2 * y + ky4 * y - h) / (Real(3) * y2 + Real(5) * ky4);
+            y -= step;
+            if (step <= tolerance * y)
+                break;
+        }
+        y = std::max(y, Real(0));
+        return y * y * y;
+    }
+
+    int nRows;
+    int nCols;
+    std::vector<Real> depthGrid;                    ///< Water depth (m), row-major, no halo
+    std::vector<Real> sourcedDepth;                 ///< Depths after this step's sources (m)
+    std::vector<RouteCell> route;                   ///< Domain cells, upstream first
+    std::vector<CellSpan> spans;                    ///< Domain spans, row-major
+    const DrainageNetwork *network;                 ///< Engine's D8 network, not owned
+};
+
+#endif // KINEMATICWAVEKERNEL_H
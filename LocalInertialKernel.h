@@ -0,0 +1,384 @@
+#ifndef LOCALINERTIALKERNEL_H
+#define LOCALINERTIALKERNEL_H
+
+#include "FlowKernel.h"
+#include "PaddedGrid.h"
+#include "Reduction.h"
+#include "TileScheduler.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+/**
+ * @brief Local inertial (Bates et al. 2010) shallow-water kernel
+ * @tparam Real float or double
+ *
+ * Unit-width discharges q (m²/s) live on cell faces and are carried from
+ * step to step. Each step updates them from the water surface slope with
+ * semi-implicit Manning friction,
+ *
+ *     q' = (q + g h_f dt S) / (1 + g dt n² |q| / h_f^(7/3))
+ *
+ * where S is the surface slope across the face and h_f the flow depth
+ * (higher water surface minus higher bed), then applies the divergence to
+ * the depths. The step is stable up to the CFL limit
+ * dt = CFL * res / sqrt(g h_max), which stableTimeStep() reports; on flat
+ * terrain that is far longer than the diffusive-wave kernel tolerates.
+ *
+ * Every cell owns its E and S faces. To keep depths non-negative without
+ * losing mass, a cell whose outgoing faces would drain more than it holds
+ * gets a limiter < 1 that scales those faces; the scaled discharge is what
+ * the divergence uses and what the next step starts from.
+ *
+ * Uses the row-major PaddedGrid layout. Rows are grouped into bands that the
+ * TileScheduler runs in parallel; each pass writes only its own band's cells
+ * and faces. Outlet cells are drained after the divergence pass on the
+ * calling thread, in row-major order, and volume partials are
+ * ReproducibleSums, so results do not depend on the thread count.
+ */
+template <typename Real>
+class LocalInertialKernel : public FlowKernel
+{
+    static_assert(std::is_floating_point<Real>::value, "LocalInertialKernel needs a floating point type");
+
+public:
+    static constexpr double GRAVITY = 9.81;         ///< m/s²
+    static constexpr double CFL = 0.7;              ///< Courant number of stableTimeStep()
+    static constexpr int ROW_BAND = 32;             ///< Rows per scheduler task
+
+    /**
+     * @param threads Worker threads, 0 = one per core
+     */
+    explicit LocalInertialKernel(int threads = 0)
+        : resolution(0), roughness(0), lastMaxDepth(0), scheduler(threads) {}
+
+    KernelPrecision precision() const override
+    {
+        return std::is_same<Real, float>::value ? KernelPrecision::Float : KernelPrecision::Double;
+    }
+
+    KernelLayout layout() const override { return KernelLayout::RowMajor; }
+
+    void reset(int rows, int cols) override
+    {
+        depthGrid.assign(rows, cols, Real(0), Real(0));
+        spans.clear();
+        rowSpans.assign(rows + 1, 0);
+        const int bandCount = (rows + ROW_BAND - 1) / ROW_BAND;
+        bands.resize(bandCount);
+        for (int b = 0; b < bandCount; b++)
+            bands[b] = b;
+        bandSourceDepth.assign(bandCount, ReproducibleSum());
+        bandStoredDepth.assign(bandCount, ReproducibleSum());
+        bandWetCells.assign(bandCount, 0);
+        bandMaxDepth.assign(bandCount, Real(0));
+        bandMaxChange.assign(bandCount, Real(0));
+        lastMaxDepth = 0;
+    }
+
+    /**
+     * Faces of cells outside the domain are never written, so clearing the
+     * discharges here keeps them at zero for the whole run.
+     */
+    void setDomain(const std::vector<CellSpan> &domainSpans, const std::vector<int> &domainRowSpans) override
+    {
+        spans = domainSpans;
+        rowSpans = domainRowSpans;
+        const std::array<Real, 2> noFlow = {Real(0), Real(0)};
+        discharge.assign(depthGrid.rows(), depthGrid.cols(), noFlow, noFlow);
+        limiter.assign(depthGrid.rows(), depthGrid.cols(), Real(1), Real(1));
+    }
+
+    /**
+     * For each domain cell, faceBedDrop holds dem[cell] - dem[neighbour] for
+     * the E and S faces; faces towards inactive cells or the halo are walls.
+     */
+    void buildFaceCoefficients(const ElevationGrid &dem, const PaddedGrid<uint8_t> &mask,
+                               double resolution, double manningN) override
+    {
+        const std::array<Real, 2> wall = {-WALL, -WALL};
+        faceBedDrop.assign(depthGrid.rows(), depthGrid.cols(), wall, wall);
+
+        const int di[2] = {0, 1}; // E, S
+        const int dj[2] = {1, 0};
+        for (const CellSpan &span : spans) {
+            const int i = span.row;
+            for (int j = span.begin; j < span.end; j++) {
+                std::array<Real, 2> &drop = faceBedDrop[i][j];
+                for (int k = 0; k < 2; k++) {
+                    int ni = i + di[k];
+                    int nj = j + dj[k];
+                    if (mask[ni][nj] != DOMAIN_INACTIVE)
+                        drop[k] = Real(dem.difference(i, j, ni, nj));
+                }
+            }
+        }
+        this->resolution = resolution;
+        roughness = manningN * manningN;
+    }
+
+    double applySourcesAndOutflow(const KernelStepParameters &params) override
+    {
+        scheduler.run(bands, [&](int b) { applySources(b, params); });
+        scheduler.run(bands, [&](int b) { updateDischarge(b, params); });
+        scheduler.run(bands, [&](int b) { updateLimiter(b, params); });
+
+        ReproducibleSum systemDepth;
+        for (int b : bands)
+            systemDepth.add(bandSourceDepth[b]);
+        return systemDepth.value() * params.cellArea;
+    }
+
+    KernelStatistics updateDepths(const KernelStepParameters &params,
+                                  const std::function<double(int, int, double)> &drainOutlet) override
+    {
+        scheduler.run(bands, [&](int b) { updateBand(b, params); });
+
+        // Outlet callbacks touch engine state, so they run here in row order
+        const Real dtOverRes = Real(params.dt / resolution);
+        Real *hp = depthGrid.data();
+        for (const CellSpan &span : spans) {
+            if (!span.outlet)
+                continue;
+            const int b = span.row / ROW_BAND;
+            const size_t c = depthGrid.index(span.row, span.begin);
+            const Real sourced = hp[c];
+            Real depth = Real(drainOutlet(span.row, span.begin, double(updatedDepth(c, dtOverRes))));
+            hp[c] = depth;
+            bandStoredDepth[b].add(double(depth));
+            bandWetCells[b] += (depth > Real(params.minDepth));
+            bandMaxDepth[b] = std::max(bandMaxDepth[b], depth);
+            bandMaxChange[b] = std::max(bandMaxChange[b],
+                                        stepDepthChange(depth, sourced, Real(spanSourceDepth(span, params))));
+        }
+
+        ReproducibleSum storedDepth;
+        qint64 wetCells = 0;
+        Real maxDepth = 0;
+        Real maxChange = 0;
+        for (int b : bands) {
+            storedDepth.add(bandStoredDepth[b]);
+            wetCells += bandWetCells[b];
+            maxDepth = std::max(maxDepth, bandMaxDepth[b]);
+            maxChange = std::max(maxChange, bandMaxChange[b]);
+        }
+        lastMaxDepth = double(maxDepth);
+        return {storedDepth.value() * params.cellArea, wetCells, lastMaxDepth, 0, double(maxChange)};
+    }
+
+    /**
+     * CFL limit of the gravity wave speed on the deepest water of the last
+     * step; unlimited while the grid is dry.
+     */
+    double stableTimeStep() const override
+    {
+        if (lastMaxDepth <= 0.0 || resolution <= 0.0)
+            return std::numeric_limits<double>::infinity();
+        return CFL * resolution / std::sqrt(GRAVITY * lastMaxDepth);
+    }
+
+    double depth(int i, int j) const override { return double(depthGrid[i][j]); }
+
+    void copyDepthRow(int i, float *out) const override
+    {
+        const Real *row = depthGrid[i];
+        for (int j = 0; j < depthGrid.cols(); j++)
+            out[j] = float(row[j]);
+    }
+
+    /**
+     * Discharges stay as they are; the CFL limit takes the loaded depths.
+     */
+    void loadDepthRow(int i, const float *in) override
+    {
+        Real *row = depthGrid[i];
+        for (int j = 0; j < depthGrid.cols(); j++) {
+            row[j] = Real(in[j]);
+            lastMaxDepth = std::max(lastMaxDepth, double(in[j]));
+        }
+    }
+
+private:
+    /// Bed drop of faces leaving the domain
+    static constexpr Real WALL = Real(1.0e30);
+
+    int bandEnd(int band) const { return std::min(depthGrid.rows(), (band + 1) * ROW_BAND); }
+
+    /**
+     * @brief Rainfall and infiltration on one band; halo cells get no rain
+     */
+    void applySources(int band, const KernelStepParameters &params)
+    {
+        Real *hp = depthGrid.data();
+        ReproducibleSum systemDepth;
+        for (int s = rowSpans[band * ROW_BAND]; s < rowSpans[bandEnd(band)]; s++) {
+            const CellSpan &span = spans[s];
+            double rain = (span.role == DOMAIN_ACTIVE) ? params.rainfallRate : 0.0;
+            const Real delta = Real((rain - params.infiltrationRate) * params.dt);
+            for (int j = span.begin; j < span.end;) {
+                const int end = reductionSegmentEnd(j, span.end);
+                const size_t first = depthGrid.index(span.row, j);
+                double segmentDepth = 0.0;
+                for (size_t c = first; c < first + size_t(end - j); c++) {
+                    Real depth = hp[c] + delta;
+                    if (depth < 0) depth = 0;
+                    hp[c] = depth;
+                    segmentDepth += double(depth);
+                }
+                systemDepth.add(segmentDepth);
+                j = end;
+            }
+        }
+        bandSourceDepth[band] = systemDepth;
+    }
+
+    /**
+     * @brief New E and S face discharges of one band
+     *
+     * The previous discharge enters scaled by the limiter of its upwind cell,
+     * i.e. as it was actually applied. Faces with a flow depth below minDepth
+     * carry nothing.
+     */
+    void updateDischarge(int band, const KernelStepParameters &params)
+    {
+        const Real *hp = depthGrid.data();
+        const Real *lim = limiter.data();
+        std::array<Real, 2> *q = discharge.data();
+        const std::array<Real, 2> *bedDrop = faceBedDrop.data();
+        const ptrdiff_t stride = depthGrid.stride();
+        const ptrdiff_t offset[2] = {1, stride}; // E, S
+        const Real minDepth = Real(params.minDepth);
+        const Real gDt = Real(GRAVITY * params.dt);
+        const Real gDtN2 = Real(GRAVITY * params.dt * roughness);
+        const Real invRes = Real(1.0 / resolution);
+        const Real sevenThirds = Real(7.0 / 3.0);
+
+        for (int s = rowSpans[band * ROW_BAND]; s < rowSpans[bandEnd(band)]; s++) {
+            const CellSpan &span = spans[s];
+            const size_t first = depthGrid.index(span.row, span.begin);
+            const size_t last = first + size_t(span.end - span.begin);
+            for (size_t c = first; c < last; c++) {
+                const Real h_i = hp[c];
+                for (int k = 0; k < 2; k++) {
+                    const size_t n = c + offset[k];
+                    const Real drop = bedDrop[c][k];
+                    const Real h_n = hp[n];
+                    // Flow depth: higher water surface above the higher bed
+                    Real flowDepth = (drop >= 0) ? std::max(h_i, h_n - drop) : std::max(h_i + drop, h_n);
+                    if (drop <= -WALL || flowDepth < minDepth) {
+                        q[c][k] = 0;
+                        continue;
+                    }
+                    Real previous = q[c][k];
+                    previous *= lim[previous >= 0 ? c : n];
+                    const Real slope = (h_i - h_n + drop) * invRes;
+                    q[c][k] = (previous + gDt * flowDepth * slope)
+                              / (Real(1) + gDtN2 * std::abs(previous) / std::pow(flowDepth, sevenThirds));
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Fraction of its outgoing discharge each cell of a band can supply
+     */
+    void updateLimiter(int band, const KernelStepParameters &params)
+    {
+        const Real *hp = depthGrid.data();
+        const std::array<Real, 2> *q = discharge.data();
+        Real *lim = limiter.data();
+        const ptrdiff_t stride = depthGrid.stride();
+        const Real dtOverRes = Real(params.dt / resolution);
+
+        for (int s = rowSpans[band * ROW_BAND]; s < rowSpans[bandEnd(band)]; s++) {
+            const CellSpan &span = spans[s];
+            const size_t first = depthGrid.index(span.row, span.begin);
+            const size_t last = first + size_t(span.end - span.begin);
+            for (size_t c = first; c < last; c++) {
+                Real out = std::max(q[c][0], Real(0)) + std::max(q[c][1], Real(0))
+                           + std::max(-q[c - 1][0], Real(0)) + std::max(-q[c - stride][1], Real(0));
+                out *= dtOverRes;
+                lim[c] = (out > hp[c]) ? hp[c] / out : Real(1);
+            }
+        }
+    }
+
+    /**
+     * @brief Depth of cell c after the limited flux divergence, clamped at zero
+     */
+    Real updatedDepth(size_t c, Real dtOverRes) const
+    {
+        const std::array<Real, 2> *q = discharge.data();
+        const Real *lim = limiter.data();
+        const ptrdiff_t stride = depthGrid.stride();
+        auto applied = [&](size_t from, int k, size_t to) {
+            Real flux = q[from][k];
+            return flux * lim[flux >= 0 ? from : to];
+        };
+        Real net = applied(c - 1, 0, c) + applied(c - stride, 1, c) - applied(c, 0, c + 1) - applied(c, 1, c + stride);
+        Real depth = depthGrid.data()[c] + net * dtOverRes;
+        return depth < 0 ? Real(0) : depth;
+    }
+
+    /**
+     * @brief Divergence and statistics of one band; outlet spans are left to updateDepths()
+     */
+    void updateBand(int band, const KernelStepParameters &params)
+    {
+        Real *hp = depthGrid.data();
+        const Real dtOverRes = Real(params.dt / resolution);
+        const Real minDepth = Real(params.minDepth);
+
+        ReproducibleSum storedDepth;
+        qint64 wetCells = 0;
+        Real maxDepth = 0;
+        Real maxChange = 0;
+        for (int s = rowSpans[band * ROW_BAND]; s < rowSpans[bandEnd(band)]; s++) {
+            const CellSpan &span = spans[s];
+            if (span.outlet)
+                continue;
+            const Real source = Real(spanSourceDepth(span, params));
+            for (int j = span.begin; j < span.end;) {
+                const int end = reductionSegmentEnd(j, span.end);
+                const size_t first = depthGrid.index(span.row, j);
+                double segmentDepth = 0.0;
+                for (size_t c = first; c < first + size_t(end - j); c++) {
+                    const Real sourced = hp[c];
+                    Real depth = updatedDepth(c, dtOverRes);
+                    hp[c] = depth;
+                    segmentDepth += double(depth);
+                    wetCells += (depth > minDepth);
+                    maxDepth = std::max(maxDepth, depth);
+                    maxChange = std::max(maxChange, stepDepthChange(depth, sourced, source));
+                }
+                storedDepth.add(segmentDepth);
+                j = end;
+            }
+        }
+        bandStoredDepth[band] = storedDepth;
+        bandWetCells[band] = wetCells;
+        bandMaxDepth[band] = maxDepth;
+        bandMaxChange[band] = maxChange;
+    }
+
+    PaddedGrid<Real> depthGrid;                     ///< Water depth (m), zero halo
+    PaddedGrid<std::array<Real, 2>> faceBedDrop;    ///< dem[cell] - dem[neighbour], E and S faces (m)
+    PaddedGrid<std::array<Real, 2>> discharge;      ///< Unit-width discharge out through E and S (m²/s)
+    PaddedGrid<Real> limiter;                       ///< Scale of each cell's outgoing discharge this step
+    double resolution;                              ///< Cell size (m)
+    double roughness;                               ///< Manning's n squared
+    double lastMaxDepth;                            ///< Deepest water after the last step (m)
+    std::vector<CellSpan> spans;                    ///< Domain spans, row-major
+    std::vector<int> rowSpans;                      ///< First span of each row
+    std::vector<int> bands;                         ///< Band numbers, the scheduler's task list
+    std::vector<ReproducibleSum> bandSourceDepth;   ///< Depth sum after sources (m)
+    std::vector<ReproducibleSum> bandStoredDepth;   ///< Depth sum after the update (m)
+    std::vector<qint64> bandWetCells;
+    std::vector<Real> bandMaxDepth;
+    std::vector<Real> bandMaxChange;
+    TileScheduler scheduler;
+};
+
+#endif // LOCALINERTIALKERNEL_H
@@ -0,0 +1,129 @@
+/**
+ * @class MultigridHierarchy
+ * @brief Min/mean DEM aggregation and volume-conserving depth prolongation
+ */
+
+#include "MultigridHierarchy.h"
+#include <QDebug>
+#include <algorithm>
+#include <utility>
+
+MultigridHierarchy::MultigridHierarchy()
+    : fineRows(0),
+    fineCols(0),
+    builtAggregation(MultigridAggregation::Min)
+{
+}
+
+void MultigridHierarchy::clear()
+{
+    coarse.clear();
+    fineRows = 0;
+    fineCols = 0;
+}
+
+/**
+ * @brief Aggregates every level straight from the full DEM
+ *
+ * Each level reads the full grid once, so the mean of a level is weighted by
+ * the valid cells it covers rather than by the valid cells of level k-1.
+ */
+void MultigridHierarchy::build(const std::vector<double> &elevations, int rows, int cols, int levels,
+                               MultigridAggregation aggregation)
+{
+    clear();
+    levels = std::min(levels, MAX_LEVELS);
+    if (rows <= 0 || cols <= 0 || levels <= 0 || elevations.size() != size_t(rows) * size_t(cols))
+        return;
+
+    fineRows = rows;
+    fineCols = cols;
+    builtAggregation = aggregation;
+    coarse.resize(levels);
+    for (int level = 1; level <= levels; level++) {
+        const int f = factor(level);
+        Level &target = coarse[level - 1];
+        target.rows = (rows + f - 1) / f;
+        target.cols = (cols + f - 1) / f;
+        target.elevation.assign(size_t(target.rows) * target.cols, -999999.0);
+        std::vector<double> sum(target.elevation.size(), 0.0);
+        std::vector<int> count(target.elevation.size(), 0);
+        for (int i = 0; i < rows; i++) {
+            const size_t first = size_t(i / f) * target.cols;
+            for (int j = 0; j < cols; j++) {
+                const double z = elevations[size_t(i) * cols + j];
+                if (z <= -999998.0)
+                    continue;
+                const size_t c = first + j / f;
+                sum[c] = (aggregation == MultigridAggregation::Min && count[c] > 0) ? std::min(sum[c], z) : sum[c] + z;
+                count[c]++;
+            }
+        }
+        for (size_t c = 0; c < sum.size(); c++) {
+            if (count[c] == 0)
+                continue;
+            target.elevation[c] = (aggregation == MultigridAggregation::Min) ? sum[c] : sum[c] / count[c];
+        }
+    }
+    qDebug() << "Multigrid hierarchy:" << levels << "levels, coarsest" << coarse.back().rows << "x"
+             << coarse.back().cols << (aggregation == MultigridAggregation::Min ? "(min)" : "(mean)");
+}
+
+/**
+ * @brief Gives the water of each coarse cell the flat surface over its 2 x 2 block
+ *
+ * With the block's valid cells sorted by elevation z_1 <= ... <= z_m, the
+ * level that floods the n lowest stores n * level - (z_1 + ... + z_n); the
+ * first n whose level stays below z_(n+1) is the solution. The coarse cell
+ * held 4 finer cell areas of water, so the block receives 4 h.
+ */
+double MultigridHierarchy::prolongate(int level, const std::vector<float> &depth,
+                                      const std::vector<double> &finerElevations,
+                                      std::vector<float> &finerDepth) const
+{
+    const int rows = (level == 1) ? fineRows : rowCount(level - 1);
+    const int cols = (level == 1) ? fineCols : columnCount(level - 1);
+    finerDepth.assign(size_t(rows) * size_t(cols), 0.0f);
+    if (level < 1 || level > levelCount() || depth.size() != size_t(rowCount(level)) * columnCount(level)
+        || finerElevations.size() != finerDepth.size())
+        return 0.0;
+
+    const int coarseCols = columnCount(level);
+    double handedOver = 0.0;
+    std::pair<double, size_t> block[4];
+    for (size_t c = 0; c < depth.size(); c++) {
+        if (depth[c] <= 0.0f)
+            continue;
+        const int i0 = 2 * int(c / coarseCols);
+        const int j0 = 2 * int(c % coarseCols);
+        int m = 0;
+        for (int i = i0; i < std::min(i0 + 2, rows); i++) {
+            for (int j = j0; j < std::min(j0 + 2, cols); j++) {
+                const size_t f = size_t(i) * cols + j;
+                if (finerElevations[f] <= -999998.0)
+                    continue;
+                // Insertion keeps the (at most 4) cells sorted by elevation
+                int n = m++;
+                for (; n > 0 && block[n - 1].first > finerElevations[f]; n--)
+                    block[n] = block[n - 1];
+                block[n] = std::make_pair(finerElevations[f], f);
+            }
+        }
+        if (m == 0)
+            continue;
+
+        const double volume = 4.0 * double(depth[c]);
+        double elevationSum = 0.0;
+        double surface = 0.0;
+        for (int n = 1; n <= m; n++) {
+            elevationSum += block[n - 1].first;
+            surface = (volume + elevationSum) / n;
+            if (n == m || surface <= block[n].first)
+                break;
+        }
+        for (int n = 0; n < m && block[n].first < surface; n++)
+            finerDepth[block[n].second] = float(surface - block[n].first);
+        handedOver += volume;
+    }
+    return handedOver;
+}
@@ -0,0 +1,98 @@
+#ifndef MULTIGRIDHIERARCHY_H
+#define MULTIGRIDHIERARCHY_H
+
+#include <vector>
+
+/// How a coarse cell's elevation is taken from the cells it covers
+enum class MultigridAggregation {
+    Min,                           ///< Lowest valid cell: keeps channels and flow paths connected
+    Mean                           ///< Mean of the valid cells: keeps the storage volume
+};
+
+/**
+ * @brief Decimated copies of a DEM for the coarse-to-fine warm start
+ *
+ * Level k aggregates blocks of 2^k x 2^k cells of the full-resolution DEM
+ * (level 0), so every cell of level k covers exactly 2 x 2 cells of level
+ * k-1, also at odd grid edges. A coarse cell is NoData only if all the cells
+ * it covers are.
+ *
+ * Prolongation hands a depth field one level down and conserves volume: the
+ * water of a coarse cell, spread over 4 finer cells, gets the flat surface
+ * that stores it over their own elevations (solved exactly with the cells
+ * sorted by elevation). Water therefore moves to the low parts of the block
+ * instead of draping it, and no volume is lost on blocks partly outside the
+ * DEM.
+ */
+class MultigridHierarchy
+{
+public:
+    MultigridHierarchy();
+
+    /**
+     * @brief Aggregates the coarse levels
+     * @param elevations Row-major full-resolution elevations; values <= -999998 are NoData
+     * @param rows Number of grid rows
+     * @param cols Number of grid columns
+     * @param levels Coarse levels to build, 1 (2x) to MAX_LEVELS (8x)
+     * @param aggregation Elevation rule of the coarse cells
+     */
+    void build(const std::vector<double> &elevations, int rows, int cols, int levels,
+               MultigridAggregation aggregation);
+
+    /**
+     * @brief Drops the levels, e.g. when the DEM changes
+     */
+    void clear();
+
+    bool isBuilt() const { return !coarse.empty(); }
+    bool isBuiltFor(int levels, MultigridAggregation aggregation) const
+    {
+        return int(coarse.size()) == levels && builtAggregation == aggregation;
+    }
+
+    /**
+     * @brief Number of coarse levels
+     */
+    int levelCount() const { return int(coarse.size()); }
+
+    /**
+     * @brief Cells of the full-resolution DEM per side of a cell of a level
+     */
+    static int factor(int level) { return 1 << level; }
+
+    int rowCount(int level) const { return coarse[level - 1].rows; }
+    int columnCount(int level) const { return coarse[level - 1].cols; }
+
+    /**
+     * @brief Row-major elevations of a coarse level (1 = 2x), NoData as -999999
+     */
+    const std::vector<double> &elevations(int level) const { return coarse[level - 1].elevation; }
+
+    /**
+     * @brief Prolongates a depth field from a level to the next finer one
+     * @param level Coarse level of the depth field (1 prolongates onto the full DEM)
+     * @param depth Row-major depths of the level (m)
+     * @param finerElevations Elevations of level - 1; the full DEM for level 1
+     * @param finerDepth Receives the depths of level - 1 (m), zero on NoData
+     * @return Water volume handed over, in finer cell areas times metres
+     */
+    double prolongate(int level, const std::vector<float> &depth, const std::vector<double> &finerElevations,
+                      std::vector<float> &finerDepth) const;
+
+    static constexpr int MAX_LEVELS = 3;
+
+private:
+    struct Level {
+        int rows;
+        int cols;
+        std::vector<double> elevation;
+    };
+
+    int fineRows;
+    int fineCols;
+    MultigridAggregation builtAggregation;
+    std::vector<Level> coarse;          ///< Level k at index k-1
+};
+
+#endif // MULTIGRIDHIERARCHY_H
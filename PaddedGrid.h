@@ -0,0 +1,116 @@
+#ifndef PADDEDGRID_H
+#define PADDEDGRID_H
+
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+/**
+ * @brief Row-major 2-D grid surrounded by a one-cell halo
+ *
+ * Interior cells are (0..rows-1, 0..cols-1); the halo cells at row/column -1
+ * and rows/cols hold a boundary value chosen by the owner (NoData, a wall
+ * elevation, zero flux). Stencil kernels can therefore address all four or
+ * eight neighbours of any interior cell without bounds checks.
+ *
+ * grid[i][j] works like a nested vector and also accepts -1 and cols as j.
+ * Kernels that walk rows use flat indices from index() together with
+ * stride(): the neighbours of flat index c are c - stride(), c + 1,
+ * c + stride() and c - 1.
+ */
+template <typename T>
+class PaddedGrid
+{
+public:
+    PaddedGrid() : nRows(0), nCols(0), rowStride(0) {}
+
+    /**
+     * @brief Resizes the grid and sets every cell
+     * @param rows Interior rows
+     * @param cols Interior columns
+     * @param value Value of interior cells
+     * @param haloValue Value of halo cells
+     */
+    void assign(int rows, int cols, const T &value, const T &haloValue)
+    {
+        nRows = rows;
+        nCols = cols;
+        rowStride = size_t(cols) + 2;
+        cells.assign(size_t(rows + 2) * rowStride, value);
+        fillHalo(haloValue);
+    }
+
+    /**
+     * @brief Overwrites the halo only
+     */
+    void fillHalo(const T &haloValue)
+    {
+        if (cells.empty())
+            return;
+        const size_t lastRow = size_t(nRows + 1) * rowStride;
+        for (size_t j = 0; j < rowStride; ++j) {
+            cells[j] = haloValue;
+            cells[lastRow + j] = haloValue;
+        }
+        for (int i = 0; i < nRows; ++i) {
+            cells[index(i, -1)] = haloValue;
+            cells[index(i, nCols)] = haloValue;
+        }
+    }
+
+    /**
+     * @brief Sets every interior cell, leaving the halo untouched
+     */
+    void fillInterior(const T &value)
+    {
+        for (int i = 0; i < nRows; ++i) {
+            T *row = (*this)[i];
+            for (int j = 0; j < nCols; ++j)
+                row[j] = value;
+        }
+    }
+
+    void swap(PaddedGrid &other)
+    {
+        std::swap(nRows, other.nRows);
+        std::swap(nCols, other.nCols);
+        std::swap(rowStride, other.rowStride);
+        cells.swap(other.cells);
+    }
+
+    void clear()
+    {
+        nRows = nCols = 0;
+        rowStride = 0;
+        cells.clear();
+    }
+
+    int rows() const { return nRows; }
+    int cols() const { return nCols; }
+    bool empty() const { return cells.empty(); }
+
+    /**
+     * @brief Distance between vertically adjacent cells in the flat storage
+     */
+    ptrdiff_t stride() const { return ptrdiff_t(rowStride); }
+
+    /**
+     * @brief Flat index of cell (i, j); i and j may address the halo
+     */
+    size_t index(int i, int j) const { return size_t(i + 1) * rowStride + size_t(j + 1); }
+
+    /// Pointer to column 0 of row i, so row[-1] and row[cols] are halo cells
+    T *operator[](int i) { return &cells[size_t(i + 1) * rowStride + 1]; }
+    const T *operator[](int i) const { return &cells[size_t(i + 1) * rowStride + 1]; }
+
+    T *data() { return cells.data(); }
+    const T *data() const { return cells.data(); }
+
+private:
+    int nRows;
+    int nCols;
+    size_t rowStride;
+    std::vector<T> cells;
+};
+
+#endif // PADDEDGRID_H
@@ -0,0 +1,592 @@
+#ifndef QUADTREEKERNEL_H
+#define QUADTREEKERNEL_H
+
+#include "FlowKernel.h"
+#include "DrainageNetwork.h"
+#include "PaddedGrid.h"
+#include "Reduction.h"
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
+/**
+ * @brief Diffusive-wave flow on an adaptive quadtree of the raster
+ * @tparam Real float or double
+ *
+ * Leaves are square blocks of 1 to 2^MAX_LEVEL cells per side, aligned to
+ * the raster. A block becomes one leaf when all its cells are domain cells
+ * of the same role and none of them needs the full resolution:
+ * - slope: the block's relief exceeds MAX_COARSE_SLOPE times its side
+ * - flow accumulation: the cell drains at least CHANNEL_CELLS upstream cells
+ * - outlets, which the engine drains cell by cell
+ * - wetting front: the cell lies within FRONT_BUFFER cells of a wet/dry
+ *   edge, or the block is wet and its water surface is not flat to the
+ *   relief tolerance
+ * Each leaf holds one depth over the mean elevation of its cells.
+ *
+ * Flow is the diffusive-wave Manning flux of the grid solver, exchanged
+ * across the faces between leaves. A face of width w between leaves whose
+ * centres lie d apart carries
+ *
+ *     Q = w h^(5/3) sqrt(delta_eta / d) / n
+ *
+ * with h the depth of the leaf with the higher water surface; between two
+ * single cells this is the grid solver's flux. Outflows are mass-limited
+ * per leaf like the grid solver's, and every face moves its volume from one
+ * leaf to the other, so the exchange across level boundaries conserves
+ * volume exactly. Faces are found along the east and south edge of each
+ * leaf, one run of cells per neighbouring leaf.
+ *
+ * The tree is rebuilt from the DEM and the current depths every
+ * ADAPT_INTERVAL simulated seconds, so it follows the water as it spreads.
+ * A rebuild spreads each old leaf's depth over its cells and averages the
+ * cells into the new leaves, which conserves volume. Depths read back per
+ * cell, so images and exports stay on the raster. The sweeps are
+ * sequential and, like the diffusive solver, have no stability limit of
+ * their own.
+ */
+template <typename Real>
+class QuadtreeKernel : public FlowKernel
+{
+    static_assert(std::is_floating_point<Real>::value, "QuadtreeKernel needs a floating point type");
+
+public:
+    static constexpr int MAX_LEVEL = 3;                 ///< Largest leaf: 8 x 8 cells
+    static constexpr double MAX_COARSE_SLOPE = 0.02;    ///< Relief per block side allowed in a coarse leaf
+    static constexpr double CHANNEL_CELLS = 100.0;      ///< Upstream cells that keep a cell at full resolution
+    static constexpr int FRONT_BUFFER = 8;              ///< Cells around a wetting front kept at full resolution
+    static constexpr double ADAPT_INTERVAL = 30.0;      ///< Simulated time between rebuilds of the tree (s)
+
+    QuadtreeKernel()
+        : nRows(0), nCols(0), network(nullptr), resolution(0), manningN(0),
+        sinceAdapt(0), staged(false), stale(true)
+    {
+    }
+
+    KernelPrecision precision() const override
+    {
+        return std::is_same<Real, float>::value ? KernelPrecision::Float : KernelPrecision::Double;
+    }
+
+    KernelLayout layout() const override { return KernelLayout::RowMajor; }
+
+    void reset(int rows, int cols) override
+    {
+        nRows = rows;
+        nCols = cols;
+        spans.clear();
+        leaves.clear();
+        faces.clear();
+        leafOf.assign(size_t(rows) * size_t(cols), -1);
+        cellDepth.clear();
+        staged = false;
+        stale = true;
+        sinceAdapt = 0;
+    }
+
+    void setDomain(const std::vector<CellSpan> &domainSpans, const std::vector<int> &) override
+    {
+        spans = domainSpans;
+        stale = true;
+    }
+
+    void setDrainageNetwork(const DrainageNetwork *drainageNetwork) override { network = drainageNetwork; }
+
+    /**
+     * Stores elevations and the cells that must stay at full resolution;
+     * the tree itself is built at the next step, with that step's minDepth.
+     *
+     * Elevations are kept relative to the lowest domain cell, computed in
+     * double: absolute float elevations of a few hundred metres resolve only
+     * ~3e-5 m, the order of minDepth, which would quantise thin sheet-flow
+     * surface gradients away. Only differences enter the fluxes.
+     */
+    void buildFaceCoefficients(const ElevationGrid &dem, const PaddedGrid<uint8_t> &mask,
+                               double cellSize, double roughness) override
+    {
+        resolution = cellSize;
+        manningN = roughness;
+        const size_t cells = size_t(nRows) * size_t(nCols);
+        elevation.assign(cells, Real(0));
+        cellFlags.assign(cells, 0);
+        double base = std::numeric_limits<double>::max();
+        for (int i = 0; i < nRows; i++) {
+            for (int j = 0; j < nCols; j++) {
+                const size_t c = size_t(i) * nCols + j;
+                cellFlags[c] = mask[i][j] & ROLE_BITS;
+                if (cellFlags[c] != DOMAIN_INACTIVE)
+                    base = std::min(base, dem[i][j]);
+            }
+        }
+        for (size_t c = 0; c < cells; c++) {
+            if (cellFlags[c] != DOMAIN_INACTIVE)
+                elevation[c] = Real(dem[c / nCols][c % nCols] - base);
+        }
+        for (const CellSpan &span : spans) {
+            if (span.outlet)
+                cellFlags[size_t(span.row) * nCols + span.begin] |= OUTLET_CELL | FINE_CELL;
+        }
+        if (network && network->isBuilt() && network->rowCount() == nRows && network->columnCount() == nCols) {
+            const std::vector<uint32_t> &accumulation = network->flowAccumulation();
+            for (size_t c = 0; c < cells; c++) {
+                if (accumulation[c] >= CHANNEL_CELLS)
+                    cellFlags[c] |= FINE_CELL;
+            }
+        }
+        stale = true;
+    }
+
+    double applySourcesAndOutflow(const KernelStepParameters &params) override
+    {
+        if (stale || sinceAdapt >= ADAPT_INTERVAL) {
+            const bool rebuilt = stale;
+            adapt(Real(params.minDepth));
+            if (rebuilt)
+                qDebug() << "Quadtree mesh:" << leaves.size() << "leaves," << faces.size() << "faces";
+        }
+        sinceAdapt += params.dt;
+
+        ReproducibleSum systemDepth;
+        const Real active = Real((params.rainfallRate - params.infiltrationRate) * params.dt);
+        const Real halo = Real(-params.infiltrationRate * params.dt);
+        const int leafCount = int(leaves.size());
+        for (int l = 0; l < leafCount;) {
+            const int end = reductionSegmentEnd(l, leafCount);
+            double segmentDepth = 0.0;
+            for (; l < end; l++) {
+                Leaf &leaf = leaves[l];
+                Real depth = leaf.depth + (leaf.role == DOMAIN_ACTIVE ? active : halo);
+                if (depth < 0) depth = 0;
+                leaf.depth = depth;
+                leaf.sourced = depth;
+                segmentDepth += double(depth) * leaf.cells;
+            }
+            systemDepth.add(segmentDepth);
+        }
+
+        computeFluxes(params);
+        return systemDepth.value() * params.cellArea;
+    }
+
+    /**
+     * Moves each face's volume between its leaves, drains the outlet leaves
+     * and gathers the statistics per leaf, weighted by its cells.
+     */
+    KernelStatistics updateDepths(const KernelStepParameters &params,
+                                  const std::function<double(int, int, double)> &drainOutlet) override
+    {
+        const Real dtOverArea = Real(params.dt / params.cellArea);
+        for (size_t f = 0; f < faces.size(); f++) {
+            const Real exchange = faceFlux[f] * dtOverArea;   // m × cells, positive from a to b
+            if (exchange == 0)
+                continue;
+            Leaf &a = leaves[faces[f].a];
+            Leaf &b = leaves[faces[f].b];
+            a.depth -= exchange / Real(a.cells);
+            b.depth += exchange / Real(b.cells);
+        }
+
+        const Real minDepth = Real(params.minDepth);
+        const Real active = Real((params.rainfallRate - params.infiltrationRate) * params.dt);
+        const Real halo = Real(-params.infiltrationRate * params.dt);
+        ReproducibleSum storedDepth;
+        qint64 wetCells = 0;
+        Real maxDepth = 0;
+        Real maxChange = 0;
+        const int leafCount = int(leaves.size());
+        for (int l = 0; l < leafCount;) {
+            const int end = reductionSegmentEnd(l, leafCount);
+            double segmentDepth = 0.0;
+            for (; l < end; l++) {
+                Leaf &leaf = leaves[l];
+                Real depth = leaf.depth < 0 ? Real(0) : leaf.depth;
+                if (leaf.outlet)
+                    depth = Real(drainOutlet(leaf.row, leaf.col, double(depth)));
+                leaf.depth = depth;
+                segmentDepth += double(depth) * leaf.cells;
+                if (depth > minDepth)
+                    wetCells += leaf.cells;
+                maxDepth = std::max(maxDepth, depth);
+                const Real source = (leaf.role == DOMAIN_ACTIVE) ? active : halo;
+                maxChange = std::max(maxChange, stepDepthChange(depth, leaf.sourced, source));
+            }
+            storedDepth.add(segmentDepth);
+        }
+        return {storedDepth.value() * params.cellArea, wetCells, double(maxDepth), 0, double(maxChange)};
+    }
+
+    double depth(int i, int j) const override
+    {
+        const size_t c = size_t(i) * nCols + j;
+        if (staged)
+            return double(cellDepth[c]);
+        return leafOf[c] < 0 ? 0.0 : double(leaves[leafOf[c]].depth);
+    }
+
+    void copyDepthRow(int i, float *out) const override
+    {
+        const size_t first = size_t(i) * nCols;
+        for (int j = 0; j < nCols; j++) {
+            const size_t c = first + j;
+            if (staged)
+                out[j] = float(cellDepth[c]);
+            else
+                out[j] = leafOf[c] < 0 ? 0.0f : float(leaves[leafOf[c]].depth);
+        }
+    }
+
+    /**
+     * Rows are staged on the raster until the next step rebuilds the tree
+     * from them, since one row may cut through coarse leaves.
+     */
+    void loadDepthRow(int i, const float *in) override
+    {
+        if (!staged)
+            expandLeaves();
+        Real *row = cellDepth.data() + size_t(i) * nCols;
+        for (int j = 0; j < nCols; j++)
+            row[j] = Real(in[j]);
+        staged = true;
+        stale = true;
+    }
+
+private:
+    static constexpr uint8_t ROLE_BITS = 0x3;       ///< DomainRole of the cell
+    static constexpr uint8_t FINE_CELL = 0x4;       ///< Outlet or channel: never merged
+    static constexpr uint8_t OUTLET_CELL = 0x8;
+
+    /// One square block of cells sharing a depth
+    struct Leaf {
+        int row;                    ///< First row
+        int col;                    ///< First column
+        int size;                   ///< Cells per side
+        int cells;                  ///< size * size
+        Real bed;                   ///< Mean elevation of the cells above the lowest domain cell (m)
+        Real depth;                 ///< Water depth (m)
+        Real sourced;               ///< Depth after this step's sources (m)
+        uint8_t role;               ///< DomainRole shared by the cells
+        bool outlet;                ///< Single outlet cell, drained by the engine
+    };
+
+    /// Boundary between two leaves
+    struct Face {
+        int a;
+        int b;
+        Real conveyance;            ///< w / (n sqrt(d)), Q = conveyance h^(5/3) sqrt(delta_eta)
+    };
+
+    /// Merge state of an aligned block while the tree is built
+    struct Block {
+        Real minZ, maxZ;            ///< Bed elevation range (m)
+        Real minEta, maxEta;        ///< Water surface range (m)
+        int wet;                    ///< Cells at or above minDepth
+        uint8_t role;
+        bool merged;                ///< All cells may share one leaf
+    };
+
+    /**
+     * @brief Mass-limited Manning flux of every face, signed from a to b
+     */
+    void computeFluxes(const KernelStepParameters &params)
+    {
+        const Real minDepth = Real(params.minDepth);
+        const Real dt = Real(params.dt);
+        const Real cellArea = Real(params.cellArea);
+
+        // Water surface and h^(5/3) once per leaf rather than per face
+        leafSurface.resize(leaves.size());
+        leafDepthTerm.resize(leaves.size());
+        for (size_t l = 0; l < leaves.size(); l++) {
+            const Real h = leaves[l].depth;
+            leafSurface[l] = leaves[l].bed + h;
+            leafDepthTerm[l] = (h < minDepth) ? Real(0) : h * std::cbrt(h * h);
+        }
+
+        leafOutflow.assign(leaves.size(), Real(0));
+        faceFlux.resize(faces.size());
+        for (size_t f = 0; f < faces.size(); f++) {
+            const Face &face = faces[f];
+            const Real deltaEta = leafSurface[face.a] - leafSurface[face.b];
+            const int up = (deltaEta > 0) ? face.a : face.b;
+            const Real Q = face.conveyance * leafDepthTerm[up] * std::sqrt(std::abs(deltaEta));
+            faceFlux[f] = (up == face.a) ? Q : -Q;
+            leafOutflow[up] += Q;
+        }
+
+        // Mass conservation: scale a leaf's outflows if they would drain more than it holds
+        for (size_t l = 0; l < leaves.size(); l++) {
+            const Real total = leafOutflow[l];
+            const Real volume = leaves[l].depth * Real(leaves[l].cells) * cellArea;
+            leafOutflow[l] = (total * dt > volume && total > 0) ? volume / (total * dt) : Real(1);
+        }
+        for (size_t f = 0; f < faces.size(); f++)
+            faceFlux[f] *= leafOutflow[faceFlux[f] > 0 ? faces[f].a : faces[f].b];
+    }
+
+    /**
+     * @brief Rebuilds the leaves and faces from the current depths
+     */
+    void adapt(Real minDepth)
+    {
+        sinceAdapt = 0;
+        const size_t cells = size_t(nRows) * size_t(nCols);
+        if (elevation.size() != cells)
+            return;
+        if (!staged)
+            expandLeaves();
+        staged = false;
+        stale = false;
+        for (size_t c = 0; c < cells; c++) {
+            if ((cellFlags[c] & ROLE_BITS) == DOMAIN_INACTIVE)
+                cellDepth[c] = 0;
+        }
+
+        markWettingFront(minDepth);
+        buildBlocks(minDepth);
+
+        leaves.clear();
+        std::fill(leafOf.begin(), leafOf.end(), -1);
+        const int top = 1 << MAX_LEVEL;
+        for (int r = 0; r < (nRows + top - 1) / top; r++) {
+            for (int c = 0; c < (nCols + top - 1) / top; c++)
+                emitLeaves(MAX_LEVEL, r, c);
+        }
+        buildFaces();
+    }
+
+    /**
+     * @brief Spreads the leaf depths over their cells
+     */
+    void expandLeaves()
+    {
+        cellDepth.assign(size_t(nRows) * size_t(nCols), Real(0));
+        for (const Leaf &leaf : leaves) {
+            for (int i = leaf.row; i < leaf.row + leaf.size; i++)
+                std::fill_n(cellDepth.data() + size_t(i) * nCols + leaf.col, leaf.size, leaf.depth);
+        }
+    }
+
+    /**
+     * @brief Flags domain cells within FRONT_BUFFER cells of a wet/dry edge
+     */
+    void markWettingFront(Real minDepth)
+    {
+        const size_t cells = size_t(nRows) * size_t(nCols);
+        std::vector<uint8_t> edge(cells, 0);
+        for (int i = 0; i < nRows; i++) {
+            for (int j = 0; j < nCols; j++) {
+                const size_t c = size_t(i) * nCols + j;
+                if ((cellFlags[c] & ROLE_BITS) == DOMAIN_INACTIVE)
+                    continue;
+                const bool wet = cellDepth[c] >= minDepth;
+                const size_t neighbours[2] = {c + 1, c + size_t(nCols)};
+                const bool inside[2] = {j + 1 < nCols, i + 1 < nRows};
+                for (int k = 0; k < 2; k++) {
+                    const size_t n = neighbours[k];
+                    if (inside[k] && (cellFlags[n] & ROLE_BITS) != DOMAIN_INACTIVE
+                        && (cellDepth[n] >= minDepth) != wet) {
+                        edge[c] = 1;
+                        edge[n] = 1;
+                    }
+                }
+            }
+        }
+
+        // Square dilation: along the rows, then along the columns
+        std::vector<uint8_t> rowPass(cells, 0);
+        front.assign(cells, 0);
+        for (int i = 0; i < nRows; i++)
+            dilateLine(edge.data() + size_t(i) * nCols, rowPass.data() + size_t(i) * nCols, nCols, 1);
+        for (int j = 0; j < nCols; j++)
+            dilateLine(rowPass.data() + j, front.data() + j, nRows, nCols);
+    }
+
+    /**
+     * @brief Marks every entry within FRONT_BUFFER of a set entry of a strided line
+     */
+    static void dilateLine(const uint8_t *in, uint8_t *out, int n, ptrdiff_t stride)
+    {
+        int last = -FRONT_BUFFER - 1;
+        for (int k = 0; k < n; k++) {
+            if (in[k * stride])
+                last = k;
+            out[k * stride] = (k - last <= FRONT_BUFFER);
+        }
+        int next = n + FRONT_BUFFER + 1;
+        for (int k = n - 1; k >= 0; k--) {
+            if (in[k * stride])
+                next = k;
+            out[k * stride] |= (next - k <= FRONT_BUFFER);
+        }
+    }
+
+    /**
+     * @brief Merge state of the aligned blocks of levels 1 to MAX_LEVEL
+     *
+     * Level k is combined from the 2 x 2 blocks of level k-1 (cells for
+     * k = 1). Blocks reaching past the grid edge never merge.
+     */
+    void buildBlocks(Real minDepth)
+    {
+        blocks.resize(MAX_LEVEL + 1);
+        for (int level = 1; level <= MAX_LEVEL; level++) {
+            const int size = 1 << level;
+            const int rows = (nRows + size - 1) / size;
+            const int cols = (nCols + size - 1) / size;
+            const Real tolerance = Real(MAX_COARSE_SLOPE * size * resolution);
+            std::vector<Block> &target = blocks[level];
+            target.resize(size_t(rows) * cols);
+            for (int r = 0; r < rows; r++) {
+                for (int c = 0; c < cols; c++) {
+                    Block block = childBlock(level - 1, 2 * r, 2 * c, minDepth);
+                    const bool complete = (r + 1) * size <= nRows && (c + 1) * size <= nCols;
+                    for (int k = 1; k < 4 && complete; k++) {
+                        const Block child = childBlock(level - 1, 2 * r + k / 2, 2 * c + k % 2, minDepth);
+                        block.merged = block.merged && child.merged && child.role == block.role;
+                        block.minZ = std::min(block.minZ, child.minZ);
+                        block.maxZ = std::max(block.maxZ, child.maxZ);
+                        block.minEta = std::min(block.minEta, child.minEta);
+                        block.maxEta = std::max(block.maxEta, child.maxEta);
+                        block.wet += child.wet;
+                    }
+                    block.merged = block.merged && complete && block.maxZ - block.minZ <= tolerance
+                        && (block.wet == 0 || (block.wet == size * size && block.maxEta - block.minEta <= tolerance));
+                    target[size_t(r) * cols + c] = block;
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Block (r, c) of a level, a single cell for level 0
+     */
+    Block childBlock(int level, int r, int c, Real minDepth) const
+    {
+        if (level > 0) {
+            const int size = 1 << level;
+            return blocks[level][size_t(r) * ((nCols + size - 1) / size) + c];
+        }
+        const size_t cell = size_t(r) * nCols + c;
+        const Real z = elevation[cell];
+        const Real eta = z + cellDepth[cell];
+        const uint8_t role = cellFlags[cell] & ROLE_BITS;
+        const bool merged = role != DOMAIN_INACTIVE && !(cellFlags[cell] & FINE_CELL) && !front[cell];
+        return {z, z, eta, eta, cellDepth[cell] >= minDepth ? 1 : 0, role, merged};
+    }
+
+    /**
+     * @brief Emits the leaves of block (r, c) of a level, merged blocks whole
+     *
+     * Each leaf gets the mean depth of its cells, so the volume is kept.
+     */
+    void emitLeaves(int level, int r, int c)
+    {
+        const int size = 1 << level;
+        if (r * size >= nRows || c * size >= nCols)
+            return;
+        const bool merged = (level == 0)
+            ? (cellFlags[size_t(r) * nCols + c] & ROLE_BITS) != DOMAIN_INACTIVE
+            : blocks[level][size_t(r) * ((nCols + size - 1) / size) + c].merged;
+        if (!merged) {
+            if (level > 0) {
+                for (int k = 0; k < 4; k++)
+                    emitLeaves(level - 1, 2 * r + k / 2, 2 * c + k % 2);
+            }
+            return;
+        }
+
+        Leaf leaf;
+        leaf.row = r * size;
+        leaf.col = c * size;
+        leaf.size = size;
+        leaf.cells = size * size;
+        const size_t first = size_t(leaf.row) * nCols + leaf.col;
+        leaf.role = cellFlags[first] & ROLE_BITS;
+        leaf.outlet = (cellFlags[first] & OUTLET_CELL) != 0;
+        double bedSum = 0.0;
+        double depthSum = 0.0;
+        const int index = int(leaves.size());
+        for (int i = leaf.row; i < leaf.row + size; i++) {
+            for (int j = leaf.col; j < leaf.col + size; j++) {
+                const size_t cell = size_t(i) * nCols + j;
+                bedSum += double(elevation[cell]);
+                depthSum += double(cellDepth[cell]);
+                leafOf[cell] = index;
+            }
+        }
+        leaf.bed = Real(bedSum / leaf.cells);
+        leaf.depth = Real(depthSum / leaf.cells);
+        leaf.sourced = leaf.depth;
+        leaves.push_back(leaf);
+    }
+
+    /**
+     * @brief Finds the faces along the east and south edge of every leaf
+     *
+     * The neighbours of an edge are squares, so each one touches it in a
+     * single run of cells and every pair of leaves gets one face.
+     */
+    void buildFaces()
+    {
+        faces.clear();
+        for (int l = 0; l < int(leaves.size()); l++) {
+            const Leaf &leaf = leaves[l];
+            if (leaf.col + leaf.size < nCols)
+                addEdgeFaces(l, leaf.row, leaf.col + leaf.size, nCols);
+            if (leaf.row + leaf.size < nRows)
+                addEdgeFaces(l, leaf.row + leaf.size, leaf.col, 1);
+        }
+        faceFlux.assign(faces.size(), Real(0));
+    }
+
+    /**
+     * @brief Adds the faces between leaf l and the cells of one edge line
+     * @param step Index step along the edge: nCols down the east edge, 1 along the south edge
+     */
+    void addEdgeFaces(int l, int i, int j, size_t step)
+    {
+        const Leaf &leaf = leaves[l];
+        const size_t first = size_t(i) * nCols + j;
+        for (int k = 0; k < leaf.size;) {
+            const int neighbour = leafOf[first + k * step];
+            int run = 1;
+            while (k + run < leaf.size && leafOf[first + (k + run) * step] == neighbour)
+                run++;
+            if (neighbour >= 0) {
+                const double width = run * resolution;
+                const double distance = 0.5 * (leaf.size + leaves[neighbour].size) * resolution;
+                faces.push_back({l, neighbour, Real(width / (manningN * std::sqrt(distance)))});
+            }
+            k += run;
+        }
+    }
+
+    int nRows;
+    int nCols;
+    std::vector<CellSpan> spans;                    ///< Domain spans, row-major
+    const DrainageNetwork *network;                 ///< Engine's D8 network, not owned
+    double resolution;                              ///< Cell size (m)
+    double manningN;
+    double sinceAdapt;                              ///< Simulated time since the last rebuild (s)
+    bool staged;                                    ///< cellDepth holds loaded rows not yet in the leaves
+    bool stale;                                     ///< Domain, terrain or depths changed: rebuild next step
+
+    std::vector<Real> elevation;                    ///< Elevation above the lowest domain cell (m), 0 outside the domain
+    std::vector<uint8_t> cellFlags;                 ///< DomainRole plus FINE_CELL / OUTLET_CELL per cell
+    std::vector<int> leafOf;                        ///< Leaf per cell, -1 outside the domain
+    std::vector<Leaf> leaves;                       ///< Leaves in quadtree (Z) order per top block
+    std::vector<Face> faces;
+    std::vector<Real> faceFlux;                     ///< Scaled flux per face (m³/s), positive from a to b
+    std::vector<Real> leafSurface;                  ///< Water surface per leaf (m), per step
+    std::vector<Real> leafDepthTerm;                ///< h^(5/3) per leaf, 0 below minDepth, per step
+    std::vector<Real> leafOutflow;                  ///< Outflow, then mass-limit scale, per leaf
+
+    std::vector<Real> cellDepth;                    ///< Depth per cell while staged or rebuilding (m)
+    std::vector<uint8_t> front;                     ///< Cells near a wetting front, per rebuild
+    std::vector<std::vector<Block>> blocks;         ///< Merge state per level, per rebuild
+};
+
+#endif // QUADTREEKERNEL_H
@@ -0,0 +1,100 @@
+#ifndef REDUCTION_H
+#define REDUCTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+/**
+ * @brief Order-independent running sum of doubles
+ *
+ * Every term is rounded once to a multiple of 2^-72 and accumulated as a
+ * 2^-20 integer part plus a 2^-72 fraction, both in int64. Integer addition
+ * is associative, so the total is bitwise identical for any order or
+ * grouping of the same terms: thread count, work stealing and merge order of
+ * partial sums cannot change it. The rounding error per term is at most
+ * 2^-73 (~1e-22), far below that of plain or compensated double sums.
+ *
+ * Terms and totals must stay below 2^42 (~4.4e12) in magnitude, ample for
+ * volumes in m³ and depth sums in m.
+ */
+class ReproducibleSum
+{
+public:
+    ReproducibleSum() : high(0), low(0), pending(0) {}
+
+    void add(double value)
+    {
+        double scaled = value * HIGH_SCALE;
+        double whole = std::floor(scaled);
+        high += int64_t(whole);
+        low += int64_t(std::llround((scaled - whole) * LOW_SCALE));
+        if (++pending == NORMALIZE_INTERVAL)
+            normalize();
+    }
+
+    /**
+     * @brief Adds another sum, e.g. a per-tile partial
+     */
+    void add(const ReproducibleSum &other)
+    {
+        ReproducibleSum term = other;
+        term.normalize();
+        normalize();
+        high += term.high;
+        low += term.low;
+        normalize();
+    }
+
+    void reset()
+    {
+        high = 0;
+        low = 0;
+        pending = 0;
+    }
+
+    double value() const
+    {
+        ReproducibleSum total = *this;
+        total.normalize();
+        return (double(total.high) + double(total.low) / LOW_SCALE) / HIGH_SCALE;
+    }
+
+private:
+    static constexpr double HIGH_SCALE = 1048576.0;            ///< 2^20
+    static constexpr double LOW_SCALE = 4503599627370496.0;    ///< 2^52
+    static constexpr int LOW_BITS = 52;
+    static constexpr int NORMALIZE_INTERVAL = 1024;            ///< Adds before low could overflow
+
+    /// Moves whole units of low into high, leaving low in [0, 2^52)
+    void normalize()
+    {
+        high += low >> LOW_BITS;
+        low &= (int64_t(1) << LOW_BITS) - 1;
+        pending = 0;
+    }
+
+    int64_t high;       ///< Integer part, units of 2^-20
+    int64_t low;        ///< Fraction, units of 2^-72, never negative
+    int pending;        ///< Adds since the last normalize()
+};
+
+/// Columns per reduction segment of the kernel sweeps
+constexpr int REDUCTION_SEGMENT = 64;
+
+/**
+ * @brief End of the reduction segment that contains column j, clipped to end
+ *
+ * Kernels sum cell values per row segment with plain double arithmetic and
+ * add the segment sums to a ReproducibleSum. Segments are aligned to
+ * multiples of REDUCTION_SEGMENT in grid columns, not to spans or tiles, so
+ * the row-major and tiled layouts (tile sizes that are multiples of
+ * REDUCTION_SEGMENT) form the same segment sums and their totals agree
+ * bitwise.
+ */
+inline int reductionSegmentEnd(int j, int end)
+{
+    return std::min(end, (j / REDUCTION_SEGMENT + 1) * REDUCTION_SEGMENT);
+}
+
+#endif // REDUCTION_H
@@ -14,11 +14,14 @@
  */
 
 #include "SimulationEngine.h"
+#include "DepthFrameWriter.h"
+#include "FlowSolverRegistry.h"
 #include <QFile>
 #include <QTextStream>
 #include <QStringList>
 #include <QRegularExpression>
 #include <QDebug>
+#include <QMetaMethod>
 #include <algorithm>
 #include <cmath>
 #include <limits>
@@ -59,10 +62,57 @@ SimulationEngine::SimulationEngine(QObject *parent)
     outletRow(0),
     useManualOutlets(false),
     outletPercentile(0.1), // Default to 10%
+    runInitialized(false),
+    verboseLogging(true),
     drainageVolume(0.0),
+    elevationStorage(ElevationStorage::Double),
+    elevationPrecision(0.01),
+    kernelPrecision(KernelPrecision::Double),
+    kernelLayout(KernelLayout::RowMajor),
+    kernelTileSize(64),
+    kernelThreads(0),
+    flowSolverName("diffusive"),
+    maxTimeStep(1.0),
+    steadyAction(SteadyStateAction::Off),
+    steadyCoarseFactor(10.0),
+    coarseScale(10.0),
+    coarseUntil(-1.0),
+    coarseSettled(0.0),
+    steadyWindow(600.0),
+    steadyDepthRate(1.0e-6),
+    steadyBalance(0.01),
+    steadySince(-1.0),
+    steadyReached(false),
+    stoppedAtSteadyState(false),
+    handChannelArea(1.0e4),
+    handMaxDepth(0.0),
+    fillSpillMergeWarmStart(false),
+    multigridLevels(0),
+    multigridSwitchTime(600.0),
+    multigridAggregation(MultigridAggregation::Min),
+    multigridHandoverTime(0.0),
     showGrid(true),
-    gridInterval(10)
+    gridInterval(10),
+    hasGeoTransform(false),
+    depthWriter(nullptr),
+    depthOutputEverySteps(0),
+    depthOutputEverySeconds(0.0),
+    nextDepthOutputTime(0.0),
+    stepCount(0),
+    hydrographInterval(10.0),
+    lastHydrographTime(0.0),
+    contributingAreaOnly(false),
+    contributingHalo(2),
+    cropRowOffset(0),
+    cropColOffset(0),
+    faceCoefficientsDirty(true),
+    storedWaterVolume(0.0),
+    wetCellCount(0),
+    maxWaterDepth(0.0),
+    activeTileCount(0)
 {
+    for (int k = 0; k < 6; ++k)
+        geoTransform[k] = 0.0;
 }
 
 /**
@@ -89,6 +139,9 @@ bool SimulationEngine::loadDEM(const QString &filename)
     // Register GDAL drivers (only needs to be done once)
     GDALAllRegister();
 
+    // The loaders encode straight into the requested elevation storage
+    dem.setStorage(elevationStorage, elevationPrecision);
+
     if (suffix == "tif" || suffix == "tiff")
     {
         // --- Load GeoTIFF using GDAL --- 
@@ -116,8 +169,15 @@ bool SimulationEngine::loadDEM(const QString &filename)
         
         // Get geotransform for resolution
         double adfGeoTransform[6];
+        hasGeoTransform = false;
+        projectionWkt = QString::fromUtf8(poDataset->GetProjectionRef());
         if (poDataset->GetGeoTransform(adfGeoTransform) == CE_None)
         {
+            // Keep the full transform so exported rasters stay georeferenced
+            for (int k = 0; k < 6; ++k)
+                geoTransform[k] = adfGeoTransform[k];
+            hasGeoTransform = true;
+
             // adfGeoTransform[1] is pixel width (X resolution)
             // adfGeoTransform[5] is pixel height (Y resolution, usually negative)
             double resX = std::abs(adfGeoTransform[1]);
@@ -176,8 +236,16 @@ bool SimulationEngine::loadDEM(const QString &filename)
         }
         qDebug() << "Using NoData value:" << noDataValue;
 
+        // Quantized storage needs the value range before the first row is encoded
+        double minMax[2] = {0.0, 0.0};
+        if (elevationStorage != ElevationStorage::Double &&
+            poBand->ComputeRasterMinMax(FALSE, minMax) != CE_None) {
+            qDebug() << "Could not compute the elevation range, storing the DEM as double";
+            dem.setStorage(ElevationStorage::Double, elevationPrecision);
+        }
+
         // Allocate memory for DEM data
-        dem.assign(nx, std::vector<double>(ny));
+        dem.allocate(nx, ny, minMax[0], minMax[1]);
         std::vector<double> rowData(ny);
 
         // Read data row by row
@@ -196,9 +264,9 @@ bool SimulationEngine::loadDEM(const QString &filename)
             // Assign row data, handle NoData values
             for (int j = 0; j < ny; ++j) {
                 if (bGotNoData && std::abs(rowData[j] - noDataValue) < 1e-6) { // Compare with tolerance
-                    dem[i][j] = -999999.0; // Standard internal NoData value
+                    dem.set(i, j, -999999.0); // Standard internal NoData value
                 } else {
-                    dem[i][j] = rowData[j];
+                    dem.set(i, j, rowData[j]);
                 }
             }
         }
@@ -246,9 +314,25 @@ bool SimulationEngine::loadDEM(const QString &filename)
             return false;
             
         // Store DEM and dimensions
-        dem = tmpDEM;
-        nx = dem.size();
-        ny = (nx > 0) ? dem[0].size() : 0;
+        // CSV carries no georeferencing; getGeoTransform() derives one from resolution
+        hasGeoTransform = false;
+        projectionWkt.clear();
+        nx = tmpDEM.size();
+        ny = (nx > 0) ? tmpDEM[0].size() : 0;
+        double minElevation = std::numeric_limits<double>::max();
+        double maxElevation = std::numeric_limits<double>::lowest();
+        for (const std::vector<double> &row : tmpDEM) {
+            for (double value : row) {
+                if (value <= -999998.0) continue;
+                minElevation = std::min(minElevation, value);
+                maxElevation = std::max(maxElevation, value);
+            }
+        }
+        dem.allocate(nx, ny, minElevation, maxElevation);
+        for (int i = 0; i < nx; ++i) {
+            for (int j = 0; j < ny && j < int(tmpDEM[i].size()); ++j)
+                dem.set(i, j, tmpDEM[i][j]);
+        }
         
         // Keep the user-defined or default resolution for CSV
         qDebug() << "CSV loaded. Dimensions (nx, ny):" << nx << ny << ", Using resolution:" << resolution;
@@ -259,14 +343,56 @@ bool SimulationEngine::loadDEM(const QString &filename)
         return false;
     }
 
-    // Common post-loading steps for both TIF and CSV
+    return prepareLoadedDEM();
+}
+
+bool SimulationEngine::loadElevations(const std::vector<double> &elevations, int rows, int cols)
+{
+    if (rows <= 0 || cols <= 0 || elevations.size() != size_t(rows) * size_t(cols)) {
+        qDebug() << "Invalid elevation grid:" << rows << "x" << cols << "with" << elevations.size() << "values";
+        return false;
+    }
+
+    dem.setStorage(elevationStorage, elevationPrecision);
+    hasGeoTransform = false;
+    projectionWkt.clear();
+    nx = rows;
+    ny = cols;
+    double minElevation = std::numeric_limits<double>::max();
+    double maxElevation = std::numeric_limits<double>::lowest();
+    for (double value : elevations) {
+        if (value <= -999998.0) continue;
+        minElevation = std::min(minElevation, value);
+        maxElevation = std::max(maxElevation, value);
+    }
+    dem.allocate(nx, ny, minElevation, maxElevation);
+    for (int i = 0; i < nx; ++i) {
+        for (int j = 0; j < ny; ++j)
+            dem.set(i, j, elevations[size_t(i) * ny + j]);
+    }
+    return prepareLoadedDEM();
+}
+
+/**
+ * @brief Common post-loading steps of every DEM source
+ */
+bool SimulationEngine::prepareLoadedDEM()
+{
     if (nx <= 0 || ny <= 0) {
         qDebug() << "Error: Invalid grid dimensions after loading.";
         return false;
     }
+
+    // Drop NoData margins so every grid and loop scales with the valid area
+    cropToValidData();
+    faceCoefficientsDirty = true;
     
     // Initialize water depth grid (h) to zero
-    h.assign(nx, std::vector<double>(ny, 0.0));
+    resetKernel();
+
+    // Flow directions and accumulation depend only on the DEM
+    buildDrainageNetwork();
+    runInitialized = false;
 
     // Initialize outlet-related members
     outletRow = nx - 1; // Default outlet row (may be changed by methods)
@@ -275,6 +401,10 @@ bool SimulationEngine::loadDEM(const QString &filename)
     drainageVolume = 0.0;
     
     qDebug() << "DEM loaded successfully. nx:" << nx << "ny:" << ny << "Resolution:" << resolution;
+    if (dem.isQuantized())
+        qDebug() << "Elevations stored as" << (dem.storage() == ElevationStorage::Int16 ? "int16" : "int32")
+                 << "with offset" << dem.offset() << "m and step" << dem.scale() << "m,"
+                 << dem.memoryBytes() / (1024 * 1024) << "MiB";
     
     // Perform initial depression filling and flow accumulation
     // fillDepressions(); // Commented out - Implementation missing
@@ -287,7 +417,7 @@ bool SimulationEngine::loadDEM(const QString &filename)
  * @brief Sets the rainfall rate for simulation
  * @param rate The rainfall rate in meters per second (m/s)
  */
-void SimulationEngine::setRainfall(double rate)
+void SimulationEngine::setRainfallRate(double rate)
 {
     rainfallRate = rate;
 }
@@ -299,6 +429,7 @@ void SimulationEngine::setRainfall(double rate)
 void SimulationEngine::setManningCoefficient(double coefficient)
 {
     n_manning = coefficient;
+    faceCoefficientsDirty = true;
 }
 
 /**
@@ -331,6 +462,7 @@ void SimulationEngine::setMinWaterDepth(double depth)
 void SimulationEngine::setCellResolution(double res)
 {
     resolution = res;
+    faceCoefficientsDirty = true;
 }
 
 /**
@@ -394,7 +526,41 @@ void SimulationEngine::setManualOutletCells(const QVector<QPoint> &cells)
     if (outletCells.empty()) {
         useManualOutlets = false;
         computeDefaultAutomaticOutletCells();
+        return;
+    }
+
+    rebuildOutletIndex();
+}
+
+/**
+ * @brief Rebuilds the per-cell outlet index grid
+ *
+ * Every consumer that needs "is this cell an outlet" (rendering, drainage,
+ * statistics) looks the answer up here instead of scanning outletCells.
+ * Cells listed more than once keep only their first outlet entry so they
+ * are not drained twice per step.
+ */
+void SimulationEngine::rebuildOutletIndex()
+{
+    outletIdGrid.assign(size_t(nx) * size_t(ny), -1);
+
+    std::vector<int> unique;
+    unique.reserve(outletCells.size());
+    for (int idx : outletCells) {
+        if (idx < 0 || idx >= nx * ny || outletIdGrid[idx] >= 0)
+            continue;
+        outletIdGrid[idx] = int(unique.size());
+        unique.push_back(idx);
+    }
+
+    if (unique.size() != outletCells.size()) {
+        qDebug() << "Dropped" << outletCells.size() - unique.size() << "duplicate or invalid outlet cells";
     }
+    outletCells.swap(unique);
+
+    // Catchment labels are indexed like outletCells
+    if (drainageNetwork.isBuilt())
+        drainageNetwork.labelCatchments(outletCells);
 }
 
 /**
@@ -445,12 +611,20 @@ bool SimulationEngine::initSimulation()
     
     // Reset simulation time and water depth grid
     time = 0.0;
-    dt = 1.0;
+    dt = maxTimeStep;
     drainageVolume = 0.0;
+    steadyMetrics = SteadyStateMetrics();
+    steadySince = -1.0;
+    steadyReached = false;
+    stoppedAtSteadyState = false;
+    coarseScale = steadyCoarseFactor;
+    coarseUntil = -1.0;
     
     // Initialize water depth grid
+    drainageSum.reset();
+    sourceSum.reset();
     try {
-        h.assign(nx, std::vector<double>(ny, 0.0));
+        resetKernel();
     } 
     catch (const std::exception& e) {
         qDebug() << "ERROR: Failed to initialize water depth grid:" << e.what();
@@ -458,10 +632,7 @@ bool SimulationEngine::initSimulation()
     }
     
     // Clear previous time series data
-    drainageTimeSeries.clear();
-    
-    // Clear per-outlet drainage data
-    perOutletDrainage.clear();
+    drainageSeries.clear();
     
     // If using time-varying rainfall but no schedule is provided, add default entry
     if (useTimeVaryingRainfall && rainfallSchedule.isEmpty()) {
@@ -473,29 +644,48 @@ bool SimulationEngine::initSimulation()
         computeDefaultAutomaticOutletCells();
     }
     
-    // Initialize per-outlet drainage tracking for all outlet cells
-    qDebug() << "Initializing drainage tracking for outlets";
+    // Initialize per-outlet drainage tracking for all outlet cells.
+    // Accumulators are flat arrays indexed like outletCells.
+    qDebug() << "Initializing drainage tracking for" << outletCells.size()
+             << (useManualOutlets ? "manual" : "automatic") << "outlet cells";
+    outletDrainage.assign(outletCells.size(), 0.0);
+    outletIntervalVolume.assign(outletCells.size(), 0.0);
+    outletHydrographs.reset(int(outletCells.size()));
+    lastHydrographTime = 0.0;
+    recordOutletHydrographs();
     
-    perOutletDrainage.clear();  // Ensure we start with a clean state
-    
-    if (useManualOutlets) {
-        qDebug() << "Using" << manualOutletCells.size() << "manual outlet cells";
-        for (const QPoint &p : manualOutletCells) {
-            perOutletDrainage[p] = 0.0;
-            qDebug() << "  Added outlet at:" << p.x() << p.y();
-        }
-    } else {
-        qDebug() << "Using" << outletCells.size() << "automatic outlet cells";
-        QVector<QPoint> autoOutlets = getAutomaticOutletCells();
-        for (const QPoint &p : autoOutlets) {
-            perOutletDrainage[p] = 0.0;
-            qDebug() << "  Added automatic outlet at:" << p.x() << p.y();
+    // Add initial data point (time=0, drainage=0)
+    drainageSeries.append(0.0, 0.0);
+
+    // Restrict stepping to the outlets' catchments if requested
+    routeWaterToOutlets();
+    buildComputationalDomain();
+    storedWaterVolume = 0.0;
+    wetCellCount = 0;
+    maxWaterDepth = 0.0;
+    activeTileCount = 0;
+    multigridHandoverTime = 0.0;
+    if (multigridLevels > 0)
+        applyMultigridWarmStart();
+    else if (fillSpillMergeWarmStart)
+        applyFillSpillMergeWarmStart();
+
+    // (Re)open the depth raster stream and record the initial state
+    stepCount = 0;
+    if (!depthOutputPath.isEmpty()) {
+        if (!depthWriter)
+            depthWriter = new DepthFrameWriter(this);
+        double transform[6];
+        getGeoTransform(transform);
+        if (depthWriter->open(depthOutputPath, nx, ny, transform, projectionWkt, -9999.0f)) {
+            nextDepthOutputTime = depthOutputEverySeconds;
+            writeDepthFrame(true);
+        } else {
+            emit errorOccurred(QString("Could not open depth output file: %1").arg(depthOutputPath));
         }
     }
     
-    // Add initial data point (time=0, drainage=0)
-    drainageTimeSeries.append(qMakePair(0.0, 0.0));
-    
+    runInitialized = true;
     qDebug() << "Simulation initialization successful";
     return true;
 }
@@ -512,14 +702,14 @@ bool SimulationEngine::initSimulation()
  */
 void SimulationEngine::stepSimulation()
 {
-    if (nx <= 0 || ny <= 0)
+    if (nx <= 0 || ny <= 0 || stoppedAtSteadyState)
         return;
 
     // Get the rainfall rate to use (either constant or time-varying)
     double currentRainfallRate = useTimeVaryingRainfall ? getCurrentRainfallRate() : rainfallRate;
     
     // Debug - print simulation state at regular intervals
-    if (int(time) % 10 == 0) {
+    if (verboseLogging && int(time) % 10 == 0) {
         qDebug() << ">>> Simulation Time:" << time << "s";
         qDebug() << "    Current Rainfall Rate:" << currentRainfallRate << "m/s";
         qDebug() << "    Total Drainage So Far:" << drainageVolume << "m³";
@@ -534,139 +724,38 @@ void SimulationEngine::stepSimulation()
             int j = idx % ny;  // column
             
             if (i >= 0 && i < nx && j >= 0 && j < ny) {
-                qDebug() << "      Outlet at (" << i << "," << j << ") - Water depth:" << h[i][j] 
+                qDebug() << "      Outlet at (" << i << "," << j << ") - Water depth:" << kernel->depth(i, j) 
                          << "m, Elevation:" << dem[i][j] << "m";
                 checkedCount++;
             }
         }
     }
 
-    // Apply rainfall and infiltration to each cell
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            if (dem[i][j] <= -999998.0) {
-                h[i][j] = 0.0; 
-                continue;
-            }
-            double delta = (currentRainfallRate - Ks) * dt;
-            h[i][j] += delta;
-            if (h[i][j] < 0.0) h[i][j] = 0.0;
-        }
-    }
-
-    // Calculate total system water *after* rainfall/infiltration
-    double totalSystemWater = 0.0;
-    double cellArea = resolution * resolution;
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            if (dem[i][j] > -999998.0) {
-                totalSystemWater += h[i][j] * cellArea;
-            }
-        }
-    }
-
-    // Ensure outlets have some minimum water (helps start drainage)
-    /* // <<< COMMENT OUT START
-    for (const auto& idx : outletCells) {
-        int i = idx / ny;  
-        int j = idx % ny;  
-        if (i >= 0 && i < nx && j >= 0 && j < ny && dem[i][j] > -999998.0) {
-             if (h[i][j] < min_depth * 2) { // Keep this minimal enforcement
-                h[i][j] = min_depth * 2;
-            }
-        }
-    }
-    */ // <<< COMMENT OUT END
-
-    // --- Refactored Flux Calculation and Water Depth Update --- 
-
-    std::vector<std::vector<std::array<double, 4>>> Q_out(nx, std::vector<std::array<double, 4>>(ny, {0.0, 0.0, 0.0, 0.0}));
-    std::vector<std::vector<double>> Q_total_out(nx, std::vector<double>(ny, 0.0));
-
-    int di[4] = {-1, 0, 1, 0}; // N, E, S, W
-    int dj[4] = {0, 1, 0, -1};
-
-    // First pass: Calculate potential outflow Q_out
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            if (dem[i][j] <= -999998.0) continue; 
-            double h_i = h[i][j];
-            if (h_i < min_depth) continue;
-            double H_i = h_i + dem[i][j];
-
-            for (int k = 0; k < 4; k++) { 
-                int ni = i + di[k];
-                int nj = j + dj[k];
-                if (ni < 0 || ni >= nx || nj < 0 || nj >= ny || dem[ni][nj] <= -999998.0) continue;
-                double h_j = h[ni][nj];
-                double H_j = h_j + dem[ni][nj];
-                double deltaH = H_i - H_j;
-
-                if (deltaH > 0) {
-                    double S = deltaH / resolution;
-                    double A = h_i * resolution; 
-                    double R = h_i;             
-                    double Q = (A * std::pow(R, 2.0/3.0) * std::sqrt(S)) / n_manning;
-                    Q_out[i][j][k] = Q;
-                    Q_total_out[i][j] += Q;
-                }
-            }
-        }
-    }
-
-    // Second pass: Calculate delta_h using mass conservation scaling
-    std::vector<std::vector<double>> delta_h(nx, std::vector<double>(ny, 0.0));
-
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            if (dem[i][j] <= -999998.0) continue;
-
-            double V_t = h[i][j] * cellArea; 
-            double c = 1.0;                 
-
-            if (Q_total_out[i][j] * dt > V_t && Q_total_out[i][j] > 0) {
-                c = V_t / (Q_total_out[i][j] * dt);
-            }
-
-            double netFluxVolume = 0.0;
-            // Scaled Outflows FROM cell (i,j)
-            netFluxVolume -= Q_total_out[i][j] * c * dt; // Apply dt here
-
-            // Scaled Inflows TO cell (i,j) FROM neighbors
-            for (int k = 0; k < 4; k++) {
-                int ni = i - di[k]; // Neighbor index (source of flow)
-                int nj = j - dj[k];
-                int flow_direction_from_neighbor = (k + 2) % 4; // Flow direction index from neighbor's perspective
-
-                if (ni >= 0 && ni < nx && nj >= 0 && nj < ny && dem[ni][nj] > -999998.0) {
-                    double V_neighbor = h[ni][nj] * cellArea;
-                    double c_neighbor = 1.0;
-                    if (Q_total_out[ni][nj] * dt > V_neighbor && Q_total_out[ni][nj] > 0) {
-                        c_neighbor = V_neighbor / (Q_total_out[ni][nj] * dt);
-                    }
-                    netFluxVolume += Q_out[ni][nj][flow_direction_from_neighbor] * c_neighbor * dt; // Apply dt here
-                }
-            }
-            delta_h[i][j] = netFluxVolume / cellArea;
-        }
-    }
-
-    // Third pass: Update water depths
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            if (dem[i][j] <= -999998.0) continue;
-            h[i][j] += delta_h[i][j];
-            if (h[i][j] < 0.0) h[i][j] = 0.0;
-        }
+    // The flow kernel makes two fused sweeps over the domain spans (see
+    // FaceFluxKernel): sources + face outflows, then divergence, outlet
+    // drainage and statistics. Terrain-only terms come from its face cache.
+    if (faceCoefficientsDirty) {
+        kernel->buildFaceCoefficients(dem, domainMask, resolution, n_manning);
+        faceCoefficientsDirty = false;
     }
-    // --- End of Refactored Section ---
+    // Solvers with a stability limit shorten the step; the last step ends on totalTime.
+    // Coarse steps at steady state stop at the next rainfall change.
+    double stepCap = maxTimeStep;
+    if (coarseUntil > time)
+        stepCap = std::max(maxTimeStep, std::min(maxTimeStep * coarseScale, coarseUntil - time));
+    dt = std::min(stepCap, kernel->stableTimeStep());
+    if (totalTime - time > 0.0 && totalTime - time < dt)
+        dt = totalTime - time;
+    const double cellArea = resolution * resolution;
+    KernelStepParameters params = {currentRainfallRate, Ks, min_depth, dt, cellArea};
+
+    double totalSystemWater = kernel->applySourcesAndOutflow(params);
+    const double previousStored = storedWaterVolume;
+    sourceSum.add(totalSystemWater - storedWaterVolume);
 
     // Route water TO outlets (potentially tune down later)
     routeWaterToOutlets(); 
 
-    // Compute actual drainage FROM outlet cells 
-    double outflow = 0.0;
-    double totalWaterOnOutlets = 0.0;
     // Calculate adaptive drainage factor (less aggressive)
     double systemWaterThreshold = 1.0; 
     double drainageFactor = 1.0; 
@@ -677,54 +766,203 @@ void SimulationEngine::stepSimulation()
     double timeFactor = 0.7 + 0.3 * timeProgress; 
     drainageFactor *= timeFactor;
     
-    qDebug() << "Adaptive drainage factor (final):" << drainageFactor;
-    
-    for (const auto& idx : outletCells) {
-        int i = idx / ny; int j = idx % ny;
-        if (i >= 0 && i < nx && j >= 0 && j < ny && dem[i][j] > -999998.0) {
-            totalWaterOnOutlets += h[i][j] * cellArea;
-            double h_i = h[i][j];
-            if (time < 5.0 || fmod(time, 100.0) < dt) { // Limit debug output frequency
-                 qDebug() << "  Outlet (" << i << "," << j << ") h_i:" << h_i << "(min_depth:" << min_depth << ")";
-            }
-            
-            if (h_i > min_depth) {
+    if (verboseLogging)
+        qDebug() << "Adaptive drainage factor (final):" << drainageFactor;
+
+    // Drainage FROM one outlet cell, applied by the kernel right after its depth update.
+    // Layouts visit outlets in different orders, so the step totals are order-independent sums.
+    ReproducibleSum outflow;
+    ReproducibleSum totalWaterOnOutlets;
+    auto drainOutlet = [&](int i, int j, double h_i) {
+        int k = getOutletIndexAt(i, j);
+        if (k < 0 || k >= int(outletDrainage.size()))
+            return h_i; // Outlet added or removed since initSimulation()
+        if (verboseLogging)
+            totalWaterOnOutlets.add(h_i * cellArea);
+        if (verboseLogging && (time < 5.0 || fmod(time, 100.0) < dt)) { // Limit debug output frequency
+             qDebug() << "  Outlet (" << i << "," << j << ") h_i:" << h_i << "(min_depth:" << min_depth << ")";
+        }
+        
+        if (h_i > min_depth) {
+            if (verboseLogging)
                 qDebug() << "    >> Drainage triggered for Outlet (" << i << "," << j << ") with h_i:" << h_i;
-                double S = 0.2; 
-                double A = h_i * resolution;
-                double Q = 2.5 * drainageFactor * (A * std::pow(h_i, 2.0/3.0) * std::sqrt(S)) / n_manning; 
-                double vol = Q * dt;
-                double availableVolume = h_i * cellArea;
-                if (vol > availableVolume * 0.95) vol = availableVolume * 0.95;
-
-                h[i][j] -= vol / cellArea;
-                outflow += vol;
-                qDebug() << "       Calculated vol:" << vol << ", outflow step total:" << outflow;
-                QPoint outletPoint(i, j);
-                perOutletDrainage[outletPoint] += vol;
-            }
+            double S = 0.2; 
+            double A = h_i * (size_t(k) < outletWidths.size() ? outletWidths[k] : resolution);
+            double Q = 2.5 * drainageFactor * (A * std::pow(h_i, 2.0/3.0) * std::sqrt(S)) / n_manning; 
+            double vol = Q * dt;
+            double availableVolume = h_i * cellArea;
+            if (vol > availableVolume * 0.95) vol = availableVolume * 0.95;
+
+            outflow.add(vol);
+            if (verboseLogging)
+                qDebug() << "       Calculated vol:" << vol << ", outflow step total:" << outflow.value();
+            outletDrainage[k] += vol;
+            outletIntervalVolume[k] += vol;
+            return h_i - vol / cellArea;
         }
-    }
+        return h_i;
+    };
+
+    KernelStatistics stats = kernel->updateDepths(params, drainOutlet);
+    storedWaterVolume = stats.storedVolume;
+    wetCellCount = stats.wetCells;
+    maxWaterDepth = stats.maxDepth;
+    activeTileCount = stats.activeTiles;
     
-    qDebug() << "Total water volume on outlet cells:" << totalWaterOnOutlets << "m³";
-    qDebug() << "Total drainage this step:" << outflow << "m³";
-    drainageVolume += outflow;
-    drainageTimeSeries.append(qMakePair(time + dt, drainageVolume));
-    time += dt; // Use fixed dt for now
+    if (verboseLogging) {
+        qDebug() << "Total water volume on outlet cells:" << totalWaterOnOutlets.value() << "m³";
+        qDebug() << "Total drainage this step:" << outflow.value() << "m³";
+    }
+    drainageSum.add(outflow);
+    drainageVolume = drainageSum.value();
+    drainageSeries.append(time + dt, drainageVolume);
+    time += dt;
+    stepCount++;
+    updateSteadyState(totalSystemWater - previousStored, previousStored, outflow.value(), stats.maxDepthChange);
+
+    if (hydrographInterval <= 0.0 || time + 1e-9 >= lastHydrographTime + hydrographInterval
+        || isSimulationFinished())
+        recordOutletHydrographs();
+
+    // Hand a depth snapshot to the writer thread; the last step always gets one
+    if (depthWriter && depthWriter->isOpen()) {
+        writeDepthFrame(isSimulationFinished());
+        if (isSimulationFinished())
+            finishDepthOutput();
+    }
 
-    // Emit signals to update UI
+    // Emit signals to update UI; the depth image is only rendered for a receiver
     emit simulationTimeUpdated(time, totalTime);
-    emit simulationStepCompleted(getWaterDepthImage());
+    if (isSignalConnected(QMetaMethod::fromSignal(&SimulationEngine::simulationStepCompleted)))
+        emit simulationStepCompleted(getWaterDepthImage());
+}
+
+/**
+ * @brief Configures periodic streaming of the water depth grid
+ * @param path Raw frame file (ENVI band-sequential float32)
+ * @param everySteps Step interval between frames, 0 to disable
+ * @param everySeconds Simulated-time interval between frames, 0 to disable
+ *
+ * Either trigger firing writes a frame. Takes effect at the next initSimulation().
+ */
+void SimulationEngine::setDepthOutput(const QString &path, int everySteps, double everySeconds)
+{
+    depthOutputPath = path;
+    depthOutputEverySteps = std::max(0, everySteps);
+    depthOutputEverySeconds = std::max(0.0, everySeconds);
+    if (depthOutputEverySteps == 0 && depthOutputEverySeconds <= 0.0) {
+        qDebug() << "Depth output has no trigger, defaulting to every step";
+        depthOutputEverySteps = 1;
+    }
+}
+
+void SimulationEngine::disableDepthOutput()
+{
+    finishDepthOutput();
+    depthOutputPath.clear();
+}
+
+/**
+ * @brief Drains the frame queue and finalizes the output header
+ *
+ * Blocks until the writer thread has flushed every queued frame.
+ */
+void SimulationEngine::finishDepthOutput()
+{
+    if (!depthWriter || !depthWriter->isOpen())
+        return;
+
+    depthWriter->close();
+    if (depthWriter->hasFailed())
+        emit errorOccurred(depthWriter->errorString());
+}
+
+/**
+ * @brief Returns the DEM geotransform
+ * @param transform Receives origin X, pixel width, row rotation, origin Y, column rotation, pixel height
+ *
+ * CSV grids have no georeferencing, so a north-up transform with the file
+ * origin at (0, 0) and the current cell resolution is returned instead. Both
+ * refer to the cropped grid, see cropToValidData().
+ */
+void SimulationEngine::getGeoTransform(double transform[6]) const
+{
+    if (hasGeoTransform) {
+        for (int k = 0; k < 6; ++k)
+            transform[k] = geoTransform[k];
+        return;
+    }
+    transform[0] = cropColOffset * resolution;
+    transform[1] = resolution;
+    transform[2] = 0.0;
+    transform[3] = -cropRowOffset * resolution;
+    transform[4] = 0.0;
+    transform[5] = -resolution;
 }
 
-double SimulationEngine::getTotalDrainage() const
+/**
+ * @brief Snapshots the depth grid into a pooled buffer for the writer thread
+ * @param force Write even if neither the step nor the time trigger fired
+ *
+ * The copy is the only work done on the simulation thread. acquireFrame()
+ * blocks only when the writer's queue is full.
+ */
+void SimulationEngine::writeDepthFrame(bool force)
 {
-    return drainageVolume;
+    if (!depthWriter || !depthWriter->isOpen())
+        return;
+
+    bool due = force;
+    if (depthOutputEverySteps > 0 && stepCount % depthOutputEverySteps == 0)
+        due = true;
+    if (depthOutputEverySeconds > 0.0 && time + 1e-9 >= nextDepthOutputTime) {
+        due = true;
+        while (nextDepthOutputTime <= time + 1e-9)
+            nextDepthOutputTime += depthOutputEverySeconds;
+    }
+    if (!due)
+        return;
+
+    float *frame = depthWriter->acquireFrame();
+    if (!frame) {
+        emit errorOccurred(depthWriter->errorString());
+        finishDepthOutput();
+        return;
+    }
+
+    for (int i = 0; i < nx; i++) {
+        float *row = frame + size_t(i) * ny;
+        kernel->copyDepthRow(i, row);
+        for (int j = 0; j < ny; j++) {
+            if (dem[i][j] <= -999998.0) row[j] = -9999.0f;
+        }
+    }
+    depthWriter->submitFrame(frame, stepCount, time);
 }
 
 QVector<QPair<double, double>> SimulationEngine::getDrainageTimeSeries() const
 {
-    return drainageTimeSeries;
+    return drainageSeries.samplesSince(0);
+}
+
+/**
+ * @brief Incremental drainage read for UI polling
+ * @param first Number of samples the caller already has
+ * @return Only the samples appended since then (O(new samples))
+ */
+QVector<QPair<double, double>> SimulationEngine::getDrainageSamplesSince(qint64 first) const
+{
+    return drainageSeries.samplesSince(first);
+}
+
+/**
+ * @brief Plot-ready drainage history
+ * @param maxPoints Maximum number of points
+ * @return Min/max decimated series answered mostly from in-memory summaries
+ */
+QVector<QPair<double, double>> SimulationEngine::getDrainageTimeSeriesDecimated(int maxPoints) const
+{
+    return drainageSeries.decimated(maxPoints);
 }
 
 /**
@@ -740,54 +978,55 @@ QVector<QPair<double, double>> SimulationEngine::getDrainageTimeSeries() const
  */
 QImage SimulationEngine::getWaterDepthImage() const
 {
-    if (nx <= 0 || ny <= 0)
+    if (nx <= 0 || ny <= 0 || !kernel)
         return QImage();
 
+    // Max water depth for scaling, tracked by the update sweep of stepSimulation()
+    return renderDepthImage([this](int i, float *row) { kernel->copyDepthRow(i, row); }, maxWaterDepth);
+}
+
+/**
+ * @brief Colors a depth field white (dry) to blue (deepest), with grid and rulers
+ * @param copyRow Fills one row of depths (m)
+ * @param maxDepth Depth mapped to full blue (m)
+ *
+ * Shared by the simulated depths and the HAND inundation maps.
+ */
+QImage SimulationEngine::renderDepthImage(const std::function<void(int, float *)> &copyRow, double maxDepth) const
+{
     // Create an image with dimensions matching the DEM grid
     // Note: Correctly match image dimensions to DEM dimensions (nx = rows, ny = columns)
     QImage img(ny, nx, QImage::Format_RGB32);
     img.fill(Qt::white);
 
-    // Find the max water depth for scaling
-    double maxDepth = 0.0;
-    for (int i = 0; i < nx; i++)
-    {
-        for (int j = 0; j < ny; j++)
-        {
-            // Skip no-data cells
-            if (dem[i][j] > -999998.0) {
-                maxDepth = std::max(maxDepth, h[i][j]);
-            }
-        }
-    }
-    
     // Ensure max depth is positive for scaling
     if (maxDepth <= 0.0)
         maxDepth = 1.0;
 
-    // Create a color gradient from white to blue
+    // Create a color gradient from white to blue, one row at a time
+    std::vector<float> depthRow(ny);
     for (int i = 0; i < nx; i++)
     {
+        copyRow(i, depthRow.data());
+        QRgb *line = reinterpret_cast<QRgb *>(img.scanLine(i));
         for (int j = 0; j < ny; j++)
         {
             if (dem[i][j] <= -999998.0) {
                 // No-data cells are light gray
-                img.setPixel(j, i, qRgb(200, 200, 200));
+                line[j] = qRgb(200, 200, 200);
                 continue;
             }
             
-            double depth = h[i][j];
             // Normalize depth to 0-1 range
-            double normalizedDepth = depth / maxDepth;
+            double normalizedDepth = std::min(1.0, depthRow[j] / maxDepth);
             
             // Create a color gradient: white (no water) to blue (deep water)
             int blue = 255;
             int red = int(255 * (1.0 - normalizedDepth));
             int green = int(255 * (1.0 - normalizedDepth));
             
-            // Flip the image vertically to correctly represent the DEM where row 0 is the top
-            // and j=0 is the left, j=ny-1 is the right
-            img.setPixel(j, i, qRgb(red, green, blue));
+            // Row 0 is the top of the image, j=0 is the left, j=ny-1 is the right
+            line[j] = qRgb(red, green, blue);
         }
     }
 
@@ -1074,8 +1313,9 @@ QImage SimulationEngine::getDEMPreviewImage() const
  */
 QImage SimulationEngine::getFlowAccumulationImage() const
 {
-    if (nx <= 0 || ny <= 0 || flowAccumulationGrid.empty())
+    if (nx <= 0 || ny <= 0 || !drainageNetwork.isBuilt())
         return QImage();
+    const std::vector<uint32_t> &accumulation = drainageNetwork.flowAccumulation();
 
     // Create an image with dimensions matching the DEM grid
     QImage img(ny, nx, QImage::Format_RGB32);
@@ -1086,7 +1326,7 @@ QImage SimulationEngine::getFlowAccumulationImage() const
     for (int i = 0; i < nx; i++) {
         for (int j = 0; j < ny; j++) {
             if (dem[i][j] > -999998.0) {
-                maxFlow = std::max(maxFlow, flowAccumulationGrid[i][j]);
+                maxFlow = std::max(maxFlow, double(accumulation[size_t(i) * ny + j]));
             }
         }
     }
@@ -1103,7 +1343,7 @@ QImage SimulationEngine::getFlowAccumulationImage() const
                 continue;
             }
             
-            double flowValue = flowAccumulationGrid[i][j];
+            double flowValue = double(accumulation[size_t(i) * ny + j]);
             
             // Use log scale to better visualize the full range of values
             double normalizedFlow = (flowValue > 0) ? 
@@ -1126,17 +1366,7 @@ QImage SimulationEngine::getFlowAccumulationImage() const
             }
             
             // Mark outlet cells with a distinctive color
-            bool isOutlet = false;
-            for (const auto& idx : outletCells) {
-                int oi = idx / ny;
-                int oj = idx % ny;
-                if (i == oi && j == oj) {
-                    isOutlet = true;
-                    break;
-                }
-            }
-            
-            if (isOutlet) {
+            if (isOutletCell(i, j)) {
                 red = 255;
                 green = 50;
                 blue = 50;
@@ -1220,306 +1450,953 @@ QImage SimulationEngine::getFlowAccumulationImage() const
  */
 QMap<QPoint, double> SimulationEngine::getPerOutletDrainage() const
 {
-    return perOutletDrainage;
+    QMap<QPoint, double> result;
+    for (size_t k = 0; k < outletCells.size(); ++k) {
+        double volume = k < outletDrainage.size() ? outletDrainage[k] : 0.0;
+        result[QPoint(outletCells[k] / ny, outletCells[k] % ny)] += volume;
+    }
+    return result;
 }
 
-QVector<QPoint> SimulationEngine::getAutomaticOutletCells() const
+QPoint SimulationEngine::getOutletCell(int outlet) const
 {
-    QVector<QPoint> result;
-    
-    // Convert 1D indices back to 2D coordinates
-    for (const auto& idx : outletCells) {
-        int i = idx / ny;  // row
-        int j = idx % ny;  // column
-        
-        if (i >= 0 && i < nx && j >= 0 && j < ny) {
-            result.append(QPoint(i, j));
-        }
-    }
-    
-    qDebug() << "Returning" << result.size() << "automatic outlet cells";
-    return result;
+    if (outlet < 0 || outlet >= int(outletCells.size()) || ny <= 0)
+        return QPoint(-1, -1);
+    return QPoint(outletCells[outlet] / ny, outletCells[outlet] % ny);
+}
+
+double SimulationEngine::getOutletDrainage(int outlet) const
+{
+    if (outlet < 0 || outlet >= int(outletDrainage.size()))
+        return 0.0;
+    return outletDrainage[outlet];
+}
+
+/**
+ * @brief Sets the hydrograph sampling interval
+ * @param seconds Simulated seconds between samples, 0 to sample every step
+ */
+void SimulationEngine::setHydrographInterval(double seconds)
+{
+    hydrographInterval = std::max(0.0, seconds);
+}
+
+QVector<QPair<double, double>> SimulationEngine::getOutletHydrographSince(int outlet, qint64 first) const
+{
+    if (outlet < 0 || outlet >= outletHydrographs.channelCount() || outletCells.empty())
+        return QVector<QPair<double, double>>();
+    return outletHydrographs.samplesSince(first, outlet);
+}
+
+QVector<QPair<double, double>> SimulationEngine::getOutletHydrographDecimated(int outlet, int maxPoints) const
+{
+    if (outlet < 0 || outlet >= outletHydrographs.channelCount() || outletCells.empty())
+        return QVector<QPair<double, double>>();
+    return outletHydrographs.decimated(maxPoints, outlet);
 }
 
 /**
- * @brief Routes water flow from higher to lower elevations towards outlet cells
+ * @brief Convolves the rainfall excess with the outlet's time-area histogram
  *
- * Algorithm steps:
- * 1. Creates flow accumulation grid for main drainage paths
- * 2. Fills depressions to ensure continuous flow
- * 3. Calculates flow directions based on steepest descent
- * 4. Creates multiple drainage paths per outlet
- * 5. Applies adaptive flow routing with reduced aggressiveness
+ * The travel times depend on the flow depths, which are set by the peak
+ * excess of the series, so they are rebuilt when that peak changes.
  */
-void SimulationEngine::routeWaterToOutlets()
+QVector<QPair<double, double>> SimulationEngine::getSurrogateHydrograph(int outlet, double interval)
 {
-    if (outletCells.empty() || nx <= 0 || ny <= 0)
-        return;
-        
-    qDebug() << "Routing water to" << outletCells.size() << "outlet cells";
-    
-    // Create a flow accumulation grid to identify main drainage paths
-    std::vector<std::vector<double>> flowAccumulation(nx, std::vector<double>(ny, 0.0));
-    
-    // Depression filling - identify and fill local depressions to ensure flow continuity
-    std::vector<std::vector<double>> filledDEM = dem; // Copy original DEM
-    bool depressionsFilled = false;
-    int fillIterations = 0;
-    const int MAX_FILL_ITERATIONS = 3; // Limit iterations to avoid excessive processing
-    
-    while (!depressionsFilled && fillIterations < MAX_FILL_ITERATIONS) {
-        depressionsFilled = true;
-        
-        for (int i = 1; i < nx - 1; i++) {
-            for (int j = 1; j < ny - 1; j++) {
-                // Skip no-data cells
-                if (filledDEM[i][j] <= -999998.0) {
-                    continue;
-                }
-                
-                // Check if this is a depression (all neighbors are higher)
-                bool isDepression = true;
-                double lowestNeighbor = std::numeric_limits<double>::max();
-                
-                // Check 8 neighbors
-                for (int di = -1; di <= 1; di++) {
-                    for (int dj = -1; dj <= 1; dj++) {
-                        if (di == 0 && dj == 0) continue; // Skip self
-                        
-                        int ni = i + di;
-                        int nj = j + dj;
-                        
-                        // Skip out of bounds or no-data cells
-                        if (ni < 0 || ni >= nx || nj < 0 || nj >= ny || filledDEM[ni][nj] <= -999998.0) {
-                            continue;
-                        }
-                        
-                        if (filledDEM[ni][nj] < filledDEM[i][j]) {
-                            isDepression = false;
-                            break;
-                        }
-                        
-                        lowestNeighbor = std::min(lowestNeighbor, filledDEM[ni][nj]);
-                    }
-                }
-                
-                // Fill depression by setting elevation slightly below lowest neighbor
-                if (isDepression && lowestNeighbor < std::numeric_limits<double>::max()) {
-                    double oldElev = filledDEM[i][j];
-                    filledDEM[i][j] = lowestNeighbor - 0.01; // Set slightly below lowest neighbor
-                    depressionsFilled = false; // Need another iteration
-                    
-                    if (fillIterations == 0) { // Only log on first iteration to avoid spam
-                        qDebug() << "Filled depression at" << i << j << "from" << oldElev << "to" << filledDEM[i][j];
-                    }
-                }
-            }
-        }
-        
-        fillIterations++;
+    QVector<QPair<double, double>> result;
+    if (outlet < 0 || outlet >= int(outletCells.size()) || totalTime <= 0.0)
+        return result;
+    if (interval <= 0.0)
+        interval = hydrographInterval > 0.0 ? hydrographInterval : maxTimeStep;
+
+    routeWaterToOutlets();
+    const int count = int(std::ceil(totalTime / interval - 1e-9));
+    std::vector<double> excess = rainfallExcessSeries(interval, count);
+    const double peakExcess = excess.empty() ? 0.0 : *std::max_element(excess.begin(), excess.end());
+
+    std::vector<double> discharge(excess.size(), 0.0);
+    if (peakExcess > 0.0) {
+        if (!timeAreaModel.isBuiltFor(resolution, n_manning, peakExcess))
+            timeAreaModel.build(drainageNetwork, resolution, n_manning, peakExcess);
+        discharge = TimeAreaModel::convolve(timeAreaModel.histogram(drainageNetwork, outlet, interval), excess);
     }
-    
-    qDebug() << "Depression filling completed in" << fillIterations << "iterations";
-    
-    // Calculate flow directions and accumulation based on the filled DEM
-    for (int i = 0; i < nx; i++) {
-        for (int j = 0; j < ny; j++) {
-            // Skip no-data cells
-            if (filledDEM[i][j] <= -999998.0) {
-                continue;
-            }
-            
-            // Find the steepest downhill neighbor
-            int di[8] = {-1, -1, 0, 1, 1, 1, 0, -1}; // Include diagonals
-            int dj[8] = {0, 1, 1, 1, 0, -1, -1, -1};
-            double maxSlope = 0.0;
-            int flowDir = -1;
-            
-            for (int k = 0; k < 8; k++) {
-                int ni = i + di[k];
-                int nj = j + dj[k];
-                
-                // Skip if out of bounds or no-data cell
-                if (ni < 0 || ni >= nx || nj < 0 || nj >= ny || filledDEM[ni][nj] <= -999998.0) {
-                    continue;
-                }
-                
-                // Calculate elevation difference and slope
-                double dElev = filledDEM[i][j] - filledDEM[ni][nj];
-                double distance = (k % 2 == 0) ? resolution : resolution * 1.414; // Adjust for diagonals
-                double slope = dElev / distance;
-                
-                // If this slope is steeper, update flow direction
-                if (slope > maxSlope) {
-                    maxSlope = slope;
-                    flowDir = k;
-                }
-            }
-            
-            // If we found a downhill direction, add to flow accumulation
-            if (flowDir >= 0) {
-                int ni = i + di[flowDir];
-                int nj = j + dj[flowDir];
-                flowAccumulation[ni][nj] += 1.0 + flowAccumulation[i][j];
-            }
-        }
+
+    result.reserve(count + 1);
+    result.append(qMakePair(0.0, 0.0));
+    for (int n = 0; n < count; n++)
+        result.append(qMakePair((n + 1) * interval, discharge[n]));
+    return result;
+}
+
+void SimulationEngine::setHandChannelArea(double area)
+{
+    if (area <= 0.0) {
+        qDebug() << "Ignoring invalid HAND channel area:" << area;
+        return;
     }
-    
-    // Retain a copy of flow accumulation for visualization
-    flowAccumulationGrid = flowAccumulation;
-    
-    // For each outlet cell, create a path of increased water depth leading to it
-    for (const auto& idx : outletCells) {
-        int i = idx / ny;  // row
-        int j = idx % ny;  // column
-        
-        // Make sure coordinates are valid
-        if (i < 0 || i >= nx || j < 0 || j >= ny || dem[i][j] <= -999998.0)
-            continue;
-            
-        // Find multiple paths from the outlet toward higher accumulation areas
-        // This creates a more realistic drainage network
-        std::vector<std::pair<int, int>> paths;
-        int maxPaths = 3; // Try to find up to 3 distinct drainage paths
-        
-        // Start with the outlet cell
-        paths.push_back(std::make_pair(i, j));
+    handChannelArea = area;
+}
+
+bool SimulationEngine::ensureHandModel()
+{
+    if (nx <= 0 || ny <= 0)
+        return false;
+    if (!drainageNetwork.isBuilt())
+        buildDrainageNetwork();
+    // Channel threshold in flow-accumulation cells for the current resolution
+    const double threshold = std::max(1.0, std::round(handChannelArea / (resolution * resolution)));
+    if (!handModel.isBuiltFor(threshold))
+        handModel.build(drainageNetwork, threshold);
+    return handModel.isBuilt();
+}
+
+bool SimulationEngine::mapHandInundation(double stage)
+{
+    if (!ensureHandModel())
+        return false;
+    handMaxDepth = handModel.mapStage(stage, handDepth);
+    qDebug() << "HAND inundation for stage" << stage << "m, deepest water" << handMaxDepth << "m";
+    return true;
+}
+
+/**
+ * @brief Spreads each catchment's rainfall excess volume as a flat stage above the drainage
+ */
+bool SimulationEngine::mapHandInundationFromRainfall()
+{
+    if (outletCells.empty() || totalTime <= 0.0 || !ensureHandModel())
+        return false;
+    routeWaterToOutlets();
+
+    // One interval over the whole run gives the mean excess rate
+    const double excessDepth = rainfallExcessSeries(totalTime, 1)[0] * totalTime;
+    const double cellArea = resolution * resolution;
+    std::vector<double> volume(outletCells.size());
+    for (size_t k = 0; k < outletCells.size(); k++)
+        volume[k] = excessDepth * double(drainageNetwork.catchmentCells(int(k)).size()) * cellArea;
+
+    handMaxDepth = handModel.mapVolumes(drainageNetwork, volume, cellArea, handDepth);
+    qDebug() << "HAND inundation for" << excessDepth << "m of rainfall excess, deepest water" << handMaxDepth << "m";
+    return true;
+}
+
+double SimulationEngine::getHeightAboveDrainage(int i, int j) const
+{
+    if (!handModel.isBuilt() || i < 0 || i >= nx || j < 0 || j >= ny)
+        return -1.0;
+    return handModel.heightAt(i * ny + j);
+}
+
+double SimulationEngine::getHandInundationDepth(int i, int j) const
+{
+    if (handDepth.empty() || i < 0 || i >= nx || j < 0 || j >= ny)
+        return 0.0;
+    return handDepth[size_t(i) * ny + j];
+}
+
+QImage SimulationEngine::getHandInundationImage() const
+{
+    if (nx <= 0 || ny <= 0 || handDepth.size() != size_t(nx) * size_t(ny))
+        return QImage();
+    return renderDepthImage([this](int i, float *row) {
+        std::copy_n(handDepth.data() + size_t(i) * ny, ny, row);
+    }, handMaxDepth);
+}
+
+/**
+ * @brief Fills, spills and merges the rainfall excess over the total time
+ */
+bool SimulationEngine::runFillSpillMerge()
+{
+    if (nx <= 0 || ny <= 0 || totalTime <= 0.0)
+        return false;
+    if (!drainageNetwork.isBuilt())
+        buildDrainageNetwork();
+    routeWaterToOutlets();
+    if (!depressionStorage.isBuilt())
+        depressionStorage.build(flatElevations(), nx, ny);
+
+    const double excessDepth = rainfallExcessSeries(totalTime, 1)[0] * totalTime;
+    pondedResult = depressionStorage.route(excessDepth, resolution * resolution, drainageNetwork, outletCells);
+    double drained = 0.0;
+    for (double volume : pondedResult.outletVolume)
+        drained += volume;
+    qDebug() << "Fill-Spill-Merge of" << excessDepth << "m rainfall excess: ponded" << pondedResult.pondedVolume
+             << "m³, outlets" << drained << "m³, off the grid" << pondedResult.offGridVolume << "m³";
+    return true;
+}
+
+double SimulationEngine::getPondedDepth(int i, int j) const
+{
+    if (pondedResult.depth.empty() || i < 0 || i >= nx || j < 0 || j >= ny)
+        return 0.0;
+    return pondedResult.depth[size_t(i) * ny + j];
+}
+
+QImage SimulationEngine::getPondedDepthImage() const
+{
+    if (nx <= 0 || ny <= 0 || pondedResult.depth.size() != size_t(nx) * size_t(ny))
+        return QImage();
+    return renderDepthImage([this](int i, float *row) {
+        std::copy_n(pondedResult.depth.data() + size_t(i) * ny, ny, row);
+    }, pondedResult.maxDepth);
+}
+
+double SimulationEngine::getFillSpillMergeOutletVolume(int outlet) const
+{
+    if (outlet < 0 || outlet >= int(pondedResult.outletVolume.size()))
+        return 0.0;
+    return pondedResult.outletVolume[outlet];
+}
+
+void SimulationEngine::applyFillSpillMergeWarmStart()
+{
+    if (pondedResult.depth.size() != size_t(nx) * size_t(ny) && !runFillSpillMerge())
+        return;
+
+    loadInitialDepths(pondedResult.depth);
+    qDebug() << "Warm start from Fill-Spill-Merge:" << storedWaterVolume << "m³ ponded," << wetCellCount << "wet cells";
+}
+
+/**
+ * @brief Loads the depths row by row, dry outside the domain
+ *
+ * The loaded volume enters the source total, so the mass balance of the run
+ * still closes.
+ */
+double SimulationEngine::loadInitialDepths(const std::vector<float> &depth)
+{
+    std::vector<float> row(ny);
+    ReproducibleSum loaded;
+    for (int i = 0; i < nx; i++) {
+        double rowDepth = 0.0;
+        for (int j = 0; j < ny; j++) {
+            row[j] = (domainMask[i][j] != DOMAIN_INACTIVE) ? depth[size_t(i) * ny + j] : 0.0f;
+            rowDepth += double(row[j]);
+            wetCellCount += (row[j] > min_depth);
+            maxWaterDepth = std::max(maxWaterDepth, double(row[j]));
+        }
+        kernel->loadDepthRow(i, row.data());
+        loaded.add(rowDepth);
+    }
+    const double volume = loaded.value() * resolution * resolution;
+    storedWaterVolume += volume;
+    sourceSum.add(volume);
+    return volume;
+}
+
+void SimulationEngine::setMultigridWarmStart(int levels, double switchTime, MultigridAggregation aggregation)
+{
+    if (levels < 0 || levels > MultigridHierarchy::MAX_LEVELS || switchTime < 0.0) {
+        qDebug() << "Ignoring invalid multigrid warm start:" << levels << "levels, switch at" << switchTime << "s";
+        return;
+    }
+    multigridLevels = levels;
+    multigridSwitchTime = switchTime;
+    multigridAggregation = aggregation;
+}
+
+/**
+ * @brief Runs [0, switchTime] coarsest level first and hands the depths down
+ *
+ * Every level is a separate engine on the aggregated DEM with the outlets
+ * moved to the coarse cells that contain them; it runs until the end of its
+ * share of the switch time or until it is steady. Its depths are then
+ * prolongated onto the next finer level, which continues from the same time.
+ * The full-resolution run starts where the finest coarse level stopped: the
+ * prolongated water is loaded, and the drained volume is added to the
+ * sources so the mass balance closes over the whole event. If a level fails
+ * to initialize, the run starts dry at t = 0.
+ */
+void SimulationEngine::applyMultigridWarmStart()
+{
+    const double switchTime = std::min(multigridSwitchTime, totalTime);
+    if (switchTime <= 0.0)
+        return;
+    if (!multigrid.isBuiltFor(multigridLevels, multigridAggregation))
+        multigrid.build(flatElevations(), nx, ny, multigridLevels, multigridAggregation);
+    const int levels = multigrid.levelCount();
+    if (levels == 0)
+        return;
+
+    std::vector<float> depth;
+    std::vector<float> finerDepth;
+    double start = 0.0;
+    for (int level = levels; level >= 1; level--) {
+        const int factor = MultigridHierarchy::factor(level);
+        SimulationEngine coarse;
+        configureCoarseLevel(coarse, factor);
+        if (!coarse.loadElevations(multigrid.elevations(level), multigrid.rowCount(level), multigrid.columnCount(level)))
+            return;
+        QVector<QPoint> outlets;
+        for (int idx : outletCells)
+            outlets.append(QPoint(idx / ny / factor, idx % ny / factor));
+        coarse.setManualOutletCells(outlets);
+        // A coarse outlet drains through the width of the outlets it contains, not its own
+        coarse.outletWidths.assign(coarse.outletCells.size(), 0.0);
+        for (int idx : outletCells) {
+            const int m = coarse.getOutletIndexAt(idx / ny / factor, idx % ny / factor);
+            if (m >= 0)
+                coarse.outletWidths[m] += resolution;
+        }
+        coarse.setTotalTime(switchTime * (levels - level + 1) / levels);
+        if (!coarse.initSimulation()) {
+            qDebug() << "Multigrid level" << factor << "x could not start, running at full resolution only";
+            return;
+        }
+        coarse.time = start;
+        coarse.lastHydrographTime = start;
+        if (!depth.empty()) {
+            multigrid.prolongate(level + 1, depth, multigrid.elevations(level), finerDepth);
+            coarse.loadInitialDepths(finerDepth);
+        }
+
+        while (!coarse.isSimulationFinished() && !coarse.isSteadyState())
+            coarse.stepSimulation();
+        if (coarse.lastHydrographTime < coarse.time)
+            coarse.recordOutletHydrographs();
+        appendCoarseHistory(coarse, factor, start);
+        qDebug() << "Multigrid level" << factor << "x ran" << start << "-" << coarse.time << "s in"
+                 << coarse.stepCount << "steps" << (coarse.isSteadyState() ? "(steady)" : "");
+        start = coarse.time;
+
+        depth.resize(size_t(coarse.nx) * size_t(coarse.ny));
+        for (int i = 0; i < coarse.nx; i++)
+            coarse.kernel->copyDepthRow(i, depth.data() + size_t(i) * coarse.ny);
+    }
+
+    const std::vector<double> elevations = flatElevations();
+    multigrid.prolongate(1, depth, elevations, finerDepth);
+    const double loaded = loadInitialDepths(finerDepth);
+    sourceSum.add(drainageVolume);
+    time = start;
+    lastHydrographTime = start;
+    multigridHandoverTime = start;
+    qDebug() << "Multigrid warm start: full resolution from" << start << "s with" << loaded << "m³ stored,"
+             << drainageVolume << "m³ drained";
+}
+
+void SimulationEngine::configureCoarseLevel(SimulationEngine &level, int factor) const
+{
+    level.resolution = resolution * factor;
+    level.n_manning = n_manning;
+    level.Ks = Ks;
+    level.min_depth = min_depth;
+    level.rainfallRate = rainfallRate;
+    level.useTimeVaryingRainfall = useTimeVaryingRainfall;
+    level.rainfallSchedule = rainfallSchedule;
+    level.kernelPrecision = kernelPrecision;
+    level.kernelLayout = kernelLayout;
+    level.kernelTileSize = kernelTileSize;
+    level.kernelThreads = kernelThreads;
+    level.flowSolverName = flowSolverName;
+    level.maxTimeStep = maxTimeStep * factor;
+    level.contributingAreaOnly = contributingAreaOnly;
+    level.contributingHalo = (contributingHalo + factor - 1) / factor;
+    level.hydrographInterval = hydrographInterval;
+    level.steadyAction = SteadyStateAction::Report;
+    level.steadyWindow = steadyWindow;
+    level.steadyDepthRate = steadyDepthRate;
+    level.steadyBalance = steadyBalance;
+    // Internal engine: nothing displays its steps, so keep it headless
+    level.verboseLogging = false;
+}
+
+/**
+ * @brief Adds a coarse level's drainage to this run's totals and series
+ *
+ * Fine outlets inside the same coarse cell share that cell's drainage
+ * evenly. Samples at or before start belong to the previous level.
+ */
+void SimulationEngine::appendCoarseHistory(const SimulationEngine &level, int factor, double start)
+{
+    std::vector<int> coarseOutlet(outletCells.size(), -1);
+    std::vector<int> shares(level.outletCells.size(), 0);
+    for (size_t k = 0; k < outletCells.size(); k++) {
+        coarseOutlet[k] = level.getOutletIndexAt(outletCells[k] / ny / factor, outletCells[k] % ny / factor);
+        if (coarseOutlet[k] >= 0)
+            shares[coarseOutlet[k]]++;
+    }
+
+    const double drainedBefore = drainageVolume;
+    const QVector<QPair<double, double>> drained = level.drainageSeries.samplesSince(0);
+    for (const QPair<double, double> &sample : drained) {
+        if (sample.first > start)
+            drainageSeries.append(sample.first, drainedBefore + sample.second);
+    }
+    drainageSum.add(level.drainageVolume);
+    drainageVolume = drainageSum.value();
+
+    std::vector<double> discharge(outletCells.size(), 0.0);
+    for (qint64 s = 0; s < level.outletHydrographs.size(); s++) {
+        double t = 0.0;
+        level.outletHydrographs.valueAt(s, 0, &t);
+        if (t <= start)
+            continue;
+        for (size_t k = 0; k < outletCells.size(); k++) {
+            const int m = coarseOutlet[k];
+            discharge[k] = (m >= 0) ? level.outletHydrographs.valueAt(s, m) / shares[m] : 0.0;
+        }
+        outletHydrographs.append(t, discharge.data());
+    }
+    for (size_t k = 0; k < outletCells.size(); k++) {
+        if (coarseOutlet[k] >= 0)
+            outletDrainage[k] += level.outletDrainage[coarseOutlet[k]] / shares[coarseOutlet[k]];
+    }
+}
+
+/**
+ * @brief Samples outlet discharge for the hydrograph store
+ *
+ * Q is the volume drained by each outlet since the previous sample divided by
+ * the elapsed simulated time, so the hydrograph conserves volume at any
+ * sampling interval. The first call (t = 0) records zero discharge.
+ */
+void SimulationEngine::recordOutletHydrographs()
+{
+    // Channels and interval volumes are sized by initSimulation(), not by later outlet edits
+    const size_t channels = size_t(outletHydrographs.channelCount());
+    if (channels == 0)
+        return;
+
+    double elapsed = time - lastHydrographTime;
+    std::vector<double> discharge(channels, 0.0);
+    if (elapsed > 0.0) {
+        for (size_t k = 0; k < std::min(channels, outletIntervalVolume.size()); ++k)
+            discharge[k] = outletIntervalVolume[k] / elapsed;
+    }
+    outletHydrographs.append(time, discharge.data());
+
+    std::fill(outletIntervalVolume.begin(), outletIntervalVolume.end(), 0.0);
+    lastHydrographTime = time;
+}
+
+QVector<QPoint> SimulationEngine::getAutomaticOutletCells() const
+{
+    QVector<QPoint> result;
+    
+    // Convert 1D indices back to 2D coordinates
+    for (const auto& idx : outletCells) {
+        int i = idx / ny;  // row
+        int j = idx % ny;  // column
         
-        // Create multiple flow paths to ensure comprehensive drainage
-        for (int pathId = 0; pathId < maxPaths; pathId++) {
-            int currentI = i;
-            int currentJ = j;
-            
-            // If we're creating additional paths, offset the starting point
-            if (pathId > 0) {
-                if (pathId == 1 && j > 1) {
-                    currentJ = j - 1;  // Start one cell to the left
-                } else if (pathId == 2 && j < ny-2) {
-                    currentJ = j + 1;  // Start one cell to the right
-                } else {
-                    continue; // Skip if we can't create an offset path
-                }
+        if (i >= 0 && i < nx && j >= 0 && j < ny) {
+            result.append(QPoint(i, j));
+        }
+    }
+    
+    qDebug() << "Returning" << result.size() << "automatic outlet cells";
+    return result;
+}
+
+/**
+ * @brief Keeps the drainage network and outlet catchments up to date
+ *
+ * The D8 network (Priority-Flood filled DEM, flow directions, accumulation) is
+ * built once per DEM and catchments are relabeled whenever outlets change, so
+ * per step this only verifies that both exist.
+ */
+void SimulationEngine::routeWaterToOutlets()
+{
+    if (outletCells.empty() || nx <= 0 || ny <= 0)
+        return;
+
+    if (!drainageNetwork.isBuilt())
+        buildDrainageNetwork();
+    if (!drainageNetwork.hasCatchments() || drainageNetwork.catchmentCount() != int(outletCells.size()))
+        drainageNetwork.labelCatchments(outletCells);
+}
+
+std::vector<double> SimulationEngine::flatElevations() const
+{
+    std::vector<double> elevations(size_t(nx) * size_t(ny));
+    for (int i = 0; i < nx; i++) {
+        for (int j = 0; j < ny; j++) {
+            elevations[size_t(i) * ny + j] = dem[i][j];
+        }
+    }
+    return elevations;
+}
+
+/**
+ * @brief Builds the D8 drainage network for the loaded DEM
+ *
+ * Depends only on elevations (the diagonal distance factor is resolution
+ * independent), so it is rebuilt by loadDEM() and nowhere else.
+ */
+void SimulationEngine::buildDrainageNetwork()
+{
+    if (dem.isQuantized()) {
+        // Fill on the integer levels so no double copy of the DEM is made
+        std::vector<int32_t> levels(size_t(nx) * size_t(ny));
+        for (int i = 0; i < nx; i++) {
+            for (int j = 0; j < ny; j++) {
+                levels[size_t(i) * ny + j] = dem.level(i, j);
             }
-            
-            // Create a path uphill from the outlet
-            // We'll look for cells with higher flow accumulation to find natural channels
-            int pathLength = std::min(15, nx/2); // Extend path length for even better coverage
-            double pathFactor = 1.0; // Start with full effect at outlet
-            
-            // Add the initial cell to the path
-            if (pathId > 0) {
-                paths.push_back(std::make_pair(currentI, currentJ));
+        }
+        drainageNetwork.buildQuantized(std::move(levels), nx, ny, dem.offset(), dem.scale());
+    } else {
+        drainageNetwork.build(flatElevations(), nx, ny);
+    }
+    timeAreaModel.clear();
+    handModel.clear();
+    handDepth.clear();
+    handMaxDepth = 0.0;
+    depressionStorage.clear();
+    pondedResult = FillSpillMergeResult();
+    multigrid.clear();
+    if (!outletCells.empty())
+        drainageNetwork.labelCatchments(outletCells);
+}
+
+/**
+ * @brief Enables stepping only the cells that drain to the chosen outlets
+ * @param enabled True to restrict the domain to the outlet catchments
+ * @param haloCells Width of the flow-only buffer around the catchments (cells)
+ *
+ * Takes effect at the next initSimulation().
+ */
+void SimulationEngine::setContributingAreaOnly(bool enabled, int haloCells)
+{
+    contributingAreaOnly = enabled;
+    contributingHalo = std::max(0, haloCells);
+}
+
+/**
+ * @brief Builds the computational domain mask and its row spans
+ *
+ * Full mode: every valid DEM cell is active. Contributing-area mode: cells
+ * labeled with an outlet catchment are active (rain + flow), a halo of
+ * haloCells around them is flow-only so water spilling over a divide is not
+ * reflected back, and everything else is inactive (treated like NoData).
+ * The mask is then run-length encoded into per-row spans: stepSimulation()
+ * iterates only those spans and never tests a sentinel per cell. Only the
+ * iteration shrinks: kernels still allocate their depth, flux and face
+ * arrays for the full grid, h stays zero outside the domain, and images and
+ * totals keep full-grid coordinates.
+ */
+void SimulationEngine::buildComputationalDomain()
+{
+    domainMask.assign(nx, ny, DOMAIN_INACTIVE, DOMAIN_INACTIVE);
+
+    bool restrict = contributingAreaOnly && drainageNetwork.hasCatchments();
+    int rowMin = nx, rowMax = -1, colMin = ny, colMax = -1;
+    for (int i = 0; i < nx; i++) {
+        for (int j = 0; j < ny; j++) {
+            if (dem[i][j] <= -999998.0) continue;
+            if (restrict && drainageNetwork.catchmentAt(i * ny + j) < 0) continue;
+            domainMask[i][j] = DOMAIN_ACTIVE;
+            rowMin = std::min(rowMin, i);
+            rowMax = std::max(rowMax, i);
+            colMin = std::min(colMin, j);
+            colMax = std::max(colMax, j);
+        }
+    }
+
+    if (!restrict || rowMax < 0) {
+        if (restrict) {
+            qDebug() << "No outlet catchments available, simulating the full DEM";
+            for (int i = 0; i < nx; i++) {
+                for (int j = 0; j < ny; j++)
+                    domainMask[i][j] = (dem[i][j] <= -999998.0) ? DOMAIN_INACTIVE : DOMAIN_ACTIVE;
             }
+        }
+        buildDomainSpans();
+        kernel->setDomain(domainSpans, domainRowSpans);
+        faceCoefficientsDirty = true;
+        return;
+    }
 
-            // Keep track of cells already in this path to avoid loops
-            std::set<int> pathCellIndices;
-            pathCellIndices.insert(currentI * ny + currentJ);
+    // Grow the flow-only halo one ring at a time (4-neighbour dilation).
+    // The padded mask's border is inactive, so neighbours need no bounds tests.
+    for (int ring = 1; ring <= contributingHalo; ring++) {
+        int r0 = std::max(0, rowMin - ring), r1 = std::min(nx - 1, rowMax + ring);
+        int c0 = std::max(0, colMin - ring), c1 = std::min(ny - 1, colMax + ring);
+        std::vector<QPoint> grown;
+        for (int i = r0; i <= r1; i++) {
+            for (int j = c0; j <= c1; j++) {
+                if (domainMask[i][j] != DOMAIN_INACTIVE || dem[i][j] <= -999998.0) continue;
+                if (domainMask[i - 1][j] | domainMask[i][j + 1] | domainMask[i + 1][j] | domainMask[i][j - 1])
+                    grown.push_back(QPoint(i, j));
+            }
+        }
+        for (const QPoint &p : grown)
+            domainMask[p.x()][p.y()] = DOMAIN_HALO;
+    }
 
-            for (int step = 0; step < pathLength; step++) {
-                // Find the best next cell to include in the path (highest flow accumulation)
-                int di[8] = {-1, -1, 0, 1, 1, 1, 0, -1}; // Include diagonals
-                int dj[8] = {0, 1, 1, 1, 0, -1, -1, -1};
-                
-                double bestScore = -1.0;
-                int nextI = -1, nextJ = -1;
-                
-                // Prioritize movement uphill and toward high flow accumulation
-                for (int k = 0; k < 8; k++) {
-                    int ni = currentI + di[k];
-                    int nj = currentJ + dj[k];
-                    
-                    // Skip if out of bounds or no-data cell
-                    if (ni < 0 || ni >= nx || nj < 0 || nj >= ny || dem[ni][nj] <= -999998.0) {
-                        continue;
-                    }
-                    
-                    // Skip cells already in this path to avoid loops
-                    int cellIndex = ni * ny + nj;
-                    if (pathCellIndices.find(cellIndex) != pathCellIndices.end()) {
-                        continue;
-                    }
-                    
-                    // Calculate a score based on flow accumulation and elevation
-                    // Prefer cells that: 1) have high flow accumulation, 2) are uphill
-                    double flowScore = flowAccumulation[ni][nj] * 0.7; // Increased weight for flow accumulation
-                    double elevScore = std::max(0.0, dem[ni][nj] - dem[currentI][currentJ]) * 1.5;
-                    double upstreamScore = (ni < currentI) ? 2.5 : 0.0; // Prefer upstream cells
-                    
-                    // New: Add a penalty for flat areas to help guide water through depressions
-                    double flatPenalty = 0.0;
-                    if (std::abs(dem[ni][nj] - dem[currentI][currentJ]) < 0.01) {
-                        flatPenalty = -1.0; // Penalty for flat areas
-                    }
-                    
-                    double score = flowScore + elevScore + upstreamScore + flatPenalty;
-                    
-                    // Check if this is the best option so far
-                    if (score > bestScore) {
-                        bestScore = score;
-                        nextI = ni;
-                        nextJ = nj;
-                    }
-                }
-                
-                // If we couldn't find a next cell, stop this path
-                if (nextI < 0) break;
-                
-                // Add this cell to the path
-                currentI = nextI;
-                currentJ = nextJ;
-                paths.push_back(std::make_pair(currentI, currentJ));
-                pathCellIndices.insert(currentI * ny + currentJ);
-                
-                // Add water to the current cell - Reduced aggressiveness
-                /* // <<< COMMENT OUT START
-                double flowValue = flowAccumulation[currentI][currentJ];
-                double baseWaterAmount = min_depth * 15; // Reduced base amount from 25
-                
-                double flowMultiplier = 1.0 + std::min(1.5, flowValue / 10.0); // Reduced multiplier effect
-                double addedWater = baseWaterAmount * pathFactor * flowMultiplier;
-                
-                h[currentI][currentJ] += addedWater;
-                pathFactor *= 0.95; // Even slower decay 
-                
-                // Add water to adjacent cells - Reduced aggressiveness
-                if (flowAccumulation[currentI][currentJ] > 5.0) { // Increased threshold from 2.0
-                    for (int direction = 0; direction < 8; direction++) {
-                        int ni = currentI + di[direction];
-                        int nj = currentJ + dj[direction];
-                        
-                        if (ni >= 0 && ni < nx && nj >= 0 && nj < ny && dem[ni][nj] > -999998.0) {
-                            h[ni][nj] += addedWater * 0.5; // Reduced spread amount from 0.65
-                        }
-                    }
-                }
-                */ // <<< COMMENT OUT END
+    buildDomainSpans();
+    kernel->setDomain(domainSpans, domainRowSpans);
+    faceCoefficientsDirty = true;
+}
+
+/**
+ * @brief Creates the flow kernel for the selected precision and layout with zero depths
+ */
+void SimulationEngine::resetKernel()
+{
+    const FlowSolverRegistry &registry = FlowSolverRegistry::instance();
+    if (kernelLayout == KernelLayout::Tiled && !registry.supportsTiled(flowSolverName))
+        qDebug() << "Solver" << flowSolverName << "has no tiled layout, using row-major";
+
+    // Tile size and threads are fixed at construction, so the kernel is always recreated
+    KernelOptions options = {kernelPrecision, kernelLayout, kernelTileSize, kernelThreads};
+    kernel = registry.create(flowSolverName, options);
+    kernel->setDrainageNetwork(&drainageNetwork);
+    kernel->reset(nx, ny);
+    faceCoefficientsDirty = true;
+}
+
+void SimulationEngine::setPrecision(KernelPrecision precision)
+{
+    kernelPrecision = precision;
+}
+
+void SimulationEngine::setKernelLayout(KernelLayout layout, int tileSize)
+{
+    kernelLayout = layout;
+    kernelTileSize = tileSize;
+}
+
+void SimulationEngine::setThreadCount(int threads)
+{
+    kernelThreads = std::max(0, threads);
+}
+
+bool SimulationEngine::setFlowSolver(const QString &name)
+{
+    if (!FlowSolverRegistry::instance().contains(name)) {
+        qDebug() << "Unknown flow solver" << name << "- available:" << getAvailableFlowSolvers();
+        return false;
+    }
+    flowSolverName = name;
+    return true;
+}
+
+QStringList SimulationEngine::getAvailableFlowSolvers()
+{
+    return FlowSolverRegistry::instance().names();
+}
+
+void SimulationEngine::setMaxTimeStep(double seconds)
+{
+    if (seconds <= 0.0) {
+        qDebug() << "Ignoring invalid time step:" << seconds;
+        return;
+    }
+    maxTimeStep = seconds;
+}
+
+void SimulationEngine::setSteadyStateAction(SteadyStateAction action, double coarseStepFactor)
+{
+    steadyAction = action;
+    if (coarseStepFactor >= 1.0)
+        steadyCoarseFactor = coarseStepFactor;
+    else
+        qDebug() << "Ignoring invalid coarse step factor:" << coarseStepFactor;
+    coarseScale = steadyCoarseFactor;
+    if (action != SteadyStateAction::CoarseSteps)
+        coarseUntil = -1.0;
+}
+
+void SimulationEngine::setSteadyStateCriteria(double window, double maxDepthRate, double balanceTolerance)
+{
+    if (window < 0.0 || maxDepthRate < 0.0 || balanceTolerance < 0.0) {
+        qDebug() << "Ignoring invalid steady-state criteria:" << window << maxDepthRate << balanceTolerance;
+        return;
+    }
+    steadyWindow = window;
+    steadyDepthRate = maxDepthRate;
+    steadyBalance = balanceTolerance;
+}
+
+/**
+ * @brief Tests the step against the steady-state criteria
+ *
+ * Steady means no cell changes faster than steadyDepthRate and storage
+ * changes by at most steadyBalance of the larger of inflow and outflow, so
+ * outflow balances rainfall minus infiltration. Any failing step restarts
+ * the window. Coarse steps are (re)armed by every step that completes the
+ * window; while they run, a window without such a step halves the factor.
+ */
+void SimulationEngine::updateSteadyState(double sourced, double previousStored, double drained, double maxDepthChange)
+{
+    if (steadyAction == SteadyStateAction::Off || dt <= 0.0)
+        return;
+
+    steadyMetrics.maxDepthRate = maxDepthChange / dt;
+    steadyMetrics.storageRate = (storedWaterVolume - previousStored) / dt;
+    steadyMetrics.inflowRate = sourced / dt;
+    steadyMetrics.outflowRate = drained / dt;
+    const double scale = std::max(std::abs(steadyMetrics.inflowRate), steadyMetrics.outflowRate);
+    const bool steady = steadyMetrics.maxDepthRate <= steadyDepthRate
+                        && std::abs(steadyMetrics.storageRate) <= steadyBalance * scale;
+    if (!steady) {
+        if (steadyReached)
+            qDebug() << "Steady state lost at" << time << "s";
+        steadySince = -1.0;
+        steadyReached = false;
+        steadyMetrics.steadyFor = 0.0;
+        if (coarseUntil > time && coarseScale > 1.0 && time - coarseSettled >= steadyWindow) {
+            coarseScale = std::max(1.0, 0.5 * coarseScale);
+            coarseSettled = time;
+            qDebug() << "Coarse steps did not settle by" << time << "s, step factor lowered to" << coarseScale;
+        }
+        return;
+    }
+
+    if (steadySince < 0.0)
+        steadySince = time - dt;
+    steadyMetrics.steadyFor = time - steadySince;
+    if (steadyMetrics.steadyFor < steadyWindow)
+        return;
+    if (steadyAction == SteadyStateAction::CoarseSteps) {
+        coarseUntil = nextRainfallChange(time);
+        coarseSettled = time;
+    }
+    if (steadyReached)
+        return;
+
+    steadyReached = true;
+    stoppedAtSteadyState = (steadyAction == SteadyStateAction::Stop) && std::isinf(nextRainfallChange(time));
+    qDebug() << "Steady state at" << time << "s: outflow" << steadyMetrics.outflowRate << "m³/s, inflow"
+             << steadyMetrics.inflowRate << "m³/s, max |dh/dt|" << steadyMetrics.maxDepthRate << "m/s"
+             << (stoppedAtSteadyState ? "- run stopped" : "");
+    emit steadyStateReached(time, stoppedAtSteadyState);
+}
+
+void SimulationEngine::setElevationStorage(ElevationStorage storage, double precision)
+{
+    elevationStorage = storage;
+    elevationPrecision = precision;
+}
+
+double SimulationEngine::getWaterDepth(int i, int j) const
+{
+    if (!kernel || i < 0 || i >= nx || j < 0 || j >= ny)
+        return 0.0;
+    return kernel->depth(i, j);
+}
+
+/**
+ * @brief Run-length encodes domainMask into row spans of equal role
+ *
+ * Outlet cells get single-cell spans flagged as outlets so the update sweep
+ * can drain them in place without a per-cell outlet lookup.
+ */
+void SimulationEngine::buildDomainSpans()
+{
+    domainSpans.clear();
+    domainRowSpans.assign(nx + 1, 0);
+    const bool hasOutletIndex = outletIdGrid.size() == size_t(nx) * size_t(ny);
+    auto isOutlet = [&](int i, int j) {
+        return hasOutletIndex && outletIdGrid[size_t(i) * ny + j] >= 0;
+    };
+
+    qint64 domainCells = 0;
+    for (int i = 0; i < nx; i++) {
+        domainRowSpans[i] = int(domainSpans.size());
+        const uint8_t *row = domainMask[i];
+        int j = 0;
+        while (j < ny) {
+            if (row[j] == DOMAIN_INACTIVE) {
+                j++;
+                continue;
             }
+            CellSpan span = {i, j, j + 1, row[j], isOutlet(i, j)};
+            j++;
+            if (!span.outlet) {
+                while (j < ny && row[j] == span.role && !isOutlet(i, j))
+                    j++;
+                span.end = j;
+            }
+            domainCells += span.end - span.begin;
+            domainSpans.push_back(span);
         }
-        
-        // Debug path information
-        qDebug() << "Created" << paths.size() << "path segments for outlet at" << i << j;
-        
-        // Ensure the outlet cell itself has sufficient water - Reduced aggressiveness
-        /* // <<< COMMENT OUT START
-        if (h[i][j] < min_depth * 10) { // Reduced from 20
-            h[i][j] = min_depth * 10; // Reduced from 20
+    }
+    domainRowSpans[nx] = int(domainSpans.size());
+    qDebug() << "Computational domain:" << domainCells << "of" << qint64(nx) * ny << "cells in"
+             << domainSpans.size() << "row spans";
+}
+
+/**
+ * @brief Crops the DEM to the bounding box of its valid cells
+ *
+ * DEMs clipped to a catchment polygon carry wide NoData margins. Removing
+ * them shrinks every per-cell grid (h, scratch fluxes, drainage network,
+ * images, depth frames). The geotransform is shifted to the new upper-left
+ * corner so exported rasters stay georeferenced; getCropOffset() maps grid
+ * cells back to file cells.
+ */
+void SimulationEngine::cropToValidData()
+{
+    int rowMin = nx, rowMax = -1, colMin = ny, colMax = -1;
+    for (int i = 0; i < nx; i++) {
+        for (int j = 0; j < ny; j++) {
+            if (dem[i][j] <= -999998.0) continue;
+            rowMin = std::min(rowMin, i);
+            rowMax = std::max(rowMax, i);
+            colMin = std::min(colMin, j);
+            colMax = std::max(colMax, j);
         }
-        */ // <<< COMMENT OUT END
-        
-        // Ensure cells immediately upstream have sufficient water - Reduced aggressiveness
-        /* // <<< COMMENT OUT START
-        for (int di = -1; di <= 0; di++) {
-            for (int dj = -1; dj <= 1; dj++) {
-                int ni = i + di;
-                int nj = j + dj;
-                
-                if (ni >= 0 && ni < nx && nj >= 0 && nj < ny && dem[ni][nj] > -999998.0) {
-                    h[ni][nj] = std::max(h[ni][nj], min_depth * 8); // Reduced from 15
-                }
+    }
+
+    cropRowOffset = 0;
+    cropColOffset = 0;
+    if (rowMax < 0) {
+        qDebug() << "Warning: DEM has no valid cells, nothing to crop";
+        return;
+    }
+    if (rowMin == 0 && colMin == 0 && rowMax == nx - 1 && colMax == ny - 1)
+        return;
+
+    int rows = rowMax - rowMin + 1;
+    int cols = colMax - colMin + 1;
+    dem.crop(rowMin, colMin, rows, cols);
+
+    qDebug() << "Cropped DEM from" << nx << "x" << ny << "to" << rows << "x" << cols
+             << "(offset" << rowMin << "," << colMin << ")";
+
+    nx = rows;
+    ny = cols;
+    cropRowOffset = rowMin;
+    cropColOffset = colMin;
+    if (hasGeoTransform) {
+        geoTransform[0] += colMin * geoTransform[1] + rowMin * geoTransform[2];
+        geoTransform[3] += colMin * geoTransform[4] + rowMin * geoTransform[5];
+    }
+}
+
+/**
+ * @brief Adds a single manual outlet and relabels only the basin it splits
+ * @param cell Outlet cell as (row, column)
+ * @return true if the outlet was added
+ */
+bool SimulationEngine::addManualOutletCell(const QPoint &cell)
+{
+    if (cell.x() < 0 || cell.x() >= nx || cell.y() < 0 || cell.y() >= ny || isOutletCell(cell.x(), cell.y())
+        || !releaseOutletArrays())
+        return false;
+
+    if (!useManualOutlets) {
+        // Switching from automatic outlets: start a fresh manual set
+        setManualOutletCells(QVector<QPoint>() << cell);
+        return useManualOutlets;
+    }
+
+    int idx = cell.x() * ny + cell.y();
+    manualOutletCells.append(cell);
+    outletIdGrid[idx] = int(outletCells.size());
+    outletCells.push_back(idx);
+    if (drainageNetwork.hasCatchments())
+        drainageNetwork.addOutlet(idx);
+    return true;
+}
+
+/**
+ * @brief Removes a single manual outlet and merges its basin downstream
+ * @param cell Outlet cell as (row, column)
+ * @return true if the outlet was removed
+ *
+ * Outlet indices are kept dense by moving the last outlet into the freed slot.
+ */
+bool SimulationEngine::removeManualOutletCell(const QPoint &cell)
+{
+    int id = getOutletIndexAt(cell.x(), cell.y());
+    if (!useManualOutlets || id < 0 || outletCells.size() <= 1 || !releaseOutletArrays())
+        return false;
+
+    manualOutletCells.removeAll(cell);
+    if (drainageNetwork.hasCatchments())
+        drainageNetwork.removeOutlet(id);
+
+    int last = int(outletCells.size()) - 1;
+    outletIdGrid[outletCells[id]] = -1;
+    if (id != last) {
+        outletCells[id] = outletCells[last];
+        outletIdGrid[outletCells[id]] = id;
+    }
+    outletCells.pop_back();
+    return true;
+}
+
+/**
+ * @brief Keeps single outlet edits from desynchronizing a run
+ *
+ * The kernel's outlet spans, the per-outlet accumulators and the hydrograph
+ * channels are laid out by initSimulation() in outlet index order. Adding an
+ * outlet mid-run would leave it undrained and past the end of the arrays;
+ * the swap-remove would credit the last outlet's drainage to the removed
+ * one. Between runs the arrays only hold results, which the edit's new
+ * indices would misattribute, so they are dropped.
+ */
+bool SimulationEngine::releaseOutletArrays()
+{
+    if (runInitialized && !isSimulationFinished()) {
+        qDebug() << "Outlets are fixed while a simulation runs; edit them before initSimulation()";
+        return false;
+    }
+    runInitialized = false;
+    outletDrainage.clear();
+    outletIntervalVolume.clear();
+    outletHydrographs.reset(0);
+    return true;
+}
+
+int SimulationEngine::getCatchmentIdAt(int i, int j) const
+{
+    if (i < 0 || i >= nx || j < 0 || j >= ny)
+        return -1;
+    return drainageNetwork.catchmentAt(i * ny + j);
+}
+
+double SimulationEngine::getCatchmentArea(int outlet) const
+{
+    if (!drainageNetwork.hasCatchments() || outlet < 0 || outlet >= drainageNetwork.catchmentCount())
+        return 0.0;
+    return double(drainageNetwork.catchmentCells(outlet).size()) * resolution * resolution;
+}
+
+QVector<QPoint> SimulationEngine::getCatchmentCells(int outlet) const
+{
+    QVector<QPoint> result;
+    if (!drainageNetwork.hasCatchments() || outlet < 0 || outlet >= drainageNetwork.catchmentCount())
+        return result;
+    const std::vector<int> &cells = drainageNetwork.catchmentCells(outlet);
+    result.reserve(int(cells.size()));
+    for (int idx : cells)
+        result.append(QPoint(idx / ny, idx % ny));
+    return result;
+}
+
+/**
+ * @brief Generates a basin map with one color per outlet catchment
+ * @return QImage with cells that reach no outlet in light gray
+ */
+QImage SimulationEngine::getCatchmentImage() const
+{
+    if (nx <= 0 || ny <= 0 || !drainageNetwork.hasCatchments())
+        return QImage();
+
+    QImage img(ny, nx, QImage::Format_RGB32);
+    for (int i = 0; i < nx; i++) {
+        for (int j = 0; j < ny; j++) {
+            if (dem[i][j] <= -999998.0) {
+                img.setPixel(j, i, qRgb(200, 200, 200));
+                continue;
+            }
+            int id = drainageNetwork.catchmentAt(i * ny + j);
+            if (isOutletCell(i, j)) {
+                img.setPixel(j, i, qRgb(255, 50, 50));
+            } else if (id < 0) {
+                img.setPixel(j, i, qRgb(235, 235, 235));
+            } else {
+                // Golden-angle hue spacing keeps neighbouring IDs distinct
+                double hue = std::fmod(id * 0.618033988749895, 1.0);
+                img.setPixel(j, i, QColor::fromHsvF(hue, 0.45, 0.95).rgb());
             }
         }
-        */ // <<< COMMENT OUT END
     }
+    return img;
 }
 
 /**
@@ -1536,6 +2413,7 @@ void SimulationEngine::routeWaterToOutlets()
 void SimulationEngine::computeOutletCellsByPercentile(double percentile)
 {
     outletCells.clear();
+    outletIdGrid.clear();
     if (nx <= 0 || ny <= 0)
         return;
 
@@ -1569,6 +2447,7 @@ void SimulationEngine::computeOutletCellsByPercentile(double percentile)
             }
         }
         if(minIdx != -1) outletCells.push_back(minIdx);
+        rebuildOutletIndex();
         return;
     }
 
@@ -1594,6 +2473,7 @@ void SimulationEngine::computeOutletCellsByPercentile(double percentile)
     // Optional: Ensure some minimum spacing between outlets if they are too clustered?
     // (Could be added later if needed)
 
+    rebuildOutletIndex();
     qDebug() << "Selected" << outletCells.size() << "automatic outlet cells along boundary.";
 }
 
@@ -1653,19 +2533,24 @@ void SimulationEngine::setRainfallSchedule(const QVector<QPair<double, double>>&
  * - Uses last rate after last time point
  */
 double SimulationEngine::getCurrentRainfallRate() const
+{
+    return rainfallRateAt(time);
+}
+
+double SimulationEngine::rainfallRateAt(double t) const
 {
     if (!useTimeVaryingRainfall || rainfallSchedule.isEmpty()) {
         return rainfallRate; // Fall back to constant rate
     }
     
-    // Find the applicable rainfall rate for the current time
+    // Find the applicable rainfall rate for the requested time
     double currentRate = rainfallSchedule.first().second; // Default to first rate
     
     for (int i = 0; i < rainfallSchedule.size(); i++) {
         const QPair<double, double>& entry = rainfallSchedule[i];
         
         // If this entry's time is in the future, use the previous entry's rate
-        if (entry.first > time) {
+        if (entry.first > t) {
             break;
         }
         
@@ -1676,6 +2561,50 @@ double SimulationEngine::getCurrentRainfallRate() const
     return currentRate;
 }
 
+double SimulationEngine::nextRainfallChange(double t) const
+{
+    double next = std::numeric_limits<double>::infinity();
+    if (!useTimeVaryingRainfall || rainfallSchedule.isEmpty())
+        return next;
+    const double current = rainfallRateAt(t);
+    for (const QPair<double, double> &entry : rainfallSchedule) {
+        if (entry.first > t && entry.second != current)
+            next = std::min(next, entry.first);
+    }
+    return next;
+}
+
+/**
+ * @brief Averages the rainfall excess over fixed intervals
+ *
+ * The schedule is a step function, so each interval gets the exact mean of
+ * the pieces overlapping it. As in rainfallRateAt(), the first entry's rate
+ * also applies before its start time.
+ */
+std::vector<double> SimulationEngine::rainfallExcessSeries(double interval, int count) const
+{
+    std::vector<double> excess(std::max(0, count), 0.0);
+    if (!useTimeVaryingRainfall || rainfallSchedule.isEmpty()) {
+        std::fill(excess.begin(), excess.end(), std::max(0.0, rainfallRate - Ks));
+        return excess;
+    }
+
+    const double end = interval * count;
+    for (int k = 0; k < rainfallSchedule.size(); k++) {
+        const double rate = std::max(0.0, rainfallSchedule[k].second - Ks);
+        const double from = (k == 0) ? 0.0 : std::max(0.0, rainfallSchedule[k].first);
+        const double to = (k + 1 < rainfallSchedule.size()) ? std::min(end, rainfallSchedule[k + 1].first) : end;
+        if (rate <= 0.0 || to <= from)
+            continue;
+        for (int n = int(from / interval); n < count && n * interval < to; n++) {
+            double overlap = std::min(to, (n + 1) * interval) - std::max(from, n * interval);
+            if (overlap > 0.0)
+                excess[n] += rate * overlap / interval;
+        }
+    }
+    return excess;
+}
+
 /**
  * @brief Computes default outlet cells using configured percentile
  * 
@@ -9,6 +9,38 @@
 #include <QVector>
 #include <QPair>
 #include <QMap>
+#include <QStringList>
+#include "TimeSeriesStore.h"
+#include "DrainageNetwork.h"
+#include "TimeAreaModel.h"
+#include "HandModel.h"
+#include "FillSpillMerge.h"
+#include "MultigridHierarchy.h"
+#include "PaddedGrid.h"
+#include "ElevationGrid.h"
+#include "FlowKernel.h"
+#include "Reduction.h"
+#include <functional>
+#include <memory>
+
+class DepthFrameWriter;
+
+/// What the engine does once a run has reached steady state
+enum class SteadyStateAction {
+    Off,                           ///< No detection
+    Report,                        ///< Emit steadyStateReached() and keep stepping
+    Stop,                          ///< End the run, unless the rainfall schedule still changes
+    CoarseSteps                    ///< Raise the step cap by the coarse factor until the rainfall changes
+};
+
+/// Convergence metrics of the last step
+struct SteadyStateMetrics {
+    double maxDepthRate = 0.0;     ///< Largest |dh/dt| of a domain cell (m/s)
+    double storageRate = 0.0;      ///< Change of the stored volume (m³/s)
+    double inflowRate = 0.0;       ///< Rainfall minus infiltration added to the grid (m³/s)
+    double outflowRate = 0.0;      ///< Outlet drainage (m³/s)
+    double steadyFor = 0.0;        ///< Simulated time the criteria have held (s)
+};
 
 // Define operator< for QPoint to use with QMap
 // This enables QPoint to be used as a key in QMap for tracking per-outlet drainage
@@ -50,6 +82,17 @@ public:
      */
     bool loadDEM(const QString &filename);
 
+    /**
+     * @brief Loads a DEM from memory, e.g. a coarse level of the multigrid warm start
+     * @param elevations Row-major elevations (m); values <= -999998 are NoData
+     * @param rows Number of grid rows
+     * @param cols Number of grid columns
+     * @return true if loading succeeded
+     *
+     * Carries no georeferencing; the resolution stays as set.
+     */
+    bool loadElevations(const std::vector<double> &elevations, int rows, int cols);
+
     /**
      * @brief Initializes simulation state
      * @return true if initialization succeeded
@@ -116,6 +159,42 @@ public:
      */
     void setManualOutletCells(const QVector<QPoint> &cells);
 
+    /**
+     * @brief Restricts stepping to cells that drain to the chosen outlets
+     * @param enabled True to simulate only the outlet catchments
+     * @param haloCells Flow-only buffer width around the catchments (cells)
+     *
+     * Applied at the next initSimulation(). Only the stepped spans shrink;
+     * kernel grids keep the full DEM size and results full-DEM coordinates.
+     */
+    void setContributingAreaOnly(bool enabled, int haloCells = 2);
+
+    /**
+     * @brief Checks whether contributing-area-only stepping is enabled
+     */
+    bool isContributingAreaOnly() const { return contributingAreaOnly; }
+
+    /**
+     * @brief Adds one manual outlet, relabeling only the catchment it splits
+     * @param cell Outlet cell as (row, column)
+     * @return true if the outlet was added; false while an initialized run is in progress
+     *
+     * initSimulation() fixes the outlet spans and per-outlet arrays of a run,
+     * so edits are refused until it has finished and apply at the next
+     * initSimulation(). An edit after a finished run drops its per-outlet
+     * drainage and hydrographs, whose outlet indices no longer hold.
+     */
+    bool addManualOutletCell(const QPoint &cell);
+
+    /**
+     * @brief Removes one manual outlet, merging its catchment downstream
+     * @param cell Outlet cell as (row, column)
+     * @return true if the outlet was removed; false while an initialized run is in progress
+     *
+     * Same run rules as addManualOutletCell().
+     */
+    bool removeManualOutletCell(const QPoint &cell);
+
     /**
      * @brief Sets rainfall schedule
      * @param schedule Vector of time-rainfall pairs
@@ -147,10 +226,229 @@ public:
     double getTotalDrainage() const { return drainageVolume; }
 
     /**
-     * @brief Gets drainage time series
+     * @brief Gets the water volume stored on the grid after the last step
+     * @return Stored volume (m³)
+     */
+    double getStoredWaterVolume() const { return storedWaterVolume; }
+
+    /**
+     * @brief Gets the number of cells deeper than the minimum water depth
+     */
+    qint64 getWetCellCount() const { return wetCellCount; }
+
+    /**
+     * @brief Gets the deepest water on the grid after the last step
+     * @return Maximum depth (m)
+     */
+    double getMaxWaterDepth() const { return maxWaterDepth; }
+
+    /**
+     * @brief Gets the net volume added by rainfall and infiltration since initSimulation()
+     * @return Volume (m³); equals stored plus drained volume when mass is conserved
+     *
+     * Includes the ponded water loaded by a Fill-Spill-Merge warm start.
+     */
+    double getNetSourceVolume() const { return sourceSum.value(); }
+
+    /**
+     * @brief Gets the water depth of one cell
+     * @return Depth (m), 0 outside the grid or before a DEM is loaded
+     */
+    double getWaterDepth(int i, int j) const;
+
+    /**
+     * @brief Selects the storage precision of depths and fluxes
+     * @param precision KernelPrecision::Double (default) or KernelPrecision::Float
+     *
+     * Float halves the memory traffic of each step; volume totals are still
+     * accumulated in double by ReproducibleSum. Applied at the next initSimulation().
+     */
+    void setPrecision(KernelPrecision precision);
+
+    /**
+     * @brief Gets the selected storage precision
+     */
+    KernelPrecision getPrecision() const { return kernelPrecision; }
+
+    /**
+     * @brief Selects the memory layout of the kernel grids
+     * @param layout KernelLayout::RowMajor (default) or KernelLayout::Tiled
+     * @param tileSize Cells per tile side of the tiled layout
+     *
+     * The tiled layout stores depths and fluxes in square blocks with halos,
+     * keeping the N/S stencil neighbours in cache on wide rasters, and
+     * allocates only tiles that hold domain cells. Applied at the next
+     * initSimulation().
+     */
+    void setKernelLayout(KernelLayout layout, int tileSize = 64);
+
+    /**
+     * @brief Gets the selected kernel layout
+     */
+    KernelLayout getKernelLayout() const { return kernelLayout; }
+
+    /**
+     * @brief Sets the worker threads of the tiled and local inertial kernels
+     * @param threads Threads including the simulation thread, 0 = one per core
+     *
+     * Applied at the next initSimulation(). Results do not depend on the
+     * thread count.
+     */
+    void setThreadCount(int threads);
+
+    /**
+     * @brief Gets the tiles stepped in the last step (tiled layout only)
+     *
+     * Dry tiles that cannot receive water are skipped, so this is the
+     * measure step time scales with.
+     */
+    int getActiveTileCount() const { return activeTileCount; }
+
+    /**
+     * @brief Selects the flow physics by registered solver name
+     * @param name A name from getAvailableFlowSolvers(), e.g. "diffusive" (default) or "inertial"
+     * @return false if no solver of that name is registered
+     *
+     * The local inertial solver carries face discharges between steps with
+     * semi-implicit friction and is stable up to a CFL step that on flat
+     * terrain is far longer than the diffusive scheme allows; raise
+     * setMaxTimeStep() to use it. Solvers without a tiled implementation run
+     * row-major whatever setKernelLayout() selects. Applied at the next
+     * initSimulation().
+     */
+    bool setFlowSolver(const QString &name);
+
+    /**
+     * @brief Gets the name of the selected flow solver
+     */
+    QString getFlowSolver() const { return flowSolverName; }
+
+    /**
+     * @brief Names of the solvers in FlowSolverRegistry, default first
+     */
+    static QStringList getAvailableFlowSolvers();
+
+    /**
+     * @brief Sets the longest time step (default 1 s)
+     *
+     * Each step takes the smaller of this and the solver's stable step;
+     * the diffusive solver has no stability estimate and always uses it.
+     */
+    void setMaxTimeStep(double seconds);
+
+    /**
+     * @brief Gets the length of the last step (s)
+     */
+    double getTimeStep() const { return dt; }
+
+    /**
+     * @brief Enables the per-step progress and outlet drainage log (default on)
+     *
+     * Headless runs (the benchmark, multigrid coarse levels) turn it off so
+     * step times measure the solver rather than logging.
+     */
+    void setVerboseLogging(bool enabled) { verboseLogging = enabled; }
+
+    /**
+     * @brief Selects what happens when the run reaches steady state
+     * @param action SteadyStateAction::Off (default), Report, Stop or CoarseSteps
+     * @param coarseStepFactor Multiplier of the max time step while steady (CoarseSteps)
+     *
+     * Stop ends the run early (isSimulationFinished()) only if the rainfall
+     * does not change for the rest of the schedule. Coarse steps still respect
+     * the solver's stable step and last until the next rainfall change. The
+     * outlet drainage is explicit, so a longer step moves the steady state
+     * slightly; if the run does not settle again within a window the factor
+     * is halved.
+     */
+    void setSteadyStateAction(SteadyStateAction action, double coarseStepFactor = 10.0);
+    SteadyStateAction getSteadyStateAction() const { return steadyAction; }
+
+    /**
+     * @brief Sets the steady-state criteria
+     * @param window Simulated time the criteria must hold without a break (s), default 600
+     * @param maxDepthRate Largest |dh/dt| of any cell (m/s), default 1e-6
+     * @param balanceTolerance Largest |dS/dt| relative to the larger of inflow
+     *        and outflow, default 0.01
+     */
+    void setSteadyStateCriteria(double window, double maxDepthRate, double balanceTolerance);
+
+    /**
+     * @brief Gets the convergence metrics of the last step
+     */
+    const SteadyStateMetrics &getSteadyStateMetrics() const { return steadyMetrics; }
+
+    /**
+     * @brief Tests whether the criteria have held for the whole window
+     */
+    bool isSteadyState() const { return steadyReached; }
+
+    /**
+     * @brief Tests whether the run is over: total time reached or stopped at steady state
+     */
+    bool isSimulationFinished() const { return time >= totalTime || stoppedAtSteadyState; }
+
+    /**
+     * @brief Selects how DEM elevations are stored
+     * @param storage ElevationStorage::Double (default), Int32 or Int16
+     * @param precision Elevation quantum of the integer modes (m)
+     *
+     * Integer storage keeps offset + precision * level per cell, cutting the
+     * DEM grid to a half or a quarter of its double footprint, and the
+     * drainage network keeps its filled surface as int32 levels (about 13
+     * instead of 17 bytes per cell). The flow kernels are not affected: they
+     * still cache Real bed drops per face (about 40 bytes per cell in float,
+     * 80 in double, for the diffusive solver), and Fill-Spill-Merge and the
+     * multigrid warm start work on double copies of the elevations. Only the
+     * loaded DEM and the drainage network are compact; a run still needs
+     * 8-32 bytes per cell on top of them. Int16 falls back to Int32 when
+     * the elevation range needs more than 65534 levels. Applied at the next
+     * loadDEM().
+     */
+    void setElevationStorage(ElevationStorage storage, double precision = 0.01);
+
+    /**
+     * @brief Gets the storage actually used by the loaded DEM
+     */
+    ElevationStorage getElevationStorage() const { return dem.storage(); }
+
+    /**
+     * @brief Gets the bytes held by the DEM elevations
+     */
+    size_t getElevationMemoryBytes() const { return dem.memoryBytes(); }
+
+    /**
+     * @brief Gets the bytes held by the drainage network and its catchments
+     */
+    size_t getDrainageNetworkMemoryBytes() const { return drainageNetwork.memoryBytes(); }
+
+    /**
+     * @brief Gets the full drainage time series
      * @return Vector of time-drainage pairs
+     *
+     * Copies the whole history (reading spilled samples from disk). Pollers
+     * should use getDrainageSamplesSince() or getDrainageTimeSeriesDecimated().
+     */
+    QVector<QPair<double, double>> getDrainageTimeSeries() const;
+
+    /**
+     * @brief Gets the number of recorded drainage samples
      */
-    QVector<QPair<double, double>> getDrainageTimeSeries() const { return drainageTimeSeries; }
+    qint64 getDrainageSampleCount() const { return drainageSeries.size(); }
+
+    /**
+     * @brief Gets drainage samples recorded after a known point
+     * @param first Index of the first sample wanted (previous sample count)
+     * @return Time-drainage pairs for samples [first, getDrainageSampleCount())
+     */
+    QVector<QPair<double, double>> getDrainageSamplesSince(qint64 first) const;
+
+    /**
+     * @brief Gets a min/max decimated drainage history for plotting
+     * @param maxPoints Maximum number of points returned
+     * @return Time-ordered time-drainage pairs preserving local extrema
+     */
+    QVector<QPair<double, double>> getDrainageTimeSeriesDecimated(int maxPoints) const;
 
     /**
      * @brief Gets automatic outlet cells
@@ -161,8 +459,86 @@ public:
     /**
      * @brief Gets per-outlet drainage volumes
      * @return Map of outlet coordinates to drainage volumes
+     *
+     * Built on demand from the flat per-outlet accumulators.
      */
-    QMap<QPoint, double> getPerOutletDrainage() const { return perOutletDrainage; }
+    QMap<QPoint, double> getPerOutletDrainage() const;
+
+    /**
+     * @brief Gets the number of active outlets
+     */
+    int getOutletCount() const { return int(outletCells.size()); }
+
+    /**
+     * @brief Gets the grid position of an outlet
+     * @param outlet Outlet index in [0, getOutletCount())
+     * @return Outlet cell as (row, column)
+     */
+    QPoint getOutletCell(int outlet) const;
+
+    /**
+     * @brief Gets the outlet index of a cell in O(1)
+     * @param i Row index
+     * @param j Column index
+     * @return Outlet index, or -1 if the cell is not an outlet
+     */
+    int getOutletIndexAt(int i, int j) const {
+        if (i < 0 || i >= nx || j < 0 || j >= ny || outletIdGrid.empty())
+            return -1;
+        return outletIdGrid[size_t(i) * ny + j];
+    }
+
+    /**
+     * @brief Tests whether a cell is an outlet in O(1)
+     */
+    bool isOutletCell(int i, int j) const { return getOutletIndexAt(i, j) >= 0; }
+
+    /**
+     * @brief Gets the cumulative drainage of one outlet
+     * @param outlet Outlet index in [0, getOutletCount())
+     * @return Drained volume (m³)
+     */
+    double getOutletDrainage(int outlet) const;
+
+    /**
+     * @brief Sets the interval at which outlet discharge is sampled
+     * @param seconds Sampling interval in simulated seconds (0 = every step)
+     */
+    void setHydrographInterval(double seconds);
+
+    /**
+     * @brief Gets the number of recorded hydrograph samples (shared by all outlets)
+     */
+    qint64 getHydrographSampleCount() const { return outletHydrographs.size(); }
+
+    /**
+     * @brief Gets discharge samples of one outlet recorded after a known point
+     * @param outlet Outlet index in [0, getOutletCount())
+     * @param first Index of the first sample wanted (previous sample count)
+     * @return Time-discharge pairs (s, m³/s), discharge averaged over each interval
+     */
+    QVector<QPair<double, double>> getOutletHydrographSince(int outlet, qint64 first) const;
+
+    /**
+     * @brief Gets a min/max decimated hydrograph of one outlet for plotting
+     * @param outlet Outlet index in [0, getOutletCount())
+     * @param maxPoints Maximum number of points returned
+     */
+    QVector<QPair<double, double>> getOutletHydrographDecimated(int outlet, int maxPoints) const;
+
+    /**
+     * @brief Gets an outlet hydrograph from the time-area surrogate, without simulating
+     * @param outlet Outlet index in [0, getOutletCount())
+     * @param interval Sample interval (s), 0 = the hydrograph interval
+     * @return Time-discharge pairs (s, m³/s) over the total time, discharge averaged over each interval
+     *
+     * Convolves the rainfall excess (rainfall - Ks, following the schedule when
+     * time-varying rainfall is on) with the outlet's time-area histogram (see
+     * TimeAreaModel). Travel times are rebuilt only when the DEM, resolution,
+     * Manning's n or peak excess change; otherwise a call costs one pass over
+     * the outlet's catchment, fast enough to follow outlet clicks.
+     */
+    QVector<QPair<double, double>> getSurrogateHydrograph(int outlet, double interval = 0.0);
 
     /**
      * @brief Gets current rainfall rate
@@ -176,6 +552,119 @@ public:
      */
     QImage getWaterDepthImage() const;
 
+    /**
+     * @brief Sets the upstream area at which the HAND model starts a channel
+     * @param area Contributing area (m²), default 10000 (1 ha)
+     *
+     * Converted to flow-accumulation cells with the current resolution; the
+     * HAND raster is rebuilt at the next inundation map if it changes.
+     */
+    void setHandChannelArea(double area);
+
+    /**
+     * @brief Maps inundation for a water stage above the nearest drainage, without time stepping
+     * @param stage Water level above the channel network (m)
+     * @return false if no DEM is loaded
+     */
+    bool mapHandInundation(double stage);
+
+    /**
+     * @brief Maps the inundation that stores each outlet catchment's rainfall excess
+     * @return false if no DEM or outlets are set
+     *
+     * The volume per catchment is the rainfall excess (rainfall - Ks, from
+     * the schedule when time-varying) over the total time times the
+     * catchment area, spread as a flat stage above the drainage (see
+     * HandModel).
+     */
+    bool mapHandInundationFromRainfall();
+
+    /**
+     * @brief Gets the HAND value of a cell (m), negative for NoData or before the first map
+     */
+    double getHeightAboveDrainage(int i, int j) const;
+
+    /**
+     * @brief Gets the depth of the last HAND inundation map at a cell (m)
+     */
+    double getHandInundationDepth(int i, int j) const;
+
+    /**
+     * @brief Gets the last HAND inundation map, colored like the water depth image
+     */
+    QImage getHandInundationImage() const;
+
+    /**
+     * @brief Routes the rainfall excess through the depression hierarchy, without time stepping
+     * @return false if no DEM is loaded or the total time is not set
+     *
+     * Fill-Spill-Merge (see FillSpillMerge): the rainfall excess over the
+     * total time falls on every valid cell, fills the depressions it drains
+     * to, and what spills out follows the D8 network to the outlets or off
+     * the grid. The depression hierarchy is built at the first run per DEM.
+     */
+    bool runFillSpillMerge();
+
+    /**
+     * @brief Gets the ponded depth of the last Fill-Spill-Merge run at a cell (m)
+     */
+    double getPondedDepth(int i, int j) const;
+
+    /**
+     * @brief Gets the last Fill-Spill-Merge ponded depths, colored like the water depth image
+     */
+    QImage getPondedDepthImage() const;
+
+    /**
+     * @brief Gets the volume the last Fill-Spill-Merge run delivered to an outlet (m³)
+     * @param outlet Outlet index in [0, getOutletCount())
+     */
+    double getFillSpillMergeOutletVolume(int outlet) const;
+
+    /**
+     * @brief Gets the volume the last Fill-Spill-Merge run left in depressions (m³)
+     */
+    double getFillSpillMergePondedVolume() const { return pondedResult.pondedVolume; }
+
+    /**
+     * @brief Gets the volume the last Fill-Spill-Merge run sent off the grid past every outlet (m³)
+     */
+    double getFillSpillMergeOffGridVolume() const { return pondedResult.offGridVolume; }
+
+    /**
+     * @brief Starts simulations from the Fill-Spill-Merge ponded depths
+     * @param enabled True to load the last run's depths in initSimulation()
+     *
+     * Runs Fill-Spill-Merge first if there is no result for the DEM. The
+     * loaded water counts as a net source; cells outside the computational
+     * domain start dry.
+     */
+    void setFillSpillMergeWarmStart(bool enabled) { fillSpillMergeWarmStart = enabled; }
+    bool isFillSpillMergeWarmStart() const { return fillSpillMergeWarmStart; }
+
+    /**
+     * @brief Runs the start of each simulation on coarser copies of the DEM
+     * @param levels Coarse levels: 1 = 2x, 2 = 4x then 2x, 3 = 8x, 4x then 2x; 0 disables
+     * @param switchTime Time at which the full-resolution run takes over (s)
+     * @param aggregation Elevation rule of the coarse cells
+     *
+     * initSimulation() then runs [0, switchTime] on the coarse levels, coarsest
+     * first, each for an equal share of the time and with its step cap scaled
+     * by its cell size. A level hands over early once it is steady (see
+     * setSteadyStateCriteria()). The depths are prolongated level by level
+     * with their volume conserved, and the full-resolution run continues from
+     * the switch time with the coarse drainage and hydrographs as its history.
+     * Replaces the Fill-Spill-Merge warm start while enabled.
+     */
+    void setMultigridWarmStart(int levels, double switchTime,
+                               MultigridAggregation aggregation = MultigridAggregation::Min);
+    int getMultigridLevels() const { return multigridLevels; }
+
+    /**
+     * @brief Gets the time at which the last run switched to full resolution (s)
+     */
+    double getMultigridHandoverTime() const { return multigridHandoverTime; }
+
     /**
      * @brief Gets DEM preview image
      * @return DEM preview image
@@ -188,6 +677,85 @@ public:
      */
     QImage getFlowAccumulationImage() const;
 
+    /**
+     * @brief Gets the outlet a cell drains to ("what drains here")
+     * @param i Row index
+     * @param j Column index
+     * @return Outlet index, or -1 if the cell drains to no outlet
+     */
+    int getCatchmentIdAt(int i, int j) const;
+
+    /**
+     * @brief Gets the catchment area of an outlet
+     * @param outlet Outlet index in [0, getOutletCount())
+     * @return Contributing area (m²)
+     */
+    double getCatchmentArea(int outlet) const;
+
+    /**
+     * @brief Gets the cells draining to an outlet
+     * @param outlet Outlet index in [0, getOutletCount())
+     * @return Cells as (row, column), including the outlet itself
+     */
+    QVector<QPoint> getCatchmentCells(int outlet) const;
+
+    /**
+     * @brief Gets the per-cell catchment labels (row-major, -1 = no outlet)
+     */
+    const std::vector<int> &getCatchmentLabels() const { return drainageNetwork.catchmentLabels(); }
+
+    /**
+     * @brief Gets a basin map with one color per outlet catchment
+     * @return Catchment image
+     */
+    QImage getCatchmentImage() const;
+
+    /**
+     * @brief Enables streaming of water depth rasters during the run
+     * @param path Output raw frame file; an ENVI .hdr and a .times sidecar are written next to it
+     * @param everySteps Write a frame every N steps (0 disables the step trigger)
+     * @param everySeconds Write a frame every T simulated seconds (0 disables the time trigger)
+     *
+     * Frames are copied into pooled buffers and written by a background thread.
+     * The stream is opened by initSimulation() and closed when the run reaches
+     * totalTime or finishDepthOutput() is called.
+     */
+    void setDepthOutput(const QString &path, int everySteps, double everySeconds);
+
+    /**
+     * @brief Disables depth streaming and closes any open stream
+     */
+    void disableDepthOutput();
+
+    /**
+     * @brief Flushes queued frames and closes the current depth stream
+     */
+    void finishDepthOutput();
+
+    /**
+     * @brief Gets the DEM geotransform (synthesized from resolution for CSV input)
+     * @param transform Receives the 6 GDAL geotransform coefficients
+     */
+    void getGeoTransform(double transform[6]) const;
+
+    /**
+     * @brief Gets the offset of the simulated grid inside the DEM file
+     *
+     * loadDEM() crops the grid to the bounding box of valid cells; grid cell
+     * (i, j) is file cell (i + offset.x(), j + offset.y()).
+     */
+    QPoint getCropOffset() const { return QPoint(cropRowOffset, cropColOffset); }
+
+    /**
+     * @brief Gets the number of grid rows after cropping
+     */
+    int getRowCount() const { return nx; }
+
+    /**
+     * @brief Gets the number of grid columns after cropping
+     */
+    int getColumnCount() const { return ny; }
+
 signals:
     /**
      * @brief Emitted when simulation time is updated
@@ -214,19 +782,122 @@ signals:
      */
     void errorOccurred(const QString &message);
 
+    /**
+     * @brief Emitted when the steady-state criteria have held for the whole window
+     * @param time Simulation time (s)
+     * @param stopped True if the run ended there (SteadyStateAction::Stop)
+     */
+    void steadyStateReached(double time, bool stopped);
+
 private:
     // Internal simulation methods
     /**
-     * @brief Routes water through preferential flow paths
-     * 
-     * Implements:
-     * 1. Depression filling
-     * 2. Flow direction computation
-     * 3. Flow accumulation tracking
-     * 4. Multi-outlet routing
+     * @brief Ensures the drainage network and outlet catchments are current
      */
     void routeWaterToOutlets();
 
+    /**
+     * @brief Builds the D8 drainage network (filled DEM, directions, accumulation)
+     */
+    void buildDrainageNetwork();
+
+    /**
+     * @brief Copies the DEM into a flat row-major vector, NoData as -999999
+     */
+    std::vector<double> flatElevations() const;
+
+    /**
+     * @brief Rainfall rate of the schedule (or the constant rate) at a time (m/s)
+     */
+    double rainfallRateAt(double t) const;
+
+    /**
+     * @brief Time of the first schedule entry after t that changes the rate, infinity if none
+     */
+    double nextRainfallChange(double t) const;
+
+    /**
+     * @brief Updates the convergence metrics and the steady-state window after a step
+     * @param sourced Volume added by rainfall and infiltration this step (m³)
+     * @param previousStored Stored volume before the step (m³)
+     * @param drained Volume drained by the outlets this step (m³)
+     * @param maxDepthChange Largest depth change of a cell this step (m)
+     */
+    void updateSteadyState(double sourced, double previousStored, double drained, double maxDepthChange);
+
+    /**
+     * @brief Mean rainfall excess max(0, rain - Ks) per interval (m/s)
+     * @param interval Interval length (s)
+     * @param count Number of intervals from t = 0
+     */
+    std::vector<double> rainfallExcessSeries(double interval, int count) const;
+
+    /**
+     * @brief Builds the HAND raster for the current channel area if needed
+     * @return false if there is no drainage network
+     */
+    bool ensureHandModel();
+
+    /**
+     * @brief Loads the Fill-Spill-Merge ponded depths into the kernel after initialization
+     */
+    void applyFillSpillMergeWarmStart();
+
+    /**
+     * @brief Loads initial depths into the kernel and counts them as a net source
+     * @param depth Row-major depths (m); cells outside the domain stay dry
+     * @return Loaded volume (m³)
+     */
+    double loadInitialDepths(const std::vector<float> &depth);
+
+    /**
+     * @brief Runs the coarse levels and loads their prolongated depths after initialization
+     */
+    void applyMultigridWarmStart();
+
+    /**
+     * @brief Copies the run parameters into the engine of a coarse level
+     *
+     * Coarse engines are internal: they have no signal receivers, so their
+     * steps render no depth image, and their per-step log is turned off.
+     */
+    void configureCoarseLevel(SimulationEngine &level, int factor) const;
+
+    /**
+     * @brief Appends the drainage and hydrographs of a coarse level after a time
+     */
+    void appendCoarseHistory(const SimulationEngine &level, int factor, double start);
+
+    /**
+     * @brief Crops, resets and analyses a freshly loaded dem
+     */
+    bool prepareLoadedDEM();
+
+    /**
+     * @brief Renders a depth field with the water depth colors, grid and rulers
+     */
+    QImage renderDepthImage(const std::function<void(int, float *)> &copyRow, double maxDepth) const;
+
+    /**
+     * @brief Builds the domain mask and the row spans iterated by stepSimulation()
+     */
+    void buildComputationalDomain();
+
+    /**
+     * @brief Crops dem to the bounding box of valid cells after loading
+     */
+    void cropToValidData();
+
+    /**
+     * @brief Run-length encodes domainMask into domainSpans
+     */
+    void buildDomainSpans();
+
+    /**
+     * @brief Creates the flow kernel for the selected precision with zero depths
+     */
+    void resetKernel();
+
     /**
      * @brief Computes outlet cells based on percentile
      * @param percentile Percentile for outlet selection
@@ -238,6 +909,29 @@ private:
      */
     void computeDefaultAutomaticOutletCells();
 
+    /**
+     * @brief Rebuilds outletIdGrid from outletCells and drops duplicate outlets
+     */
+    void rebuildOutletIndex();
+
+    /**
+     * @brief Copies the current depth grid into the output stream if a trigger fired
+     * @param force Write regardless of the step/time triggers
+     */
+    void writeDepthFrame(bool force);
+
+    /**
+     * @brief Appends the mean discharge of every outlet since the last sample
+     */
+    void recordOutletHydrographs();
+
+    /**
+     * @brief Lets a single outlet edit go ahead
+     * @return false while an initialized run is in progress; otherwise drops
+     *         the per-outlet results of the last run
+     */
+    bool releaseOutletArrays();
+
     // Member variables with detailed documentation
     double n_manning;      ///< Manning's roughness coefficient
     double Ks;            ///< Infiltration rate (m/s)
@@ -247,35 +941,105 @@ private:
     double totalTime;     ///< Total simulation duration (s)
     double dt;            ///< Current time step (s)
     double drainageVolume; ///< Total drainage volume (m³)
+    ReproducibleSum drainageSum; ///< Order-independent accumulator behind drainageVolume
+    ReproducibleSum sourceSum;   ///< Net rainfall minus infiltration added to the grid (m³)
     
     // Grid properties
     int nx, ny;           ///< Grid dimensions
     double resolution;    ///< Cell size (m)
+    double geoTransform[6]; ///< GDAL geotransform of the loaded DEM
+    bool hasGeoTransform;   ///< True if geoTransform came from the DEM file
+    QString projectionWkt;  ///< DEM projection (WKT), empty for CSV input
+    int cropRowOffset;      ///< First file row kept by cropToValidData()
+    int cropColOffset;      ///< First file column kept by cropToValidData()
     
     // Simulation grids
-    std::vector<std::vector<double>> dem; ///< Ground elevation grid (m)
-    std::vector<std::vector<double>> h;   ///< Water depth grid (m)
-    std::vector<std::vector<double>> flowAccumulationGrid; ///< Flow accumulation grid
+    ElevationGrid dem;                    ///< Ground elevation grid (m), NoData halo
+    ElevationStorage elevationStorage;    ///< Storage requested for the next loadDEM()
+    double elevationPrecision;            ///< Quantum of integer elevation storage (m)
+    KernelPrecision kernelPrecision;      ///< Storage type of the flow kernel
+    KernelLayout kernelLayout;            ///< Memory layout of the flow kernel
+    int kernelTileSize;                   ///< Tile side of the tiled layout (cells)
+    int kernelThreads;                    ///< Worker threads of the threaded kernels, 0 = one per core
+    QString flowSolverName;               ///< Registered name of the flow kernel's solver
+    double maxTimeStep;                   ///< Upper bound of dt (s)
+    SteadyStateAction steadyAction;       ///< Reaction to steady state
+    double steadyCoarseFactor;            ///< Step cap multiplier once steady (CoarseSteps)
+    double coarseScale;                   ///< Current multiplier, halved while coarse steps do not settle
+    double coarseUntil;                   ///< End of the coarse steps (next rainfall change), -1 if off
+    double coarseSettled;                 ///< Last coarse step that met the criteria or changed the scale (s)
+    double steadyWindow;                  ///< Time the criteria must hold (s)
+    double steadyDepthRate;               ///< Largest |dh/dt| at steady state (m/s)
+    double steadyBalance;                 ///< Largest |dS/dt| / max(inflow, outflow) at steady state
+    SteadyStateMetrics steadyMetrics;     ///< Metrics of the last step
+    double steadySince;                   ///< Start of the current run of steady steps (s), -1 if none
+    bool steadyReached;                   ///< Criteria held for the whole window
+    bool stoppedAtSteadyState;            ///< Run ended early by SteadyStateAction::Stop
+    std::unique_ptr<FlowKernel> kernel;   ///< Owns the water depth grid and flux scratch
+    DrainageNetwork drainageNetwork;      ///< D8 directions, accumulation and catchments
+    TimeAreaModel timeAreaModel;          ///< Travel times of the surrogate hydrographs
+    HandModel handModel;                  ///< HAND raster of the rapid inundation maps
+    double handChannelArea;               ///< Upstream area starting a HAND channel (m²)
+    std::vector<float> handDepth;         ///< Last HAND inundation map (m), row-major
+    double handMaxDepth;                  ///< Deepest water of handDepth (m)
+    FillSpillMerge depressionStorage;     ///< Depression hierarchy of the DEM
+    FillSpillMergeResult pondedResult;    ///< Last Fill-Spill-Merge run
+    bool fillSpillMergeWarmStart;         ///< Load pondedResult in initSimulation()
+    MultigridHierarchy multigrid;         ///< Coarse levels of the DEM
+    int multigridLevels;                  ///< Coarse levels run by initSimulation(), 0 = off
+    double multigridSwitchTime;           ///< End of the coarse part of the run (s)
+    MultigridAggregation multigridAggregation; ///< Elevation rule of the coarse levels
+    double multigridHandoverTime;         ///< Time the last run switched to full resolution (s)
+
+    // Computational domain
+    bool contributingAreaOnly;         ///< Step only the outlet catchments
+    int contributingHalo;              ///< Halo width around the catchments (cells)
+    PaddedGrid<uint8_t> domainMask;    ///< DomainRole per cell, inactive halo
+    std::vector<CellSpan> domainSpans; ///< Row-major spans covering the domain
+    std::vector<int> domainRowSpans;   ///< First span of each row, nx+1 entries
+    bool faceCoefficientsDirty;        ///< DEM, domain, resolution or n changed since the kernel cache
+
+    // Water statistics of the last step, gathered by the update sweep
+    double storedWaterVolume;          ///< Water stored on the grid (m³)
+    qint64 wetCellCount;               ///< Cells deeper than min_depth
+    double maxWaterDepth;              ///< Deepest water on the grid (m)
+    int activeTileCount;               ///< Tiles stepped by the tiled kernel
     
     // Outlet management
     bool useManualOutlets;             ///< Manual outlet selection flag
     double outletPercentile;           ///< Percentile for auto-outlets
     int outletRow;                     ///< Outlet row index
     std::vector<int> outletCells;      ///< Outlet cell indices
+    std::vector<int> outletIdGrid;     ///< Per-cell outlet index (-1 = not an outlet), nx*ny
+    std::vector<double> outletWidths;  ///< Drainage width per outlet (m) of a coarse level, empty = one cell
     QVector<QPoint> manualOutletCells; ///< Manual outlet cell coordinates
+    bool runInitialized;               ///< initSimulation() fixed the outlet spans and per-outlet arrays
+    bool verboseLogging;               ///< Per-step progress and outlet drainage log
     
     // Rainfall configuration
     bool useTimeVaryingRainfall;       ///< Time-varying rainfall flag
     QVector<QPair<double, double>> rainfallSchedule; ///< Rainfall schedule
     
     // Drainage tracking
-    QVector<QPair<double, double>> drainageTimeSeries; ///< Drainage time series
-    QMap<QPoint, double> perOutletDrainage; ///< Per-outlet drainage volumes
+    TimeSeriesStore drainageSeries;    ///< Cumulative drainage per step (bounded memory)
+    std::vector<double> outletDrainage;  ///< Cumulative volume per outlet (parallel to outletCells)
+    std::vector<double> outletIntervalVolume; ///< Volume per outlet since the last hydrograph sample
+    TimeSeriesStore outletHydrographs; ///< Discharge per outlet, one channel per outlet
+    double hydrographInterval;         ///< Hydrograph sampling interval (s), 0 = every step
+    double lastHydrographTime;         ///< Time of the previous hydrograph sample (s)
     
     // Visualization state
     bool showGrid;                     ///< Grid overlay flag
     bool showRulers;                   ///< Ruler overlay flag
     int gridInterval;                  ///< Grid line spacing
+
+    // Depth raster output
+    DepthFrameWriter *depthWriter;     ///< Background frame writer (owned)
+    QString depthOutputPath;           ///< Raw frame file, empty when disabled
+    int depthOutputEverySteps;         ///< Step trigger (0 = off)
+    double depthOutputEverySeconds;    ///< Simulated-time trigger (0 = off)
+    double nextDepthOutputTime;        ///< Next simulated time to snapshot (s)
+    qint64 stepCount;                  ///< Steps taken since initSimulation()
 };
 
 #endif // SIMULATIONENGINE_H
@@ -0,0 +1,129 @@
+/**
+ * @class TileScheduler
+ * @brief Per-worker task deques with work stealing for the tiled kernel passes
+ */
+
+#include "TileScheduler.h"
+#include <QMutexLocker>
+#include <algorithm>
+
+TileScheduler::TileScheduler(int threads)
+    : pass(0),
+    busyWorkers(0),
+    stopping(false),
+    body(nullptr)
+{
+    if (threads <= 0)
+        threads = QThread::idealThreadCount();
+    threads = std::max(1, threads);
+
+    for (int w = 0; w < threads; w++)
+        queues.push_back(std::unique_ptr<TaskQueue>(new TaskQueue()));
+    for (int w = 1; w < threads; w++) {
+        workers.push_back(std::unique_ptr<Worker>(new Worker(this, w)));
+        workers.back()->start();
+    }
+}
+
+TileScheduler::~TileScheduler()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        passStarted.wakeAll();
+    }
+    for (std::unique_ptr<Worker> &worker : workers)
+        worker->wait();
+}
+
+void TileScheduler::run(const std::vector<int> &tasks, const std::function<void(int)> &taskBody)
+{
+    if (tasks.empty())
+        return;
+    if (workers.empty() || tasks.size() == 1) {
+        for (int task : tasks)
+            taskBody(task);
+        return;
+    }
+
+    // Contiguous chunks keep neighbouring tiles (shared halos) on one worker
+    const size_t chunk = (tasks.size() + queues.size() - 1) / queues.size();
+    for (size_t w = 0; w < queues.size(); w++) {
+        size_t begin = std::min(tasks.size(), w * chunk);
+        size_t end = std::min(tasks.size(), begin + chunk);
+        QMutexLocker locker(&queues[w]->mutex);
+        queues[w]->tasks.assign(tasks.begin() + begin, tasks.begin() + end);
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        body = &taskBody;
+        busyWorkers = int(workers.size());
+        pass++;
+        passStarted.wakeAll();
+    }
+
+    work(0);
+
+    QMutexLocker locker(&mutex);
+    while (busyWorkers > 0)
+        passFinished.wait(&mutex);
+    body = nullptr;
+}
+
+void TileScheduler::workerLoop(int index)
+{
+    quint64 seenPass = 0;
+    for (;;) {
+        {
+            QMutexLocker locker(&mutex);
+            while (pass == seenPass && !stopping)
+                passStarted.wait(&mutex);
+            if (stopping)
+                return;
+            seenPass = pass;
+        }
+
+        work(index);
+
+        QMutexLocker locker(&mutex);
+        if (--busyWorkers == 0)
+            passFinished.wakeAll();
+    }
+}
+
+/**
+ * Tasks never spawn tasks, so a worker that finds every deque empty is done
+ * with the pass.
+ */
+void TileScheduler::work(int index)
+{
+    int task;
+    while (take(index, task))
+        (*body)(task);
+}
+
+bool TileScheduler::take(int index, int &task)
+{
+    {
+        TaskQueue &own = *queues[index];
+        QMutexLocker locker(&own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    const int count = int(queues.size());
+    for (int k = 1; k < count; k++) {
+        TaskQueue &victim = *queues[(index + k) % count];
+        QMutexLocker locker(&victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,81 @@
+#ifndef TILESCHEDULER_H
+#define TILESCHEDULER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Work-stealing pool that runs one pass of tile tasks to completion
+ *
+ * run() deals the task list out in contiguous chunks, one per worker deque,
+ * so neighbouring tiles start on the same core. Each worker pops tasks from
+ * the front of its own deque; a worker whose deque is empty steals from the
+ * back of the others' deques, so cores stay busy when the work is
+ * concentrated in a few chunks (e.g. a flood along one channel).
+ *
+ * The calling thread is worker 0; threadCount() - 1 QThreads are started
+ * once and sleep between passes. Tasks are whole tiles (thousands of cells),
+ * so each deque is guarded by a plain mutex.
+ */
+class TileScheduler
+{
+public:
+    /**
+     * @param threads Worker threads including the caller, 0 = QThread::idealThreadCount()
+     */
+    explicit TileScheduler(int threads = 0);
+    ~TileScheduler();
+
+    TileScheduler(const TileScheduler &) = delete;
+    TileScheduler &operator=(const TileScheduler &) = delete;
+
+    int threadCount() const { return int(queues.size()); }
+
+    /**
+     * @brief Runs body(task) for every task and returns when all are done
+     * @param tasks Task IDs (tile slots)
+     * @param body Work function, called concurrently for different tasks
+     */
+    void run(const std::vector<int> &tasks, const std::function<void(int)> &body);
+
+private:
+    class Worker : public QThread
+    {
+    public:
+        Worker(TileScheduler *scheduler, int index) : scheduler(scheduler), index(index) {}
+
+    protected:
+        void run() override { scheduler->workerLoop(index); }
+
+    private:
+        TileScheduler *scheduler;
+        int index;
+    };
+
+    struct TaskQueue {
+        QMutex mutex;
+        std::deque<int> tasks;
+    };
+
+    void workerLoop(int index);
+    void work(int index);
+    bool take(int index, int &task);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;   ///< One deque per worker
+    std::vector<std::unique_ptr<Worker>> workers;     ///< Workers 1..threadCount()-1
+
+    QMutex mutex;
+    QWaitCondition passStarted;
+    QWaitCondition passFinished;
+    quint64 pass;                                     ///< Number of passes started
+    int busyWorkers;                                  ///< Pool threads still in the current pass
+    bool stopping;
+    const std::function<void(int)> *body;             ///< Work function of the current pass
+};
+
+#endif // TILESCHEDULER_H
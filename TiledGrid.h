@@ -0,0 +1,187 @@
+#ifndef TILEDGRID_H
+#define TILEDGRID_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Sparse grid of square tiles, each stored contiguously with a halo
+ * @tparam T Cell value type
+ *
+ * The rows x cols grid is cut into tileSize x tileSize tiles. Only tiles
+ * flagged present are allocated; each holds (tileSize+2)² cells, the interior
+ * plus a one-cell halo, so a 4-neighbour stencil on a tile reads only that
+ * tile's block and neighbours are at flat offsets ±1 and ±pitch(). Halos are
+ * copies of the adjacent tiles' edge cells, refreshed by exchangeHalo(); halo
+ * cells of absent or off-grid neighbours hold the fill value.
+ *
+ * Cells of edge tiles past the grid border are padding: allocated but never
+ * addressed by the caller's cell lists.
+ */
+template <typename T>
+class TiledGrid
+{
+public:
+    TiledGrid() : nRows(0), nCols(0), size(0), nTileRows(0), nTileCols(0), fillValue() {}
+
+    /**
+     * @brief Sets the grid geometry and drops all tiles
+     */
+    void configure(int rows, int cols, int tileSize)
+    {
+        nRows = rows;
+        nCols = cols;
+        size = std::max(1, tileSize);
+        nTileRows = (rows + size - 1) / size;
+        nTileCols = (cols + size - 1) / size;
+        slotOfTile.assign(size_t(nTileRows) * nTileCols, -1);
+        tileOfSlot.clear();
+        cells.clear();
+    }
+
+    /**
+     * @brief Allocates the flagged tiles, keeping the cells of tiles present before
+     * @param present One flag per tile, row-major over tileRows() x tileCols()
+     * @param fill Value of new tiles and of halos facing absent tiles
+     */
+    void setTiles(const std::vector<uint8_t> &present, const T &fill)
+    {
+        std::vector<int> newSlotOfTile(slotOfTile.size(), -1);
+        std::vector<int> newTileOfSlot;
+        for (size_t t = 0; t < present.size() && t < slotOfTile.size(); t++) {
+            if (!present[t]) continue;
+            newSlotOfTile[t] = int(newTileOfSlot.size());
+            newTileOfSlot.push_back(int(t));
+        }
+
+        const size_t block = tileCells();
+        std::vector<T> newCells(newTileOfSlot.size() * block, fill);
+        for (size_t s = 0; s < newTileOfSlot.size(); s++) {
+            int old = slotOfTile[newTileOfSlot[s]];
+            if (old >= 0)
+                std::copy(cells.begin() + old * block, cells.begin() + (old + 1) * block, newCells.begin() + s * block);
+        }
+
+        slotOfTile.swap(newSlotOfTile);
+        tileOfSlot.swap(newTileOfSlot);
+        cells.swap(newCells);
+        fillValue = fill;
+    }
+
+    /**
+     * @brief Sets every cell of every present tile, halos included
+     */
+    void fill(const T &value)
+    {
+        std::fill(cells.begin(), cells.end(), value);
+    }
+
+    int rows() const { return nRows; }
+    int cols() const { return nCols; }
+    int tileSize() const { return size; }
+    int tileRows() const { return nTileRows; }
+    int tileCols() const { return nTileCols; }
+    int tileCount() const { return int(tileOfSlot.size()); }
+
+    /// Flat distance between vertically adjacent cells of a tile block
+    ptrdiff_t pitch() const { return ptrdiff_t(size) + 2; }
+
+    /// Cells per tile block, halo included
+    size_t tileCells() const { return size_t(size + 2) * size_t(size + 2); }
+
+    /// Slot of tile (ti, tj), or -1 if the tile is absent
+    int slot(int ti, int tj) const { return slotOfTile[size_t(ti) * nTileCols + tj]; }
+
+    int tileRow(int slot) const { return tileOfSlot[slot] / nTileCols; }
+    int tileCol(int slot) const { return tileOfSlot[slot] % nTileCols; }
+
+    /// Slot of the tile (di, dj) tiles away from a slot, or -1 if absent or off the grid
+    int neighbourSlot(int slot, int di, int dj) const
+    {
+        int ti = tileRow(slot) + di;
+        int tj = tileCol(slot) + dj;
+        if (ti < 0 || ti >= nTileRows || tj < 0 || tj >= nTileCols)
+            return -1;
+        return this->slot(ti, tj);
+    }
+
+    /// First cell of a tile block (its upper-left halo cell)
+    T *tile(int slot) { return cells.data() + size_t(slot) * tileCells(); }
+    const T *tile(int slot) const { return cells.data() + size_t(slot) * tileCells(); }
+
+    /// Index in a tile block of local interior cell (li, lj); -1 and size address the halo
+    size_t localIndex(int li, int lj) const { return size_t(li + 1) * (size + 2) + size_t(lj + 1); }
+
+    /**
+     * @brief Pointer to grid cell (i, j), or nullptr if its tile is absent
+     */
+    T *cell(int i, int j)
+    {
+        int s = slot(i / size, j / size);
+        return s < 0 ? nullptr : tile(s) + localIndex(i % size, j % size);
+    }
+
+    /**
+     * @brief Value of grid cell (i, j), the fill value if its tile is absent
+     */
+    T value(int i, int j) const
+    {
+        int s = slot(i / size, j / size);
+        return s < 0 ? fillValue : tile(s)[localIndex(i % size, j % size)];
+    }
+
+    /**
+     * @brief Copies the edge cells of the four adjacent tiles into a tile's halo
+     *
+     * Only the halo cells read by a 4-neighbour stencil are written; corners
+     * are left alone. Reads other tiles' interiors and writes only this
+     * tile's halo, so tiles can be refreshed concurrently.
+     */
+    void exchangeHalo(int slot)
+    {
+        T *block = tile(slot);
+        const int last = size - 1;
+
+        const T *north = neighbour(slot, -1, 0);
+        const T *south = neighbour(slot, 1, 0);
+        for (int l = 0; l < size; l++) {
+            block[localIndex(-1, l)] = north ? north[localIndex(last, l)] : fillValue;
+            block[localIndex(size, l)] = south ? south[localIndex(0, l)] : fillValue;
+        }
+        const T *west = neighbour(slot, 0, -1);
+        const T *east = neighbour(slot, 0, 1);
+        for (int l = 0; l < size; l++) {
+            block[localIndex(l, -1)] = west ? west[localIndex(l, last)] : fillValue;
+            block[localIndex(l, size)] = east ? east[localIndex(l, 0)] : fillValue;
+        }
+    }
+
+    void clear()
+    {
+        nRows = nCols = nTileRows = nTileCols = 0;
+        slotOfTile.clear();
+        tileOfSlot.clear();
+        cells.clear();
+    }
+
+private:
+    const T *neighbour(int slot, int di, int dj) const
+    {
+        int s = neighbourSlot(slot, di, dj);
+        return s < 0 ? nullptr : tile(s);
+    }
+
+    int nRows;
+    int nCols;
+    int size;                       ///< Interior cells per tile side
+    int nTileRows;
+    int nTileCols;
+    T fillValue;
+    std::vector<int> slotOfTile;    ///< Slot per tile, -1 = absent
+    std::vector<int> tileOfSlot;    ///< Row-major tile number per slot
+    std::vector<T> cells;           ///< Tile blocks, one per slot
+};
+
+#endif // TILEDGRID_H
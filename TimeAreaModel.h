@@ -0,0 +1,89 @@
+#ifndef TIMEAREAMODEL_H
+#define TIMEAREAMODEL_H
+
+#include <vector>
+
+class DrainageNetwork;
+
+/**
+ * @brief Travel-time (time-area) surrogate of the outlet hydrographs
+ *
+ * Every cell gets the time water needs to run along its D8 flow path, cell
+ * by cell at the steady kinematic Manning velocity for a reference rainfall
+ * excess. Cells with more upstream area carry more water and flow faster.
+ * Times are measured to the point where the path leaves the grid, so they
+ * do not depend on the outlets: a cell draining to outlet o reaches it after
+ * exitTime(cell) - exitTime(o).
+ *
+ * The hydrograph of an outlet is then the convolution of the rainfall excess
+ * with the outlet's time-area histogram (catchment area per travel-time
+ * bin). Building the travel times is one pass over the network per DEM,
+ * resolution, Manning's n and reference excess; a hydrograph costs one pass
+ * over the catchment plus the convolution, so it can follow outlet clicks.
+ *
+ * Storage, infiltration after ponding and backwater are ignored: the
+ * surrogate ranks outlet placements, the flow solvers give the volumes.
+ */
+class TimeAreaModel
+{
+public:
+    static constexpr double MIN_SLOPE = 1.0e-4;     ///< Slope floor on filled flats, as the kinematic solver
+
+    TimeAreaModel();
+
+    /**
+     * @brief Computes the travel time of every cell to the grid exit
+     * @param network Built D8 network of the DEM
+     * @param resolution Cell size (m)
+     * @param manningN Manning's roughness coefficient
+     * @param referenceExcess Rainfall excess setting the flow depths (m/s), > 0
+     */
+    void build(const DrainageNetwork &network, double resolution, double manningN, double referenceExcess);
+
+    /**
+     * @brief Drops the travel times, e.g. when the DEM changes
+     */
+    void clear();
+
+    bool isBuilt() const { return built; }
+
+    /**
+     * @brief Tests whether the travel times were built for these parameters
+     */
+    bool isBuiltFor(double resolution, double manningN, double referenceExcess) const;
+
+    /**
+     * @brief Travel time from a cell to where its flow path leaves the grid (s)
+     */
+    double exitTime(int index) const { return travelTime[index]; }
+
+    /**
+     * @brief Catchment area per travel-time bin of one outlet
+     * @param network Network with labeled catchments
+     * @param catchment Catchment (outlet) ID
+     * @param binWidth Bin width (s)
+     * @return Area (m²) per bin; bin b collects travel times in [b, b+1) * binWidth
+     *
+     * Each cell is split linearly between the two bins around its travel
+     * time, so the hydrograph does not jump with the bin width.
+     */
+    std::vector<double> histogram(const DrainageNetwork &network, int catchment, double binWidth) const;
+
+    /**
+     * @brief Discharge from convolving rainfall excess with a time-area histogram
+     * @param histogram Area per bin (m²)
+     * @param excess Mean rainfall excess per interval of the bin width (m/s)
+     * @return Mean discharge per interval (m³/s), as many intervals as excess
+     */
+    static std::vector<double> convolve(const std::vector<double> &histogram, const std::vector<double> &excess);
+
+private:
+    bool built;
+    double builtResolution;
+    double builtManningN;
+    double builtExcess;
+    double cellArea;                  ///< m²
+    std::vector<double> travelTime;   ///< Seconds to the grid exit per cell
+};
+
+#endif // TIMEAREAMODEL_H
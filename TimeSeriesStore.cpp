@@ -0,0 +1,255 @@
+/**
+ * @class TimeSeriesStore
+ * @brief Ring buffer + append-only spill file for long time series
+ *
+ * Layout of a record (in memory and on disk): time followed by one double per
+ * channel. Samples [0, spilledCount) are in the spill file in append order,
+ * samples [spilledCount, count) are in the ring starting at ringHead.
+ */
+
+#include "TimeSeriesStore.h"
+#include <QDebug>
+#include <QDir>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+TimeSeriesStore::TimeSeriesStore(int channels, int ringCapacity)
+    : channels(std::max(1, channels)),
+    ringCapacity(std::max(2, ringCapacity)),
+    ringHead(0),
+    spilledCount(0),
+    count(0),
+    spillFile(QDir::tempPath() + "/btp_timeseries_XXXXXX.bin"),
+    spillOpen(false)
+{
+    ring.assign(size_t(this->ringCapacity) * recordSize(), 0.0);
+}
+
+void TimeSeriesStore::reset(int channelCount)
+{
+    channels = std::max(1, channelCount);
+    ring.assign(size_t(ringCapacity) * recordSize(), 0.0);
+    clear();
+}
+
+void TimeSeriesStore::clear()
+{
+    ringHead = 0;
+    spilledCount = 0;
+    count = 0;
+    blocks.clear();
+    if (spillOpen)
+        spillFile.resize(0);
+}
+
+void TimeSeriesStore::append(double time, const double *values)
+{
+    // Keep the newest half in memory when the ring is full
+    if (count - spilledCount == ringCapacity)
+        spillOldest(ringCapacity / 2);
+
+    qint64 slot = (ringHead + (count - spilledCount)) % ringCapacity;
+    double *record = &ring[size_t(slot) * recordSize()];
+    record[0] = time;
+    for (int c = 0; c < channels; ++c)
+        record[c + 1] = values[c];
+
+    // Extend the per-block extrema used by decimated()
+    qint64 block = count / BLOCK_SIZE;
+    if (size_t(block) * channels >= blocks.size()) {
+        for (int c = 0; c < channels; ++c)
+            blocks.push_back({time, values[c], time, values[c]});
+    } else {
+        for (int c = 0; c < channels; ++c) {
+            BlockExtrema &e = blocks[size_t(block) * channels + c];
+            if (values[c] < e.minValue) { e.minValue = values[c]; e.minTime = time; }
+            if (values[c] > e.maxValue) { e.maxValue = values[c]; e.maxTime = time; }
+        }
+    }
+    count++;
+}
+
+const double *TimeSeriesStore::ringRecord(qint64 index) const
+{
+    qint64 slot = (ringHead + (index - spilledCount)) % ringCapacity;
+    return &ring[size_t(slot) * recordSize()];
+}
+
+/**
+ * @brief Appends the n oldest in-memory samples to the spill file
+ *
+ * The ring region may wrap around, so this takes at most two writes.
+ */
+void TimeSeriesStore::spillOldest(qint64 n)
+{
+    if (!spillOpen) {
+        spillOpen = spillFile.open();
+        if (!spillOpen) {
+            qDebug() << "TimeSeriesStore: cannot open spill file, older samples will be lost";
+        }
+    }
+
+    const qint64 recordBytes = qint64(recordSize()) * qint64(sizeof(double));
+    if (spillOpen) {
+        spillFile.seek(spilledCount * recordBytes);
+        qint64 firstRun = std::min(n, ringCapacity - ringHead);
+        spillFile.write(reinterpret_cast<const char *>(&ring[size_t(ringHead) * recordSize()]),
+                        firstRun * recordBytes);
+        if (n > firstRun) {
+            spillFile.write(reinterpret_cast<const char *>(ring.data()), (n - firstRun) * recordBytes);
+        }
+    }
+
+    ringHead = (ringHead + n) % ringCapacity;
+    spilledCount += n;
+}
+
+bool TimeSeriesStore::readSpilled(qint64 first, qint64 n, std::vector<double> &records) const
+{
+    const qint64 recordBytes = qint64(recordSize()) * qint64(sizeof(double));
+    records.resize(size_t(n) * recordSize());
+    if (!spillOpen || !spillFile.seek(first * recordBytes))
+        return false;
+    return spillFile.read(reinterpret_cast<char *>(records.data()), n * recordBytes) == n * recordBytes;
+}
+
+/**
+ * @brief Visits (time, value) of one channel for samples [first, last)
+ *
+ * Spilled samples are streamed from disk in fixed-size chunks so memory use
+ * stays bounded even for full-history reads.
+ */
+template <typename Visitor>
+void TimeSeriesStore::forEachSample(qint64 first, qint64 last, int channel, Visitor visit) const
+{
+    const qint64 CHUNK = 4096;
+    std::vector<double> records;
+    qint64 index = first;
+
+    while (index < last && index < spilledCount) {
+        qint64 n = std::min({CHUNK, last - index, spilledCount - index});
+        if (!readSpilled(index, n, records)) {
+            // Spill file unavailable: report the gap as NaN so callers can skip it
+            for (qint64 k = 0; k < n; ++k)
+                visit(std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::quiet_NaN());
+        } else {
+            for (qint64 k = 0; k < n; ++k) {
+                const double *record = &records[size_t(k) * recordSize()];
+                visit(record[0], record[channel + 1]);
+            }
+        }
+        index += n;
+    }
+
+    for (; index < last; ++index) {
+        const double *record = ringRecord(index);
+        visit(record[0], record[channel + 1]);
+    }
+}
+
+double TimeSeriesStore::valueAt(qint64 index, int channel, double *time) const
+{
+    if (index < 0 || index >= count || channel < 0 || channel >= channels)
+        return 0.0;
+
+    if (index >= spilledCount) {
+        const double *record = ringRecord(index);
+        if (time) *time = record[0];
+        return record[channel + 1];
+    }
+
+    std::vector<double> record;
+    if (!readSpilled(index, 1, record))
+        return 0.0;
+    if (time) *time = record[0];
+    return record[channel + 1];
+}
+
+double TimeSeriesStore::lastValue(int channel) const
+{
+    if (count == 0 || channel < 0 || channel >= channels)
+        return 0.0;
+    return ringRecord(count - 1)[channel + 1];
+}
+
+QVector<QPair<double, double>> TimeSeriesStore::samplesSince(qint64 first, int channel) const
+{
+    QVector<QPair<double, double>> result;
+    first = std::max<qint64>(0, first);
+    if (first >= count || channel < 0 || channel >= channels)
+        return result;
+
+    result.reserve(int(count - first));
+    forEachSample(first, count, channel, [&result](double t, double v) {
+        result.append(qMakePair(t, v));
+    });
+    return result;
+}
+
+/**
+ * @brief Builds a min/max decimated view of a channel
+ *
+ * The history is split into maxPoints/2 buckets. Buckets spanning whole
+ * summary blocks are answered from the in-memory block extrema; only short
+ * series (bucket smaller than a block) are read sample by sample.
+ */
+QVector<QPair<double, double>> TimeSeriesStore::decimated(int maxPoints, int channel) const
+{
+    if (channel < 0 || channel >= channels)
+        return QVector<QPair<double, double>>();
+    if (maxPoints <= 0 || count <= maxPoints)
+        return samplesSince(0, channel);
+
+    const qint64 buckets = std::max(1, maxPoints / 2);
+    qint64 bucketSize = (count + buckets - 1) / buckets;
+
+    QVector<QPair<double, double>> result;
+    result.reserve(int(2 * buckets));
+
+    auto emitBucket = [&result](const BlockExtrema &e) {
+        if (std::isnan(e.minTime))
+            return;
+        if (e.minTime < e.maxTime) {
+            result.append(qMakePair(e.minTime, e.minValue));
+            result.append(qMakePair(e.maxTime, e.maxValue));
+        } else if (e.maxTime < e.minTime) {
+            result.append(qMakePair(e.maxTime, e.maxValue));
+            result.append(qMakePair(e.minTime, e.minValue));
+        } else {
+            result.append(qMakePair(e.minTime, e.minValue));
+        }
+    };
+
+    if (bucketSize >= BLOCK_SIZE) {
+        // Align buckets to summary blocks and merge their extrema
+        const qint64 blocksPerBucket = (bucketSize + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        const qint64 blockCount = qint64(blocks.size()) / channels;
+        for (qint64 b0 = 0; b0 < blockCount; b0 += blocksPerBucket) {
+            BlockExtrema merged = blocks[size_t(b0) * channels + channel];
+            for (qint64 b = b0 + 1; b < std::min(blockCount, b0 + blocksPerBucket); ++b) {
+                const BlockExtrema &e = blocks[size_t(b) * channels + channel];
+                if (e.minValue < merged.minValue) { merged.minValue = e.minValue; merged.minTime = e.minTime; }
+                if (e.maxValue > merged.maxValue) { merged.maxValue = e.maxValue; merged.maxTime = e.maxTime; }
+            }
+            emitBucket(merged);
+        }
+        return result;
+    }
+
+    qint64 index = 0;
+    BlockExtrema current = {0.0, 0.0, 0.0, 0.0};
+    forEachSample(0, count, channel, [&](double t, double v) {
+        if (index % bucketSize == 0) {
+            if (index > 0)
+                emitBucket(current);
+            current = {t, v, t, v};
+        } else if (!std::isnan(v)) {
+            if (v < current.minValue) { current.minValue = v; current.minTime = t; }
+            if (v > current.maxValue) { current.maxValue = v; current.maxTime = t; }
+        }
+        index++;
+    });
+    emitBucket(current);
+    return result;
+}
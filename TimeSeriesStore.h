@@ -0,0 +1,125 @@
+#ifndef TIMESERIESSTORE_H
+#define TIMESERIESSTORE_H
+
+#include <QString>
+#include <QVector>
+#include <QPair>
+#include <QTemporaryFile>
+#include <vector>
+
+/**
+ * @brief Bounded-memory store for long simulation time series
+ *
+ * Each sample holds a time stamp and a fixed number of channel values (one
+ * channel for the total drainage, one per outlet for hydrographs). Memory use
+ * is bounded regardless of run length:
+ * - The most recent samples live in an in-memory ring buffer
+ * - When the ring fills up, its older half is appended to a spill file
+ * - Per-block min/max summaries stay in memory so plots of the whole history
+ *   can be decimated without re-reading the spilled samples
+ *
+ * Sample indices are stable (0 = first sample appended after clear()), so a
+ * consumer can poll samplesSince(k) and pay only for the new samples.
+ */
+class TimeSeriesStore
+{
+public:
+    /**
+     * @param channels Number of values stored per sample
+     * @param ringCapacity Number of samples kept in memory
+     */
+    explicit TimeSeriesStore(int channels = 1, int ringCapacity = 8192);
+
+    TimeSeriesStore(const TimeSeriesStore &) = delete;
+    TimeSeriesStore &operator=(const TimeSeriesStore &) = delete;
+
+    /**
+     * @brief Drops all samples and changes the channel count
+     * @param channels Number of values stored per sample
+     */
+    void reset(int channels);
+
+    /**
+     * @brief Drops all samples, keeping the channel count
+     */
+    void clear();
+
+    /**
+     * @brief Appends a sample
+     * @param time Sample time (s)
+     * @param values Pointer to channelCount() values
+     */
+    void append(double time, const double *values);
+
+    /**
+     * @brief Appends a single-channel sample
+     */
+    void append(double time, double value) { append(time, &value); }
+
+    qint64 size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    int channelCount() const { return channels; }
+
+    /**
+     * @brief Reads one sample
+     * @param index Sample index in [0, size())
+     * @param time Receives the sample time
+     * @param channel Channel to read
+     * @return Channel value (0 if index is out of range)
+     */
+    double valueAt(qint64 index, int channel, double *time = nullptr) const;
+
+    /**
+     * @brief Gets the most recent sample of a channel
+     */
+    double lastValue(int channel = 0) const;
+
+    /**
+     * @brief Incremental read for pollers
+     * @param first Index of the first sample wanted (usually the previous size())
+     * @param channel Channel to read
+     * @return (time, value) pairs for samples [first, size())
+     */
+    QVector<QPair<double, double>> samplesSince(qint64 first, int channel = 0) const;
+
+    /**
+     * @brief Min/max decimated view of the whole series for plotting
+     * @param maxPoints Upper bound on the number of returned points
+     * @param channel Channel to read
+     * @return Time-ordered (time, value) pairs; each bucket contributes its
+     *         minimum and maximum so peaks survive the decimation
+     */
+    QVector<QPair<double, double>> decimated(int maxPoints, int channel = 0) const;
+
+private:
+    /// Min/max of one channel over one summary block
+    struct BlockExtrema {
+        double minTime;
+        double minValue;
+        double maxTime;
+        double maxValue;
+    };
+
+    static const int BLOCK_SIZE = 1024; ///< Samples per summary block
+
+    int recordSize() const { return channels + 1; }
+    const double *ringRecord(qint64 index) const;
+    bool readSpilled(qint64 first, qint64 n, std::vector<double> &records) const;
+    void spillOldest(qint64 n);
+    template <typename Visitor>
+    void forEachSample(qint64 first, qint64 last, int channel, Visitor visit) const;
+
+    int channels;
+    qint64 ringCapacity;
+    std::vector<double> ring;      ///< Circular buffer of records (time + channels)
+    qint64 ringHead;               ///< Ring slot of the oldest in-memory sample
+    qint64 spilledCount;           ///< Samples [0, spilledCount) live in the spill file
+    qint64 count;                  ///< Total samples appended
+
+    mutable QTemporaryFile spillFile;
+    bool spillOpen;
+
+    std::vector<BlockExtrema> blocks; ///< blocks[b * channels + c]
+};
+
+#endif // TIMESERIESSTORE_H
@@ -14,7 +14,9 @@
  * - C++17 features
  * 
  * Command line arguments:
- * None currently supported, using default Qt initialization
+ * --benchmark [options] dem...  Runs the headless engine benchmarks instead of
+ *                               the GUI, without creating a QApplication
+ *                               (see Benchmark.h)
  * 
  * Dependencies:
  * - GDAL libraries must be installed and accessible
@@ -27,10 +29,18 @@
  */
 
 #include "mainwindow.h"
+#include "Benchmark.h"
 #include <QApplication>
+#include <QCoreApplication>
 
 int main(int argc, char *argv[])
 {
+    // Benchmarks run without a display or QPA platform
+    if (Benchmark::isRequested(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        return Benchmark::run(app.arguments());
+    }
+
     // Initialize Qt application with high DPI support
     QApplication a(argc, argv);
     QApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
@@ -1,4 +1,5 @@
 #include "mainwindow.h"
+#include "FlowSolverRegistry.h"
 #include <QFileDialog>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
@@ -25,6 +26,7 @@
 #include <QHeaderView>
 #include <algorithm>
 #include <QStatusBar>
+#include <QElapsedTimer>
 
 // Custom clickable QLabel subclass to handle mouse clicks for outlet selection
 class ClickableLabel : public QLabel {
@@ -127,6 +129,14 @@ MainWindow::MainWindow(QWidget *parent)
     simTimer = new QTimer(this);
     simTimer->setInterval(100);  // 10 Hz simulation rate
     connect(simTimer, &QTimer::timeout, this, &MainWindow::onSimulationStep);
+    connect(simEngine, &SimulationEngine::steadyStateReached, this, [this](double time, bool stopped) {
+        resultsOutputLabel->setText(QString("Steady state at %1 s%2").arg(time, 0, 'f', 1)
+                                    .arg(stopped ? ", simulation stopped" : ""));
+        if (stopped) {
+            simTimer->stop();
+            simulationRunning = false;
+        }
+    });
     
     uiUpdateTimer = new QTimer(this);
     uiUpdateTimer->setInterval(50);  // 20 Hz UI refresh
@@ -190,6 +200,7 @@ void MainWindow::setupUI()
  * Contains input fields for:
  * - DEM file selection
  * - Manning's coefficient
+ * - Flow solver and maximum time step
  * - Infiltration rate
  * - Rainfall configuration
  * - Simulation duration
@@ -263,6 +274,69 @@ void MainWindow::createInputPanel()
     manningCoeffEdit->setDecimals(3);
     paramLayout->addRow("Manning's Coefficient:", manningCoeffEdit);
     
+    // Flow solver, listed from the solver registry
+    solverCombo = new QComboBox(inputTab);
+    for (const QString &name : FlowSolverRegistry::instance().names()) {
+        solverCombo->addItem(name);
+        solverCombo->setItemData(solverCombo->count() - 1, FlowSolverRegistry::instance().description(name), Qt::ToolTipRole);
+    }
+    connect(solverCombo, &QComboBox::currentTextChanged, [this](const QString &name) {
+        if (simEngine)
+            simEngine->setFlowSolver(name);
+    });
+    paramLayout->addRow("Flow Solver:", solverCombo);
+    
+    // Upper bound of the time step; CFL-limited solvers may take shorter steps
+    maxTimeStepEdit = new QDoubleSpinBox(inputTab);
+    maxTimeStepEdit->setRange(0.01, 60.0);
+    maxTimeStepEdit->setValue(1.0);
+    maxTimeStepEdit->setDecimals(2);
+    maxTimeStepEdit->setSuffix(" s");
+    connect(maxTimeStepEdit, QOverload<double>::of(&QDoubleSpinBox::valueChanged), [this](double seconds) {
+        if (simEngine)
+            simEngine->setMaxTimeStep(seconds);
+    });
+    paramLayout->addRow("Max Time Step:", maxTimeStepEdit);
+    
+    // What to do once depths and the water balance hold steady
+    steadyStateCombo = new QComboBox(inputTab);
+    steadyStateCombo->addItem("Off");
+    steadyStateCombo->addItem("Report");
+    steadyStateCombo->addItem("Stop");
+    steadyStateCombo->addItem("Coarse steps");
+    steadyStateCombo->setToolTip("Action once no depth changes faster than 1e-6 m/s and outflow balances "
+                                 "inflow within 1% for 10 simulated minutes");
+    connect(steadyStateCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index) {
+        if (simEngine)
+            simEngine->setSteadyStateAction(static_cast<SteadyStateAction>(index));
+    });
+    paramLayout->addRow("Steady State:", steadyStateCombo);
+    
+    // Coarse-to-fine warm start: the first part of the run on aggregated DEMs
+    multigridCombo = new QComboBox(inputTab);
+    multigridCombo->addItem("Off");
+    multigridCombo->addItem("2x");
+    multigridCombo->addItem("4x, 2x");
+    multigridCombo->addItem("8x, 4x, 2x");
+    multigridCombo->setToolTip("Run the start of the event on coarser DEMs (lowest elevation per block), "
+                               "then continue at full resolution");
+    multigridSwitchEdit = new QSpinBox(inputTab);
+    multigridSwitchEdit->setRange(0, 86400);
+    multigridSwitchEdit->setValue(600);
+    multigridSwitchEdit->setSuffix(" s");
+    multigridSwitchEdit->setToolTip("Time at which the full-resolution run takes over");
+    auto updateMultigrid = [this]() {
+        if (simEngine)
+            simEngine->setMultigridWarmStart(multigridCombo->currentIndex(), multigridSwitchEdit->value());
+    };
+    connect(multigridCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), updateMultigrid);
+    connect(multigridSwitchEdit, QOverload<int>::of(&QSpinBox::valueChanged), updateMultigrid);
+    QHBoxLayout *multigridLayout = new QHBoxLayout();
+    multigridLayout->addWidget(multigridCombo);
+    multigridLayout->addWidget(new QLabel("until"));
+    multigridLayout->addWidget(multigridSwitchEdit);
+    paramLayout->addRow("Coarse Levels:", multigridLayout);
+    
     // Infiltration rate (Ks)
     infiltrationEdit = new QDoubleSpinBox(inputTab);
     infiltrationEdit->setMinimum(0.0);
@@ -561,6 +635,12 @@ void MainWindow::createDEMPreviewPanel()
     outputLabel = new QLabel("Load a DEM file and select manual outlet mode to begin selecting outlets.");
     outputLabel->setWordWrap(true);
     leftLayout->addWidget(outputLabel);
+
+    // Instant time-area hydrograph estimate for the current outlets
+    surrogateLabel = new QLabel("Surrogate hydrographs appear here once outlets are set.");
+    surrogateLabel->setWordWrap(true);
+    surrogateLabel->setToolTip("Rainfall excess convolved with each outlet's travel-time histogram; no simulation is run");
+    leftLayout->addWidget(surrogateLabel);
     
     // Right side - Outlet table
     QWidget* rightPanel = new QWidget();
@@ -584,8 +664,10 @@ void MainWindow::createDEMPreviewPanel()
     // Add splitter to main layout
     mainLayout->addWidget(splitter);
     
-    // Connect the simDisplayLabel click signal
+    // Connect the simDisplayLabel click signal; the surrogate follows the outlet change
     connect(simDisplayLabel, &ClickableLabel::clicked, this, &MainWindow::onSimDisplayClicked);
+    connect(simDisplayLabel, &ClickableLabel::clicked, this, &MainWindow::updateSurrogateSummary);
+    connect(clearOutletsButton, &QPushButton::clicked, this, &MainWindow::updateSurrogateSummary);
     
     // Use lambdas to connect signals with different parameter types
     connect(simDisplayLabel, &ClickableLabel::mouseWheelScrolled, this, 
@@ -622,6 +704,53 @@ void MainWindow::createDEMPreviewPanel()
             });
 }
 
+/**
+ * @brief Shows peak discharge and time to peak of the surrogate hydrographs
+ *
+ * Uses SimulationEngine::getSurrogateHydrograph(), which needs no simulation
+ * run, so it is refreshed on every outlet click in the DEM preview.
+ */
+void MainWindow::updateSurrogateSummary()
+{
+    if (!simEngine || simEngine->getOutletCount() == 0) {
+        surrogateLabel->setText("Surrogate hydrographs appear here once outlets are set.");
+        return;
+    }
+
+    const int maxListed = 5;
+    QElapsedTimer timer;
+    timer.start();
+    QStringList lines;
+    for (int k = 0; k < simEngine->getOutletCount(); k++) {
+        QVector<QPair<double, double>> hydrograph = simEngine->getSurrogateHydrograph(k);
+        double peak = 0.0, peakTime = 0.0;
+        for (const QPair<double, double> &sample : hydrograph) {
+            if (sample.second > peak) {
+                peak = sample.second;
+                peakTime = sample.first;
+            }
+        }
+        if (k < maxListed) {
+            QPoint cell = simEngine->getOutletCell(k);
+            lines << QString("Outlet (%1, %2): peak %3 m³/s at %4 s")
+                         .arg(cell.x()).arg(cell.y()).arg(peak, 0, 'g', 4).arg(peakTime, 0, 'f', 0);
+        }
+    }
+    if (simEngine->getOutletCount() > maxListed)
+        lines << QString("... and %1 more outlets").arg(simEngine->getOutletCount() - maxListed);
+    surrogateLabel->setText(QString("Surrogate hydrographs (%1 ms):\n").arg(timer.elapsed()) + lines.join("\n"));
+}
+
+/**
+ * @brief Shows a map computed without time stepping (HAND, Fill-Spill-Merge) in the result display
+ */
+void MainWindow::showRapidMap(const QImage &image, const QString &status)
+{
+    currentSimulationImage = image;
+    updateVisualization();
+    resultsOutputLabel->setText(status);
+}
+
 /**
  * @brief Creates the visualization panel for simulation results
  * 
@@ -779,10 +908,69 @@ void MainWindow::createVisualizationPanel()
     connect(showRulersCheckbox, &QCheckBox::toggled, this, &MainWindow::onToggleRulers);
     connect(gridIntervalSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &MainWindow::onGridIntervalChanged);
     
+    // Rapid inundation maps from HAND, drawn with the water depth colors
+    QGroupBox *handGroup = new QGroupBox("Rapid Inundation (HAND)");
+    QHBoxLayout *handLayout = new QHBoxLayout();
+    handStageEdit = new QDoubleSpinBox();
+    handStageEdit->setRange(0.0, 100.0);
+    handStageEdit->setValue(1.0);
+    handStageEdit->setDecimals(2);
+    handStageEdit->setSuffix(" m");
+    handStageEdit->setToolTip("Water level above the nearest drainage channel");
+    QPushButton *handStageButton = new QPushButton("Map Stage");
+    QPushButton *handRainfallButton = new QPushButton("Map Rainfall Excess");
+    handRainfallButton->setToolTip("Stores each outlet catchment's rainfall excess over the total time as a flat stage");
+    handLayout->addWidget(new QLabel("Stage:"));
+    handLayout->addWidget(handStageEdit);
+    handLayout->addWidget(handStageButton);
+    handLayout->addWidget(handRainfallButton);
+    handGroup->setLayout(handLayout);
+
+    connect(handStageButton, &QPushButton::clicked, this, [this]() {
+        if (simEngine && simEngine->mapHandInundation(handStageEdit->value()))
+            showRapidMap(simEngine->getHandInundationImage(),
+                         QString("HAND inundation for a %1 m stage").arg(handStageEdit->value()));
+    });
+    connect(handRainfallButton, &QPushButton::clicked, this, [this]() {
+        if (simEngine && simEngine->mapHandInundationFromRainfall())
+            showRapidMap(simEngine->getHandInundationImage(),
+                         "HAND inundation storing the rainfall excess of each outlet catchment");
+    });
+
+    // Depression storage from Fill-Spill-Merge, optionally the initial state of simulations
+    QGroupBox *fsmGroup = new QGroupBox("Depression Storage (Fill-Spill-Merge)");
+    QHBoxLayout *fsmLayout = new QHBoxLayout();
+    QPushButton *fsmButton = new QPushButton("Fill Depressions");
+    fsmButton->setToolTip("Routes the rainfall excess over the total time through the depression hierarchy");
+    warmStartCheckbox = new QCheckBox("Warm start simulations");
+    warmStartCheckbox->setToolTip("Start simulations from the ponded depths instead of a dry grid");
+    fsmLayout->addWidget(fsmButton);
+    fsmLayout->addWidget(warmStartCheckbox);
+    fsmGroup->setLayout(fsmLayout);
+
+    connect(fsmButton, &QPushButton::clicked, this, [this]() {
+        if (!simEngine || !simEngine->runFillSpillMerge())
+            return;
+        double drained = 0.0;
+        for (int k = 0; k < simEngine->getOutletCount(); k++)
+            drained += simEngine->getFillSpillMergeOutletVolume(k);
+        showRapidMap(simEngine->getPondedDepthImage(),
+                     QString("Fill-Spill-Merge: %1 m³ ponded, %2 m³ to outlets, %3 m³ off the grid")
+                         .arg(simEngine->getFillSpillMergePondedVolume(), 0, 'f', 1)
+                         .arg(drained, 0, 'f', 1)
+                         .arg(simEngine->getFillSpillMergeOffGridVolume(), 0, 'f', 1));
+    });
+    connect(warmStartCheckbox, &QCheckBox::toggled, this, [this](bool checked) {
+        if (simEngine)
+            simEngine->setFillSpillMergeWarmStart(checked);
+    });
+
     // Add components to layout
     visLayout->addLayout(splitLayout);
     visLayout->addLayout(zoomLayout);
     visLayout->addWidget(resultsOutputLabel);
+    visLayout->addWidget(handGroup);
+    visLayout->addWidget(fsmGroup);
     visLayout->addWidget(displayOptionsGroup);
 }
 
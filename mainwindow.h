@@ -127,6 +127,8 @@ private:
     void panView(const QPoint& delta);
     void updateDEMDisplay();
     void updateOutletTable();
+    void updateSurrogateSummary();
+    void showRapidMap(const QImage &image, const QString &status);
     
     // Unified view methods that work for both tabs
     void updateDisplay(QLabel* displayLabel, const QImage& image, QLabel* statusLabel, const QString& statusText, QPainter* customPainter = nullptr);
@@ -143,6 +145,11 @@ private:
     QSpinBox *totalTimeEdit;             // Total simulation time (seconds)
     QDoubleSpinBox *minDepthEdit;        // Minimum water depth threshold
     QDoubleSpinBox *resolutionEdit;      // Cell resolution (meters per cell)
+    QComboBox *solverCombo;              // Registered flow solver name
+    QDoubleSpinBox *maxTimeStepEdit;     // Upper bound of the time step (s)
+    QComboBox *steadyStateCombo;         // Action once the run reaches steady state
+    QComboBox *multigridCombo;           // Coarse levels of the multigrid warm start
+    QSpinBox *multigridSwitchEdit;       // Switch to full resolution (s)
     
     // Time-varying rainfall controls
     QCheckBox *timeVaryingRainfallCheckbox;
@@ -168,6 +175,8 @@ private:
     QCheckBox *showGridCheckbox;         // Toggle grid display
     QCheckBox *showRulersCheckbox;       // Toggle rulers display
     QSpinBox *gridIntervalSpinBox;       // Grid line interval setting
+    QDoubleSpinBox *handStageEdit;       // Stage of the HAND inundation map (m)
+    QCheckBox *warmStartCheckbox;        // Start simulations from the Fill-Spill-Merge depths
     
     // Pan and zoom variables
     float zoomLevel;                     // Current zoom level
@@ -191,6 +200,7 @@ private:
     // Output Controls
     QPushButton *saveResultsButton;
     QLabel *outputLabel;                 // Shows selection feedback
+    QLabel *surrogateLabel;              // Time-area hydrograph peaks of the current outlets
     QLabel *resultsOutputLabel;          // Shows simulation results
     
     // Layout containers
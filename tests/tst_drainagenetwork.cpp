@@ -0,0 +1,137 @@
+/**
+ * @file tst_drainagenetwork.cpp
+ * @brief Incremental outlet insertion and removal against a from-scratch catchment labeling
+ */
+
+#include "DrainageNetwork.h"
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+const int ROWS = 120;
+const int COLS = 90;
+
+/// Rough slope with a closed depression, a flat plateau and a NoData strip
+std::vector<double> syntheticDem()
+{
+    std::mt19937 random(3);
+    std::uniform_int_distribution<int> noise(0, 99);
+    std::vector<double> z(size_t(ROWS) * COLS);
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            double value = 0.05 * i + 0.5 * std::sin(0.3 * j) + 0.01 * noise(random);
+            if (i > 50 && i < 60 && j > 20 && j < 40)
+                value -= 3.0;
+            if (i > 90 && j > 60)
+                value = 8.0;
+            z[size_t(i) * COLS + j] = value;
+        }
+    }
+    for (int j = 0; j < 10; j++)
+        z[j] = -999999.0;
+    return z;
+}
+
+std::vector<int> randomOutlets(const DrainageNetwork &network, int count)
+{
+    std::mt19937 random(11);
+    std::uniform_int_distribution<int> cell(0, ROWS * COLS - 1);
+    std::vector<int> outlets;
+    while (int(outlets.size()) < count) {
+        const int c = cell(random);
+        if (network.isValid(c) && std::find(outlets.begin(), outlets.end(), c) == outlets.end())
+            outlets.push_back(c);
+    }
+    return outlets;
+}
+
+/// Labels a few outlets, adds the rest one by one, removes some, then compares with a rebuild
+void compareWithRebuild(DrainageNetwork &incremental, DrainageNetwork &rebuilt)
+{
+    std::vector<int> outlets = randomOutlets(incremental, 40);
+    std::vector<int> current(outlets.begin(), outlets.begin() + 10);
+    incremental.labelCatchments(current);
+    for (size_t k = 10; k < outlets.size(); k++) {
+        QCOMPARE(incremental.addOutlet(outlets[k]), int(current.size()));
+        current.push_back(outlets[k]);
+    }
+    // Swap-remove, as the engine does with its own outlet list
+    for (int r = 0; r < 12; r++) {
+        const int id = (r * 7) % int(current.size());
+        incremental.removeOutlet(id);
+        current[id] = current.back();
+        current.pop_back();
+    }
+
+    rebuilt.labelCatchments(current);
+    QCOMPARE(incremental.catchmentCount(), rebuilt.catchmentCount());
+    QVERIFY(incremental.catchmentLabels() == rebuilt.catchmentLabels());
+    for (int id = 0; id < rebuilt.catchmentCount(); id++) {
+        std::vector<int> a = incremental.catchmentCells(id);
+        std::vector<int> b = rebuilt.catchmentCells(id);
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        QVERIFY(a == b);
+    }
+}
+
+} // namespace
+
+class TestDrainageNetwork : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void everyValidCellIsOrdered();
+    void incrementalOutletsMatchRebuild();
+    void incrementalOutletsMatchRebuildQuantized();
+};
+
+void TestDrainageNetwork::everyValidCellIsOrdered()
+{
+    DrainageNetwork network;
+    network.build(syntheticDem(), ROWS, COLS);
+    QCOMPARE(int(network.topologicalOrder().size()), ROWS * COLS - 10);
+
+    // Upstream first: every cell comes before its downstream cell
+    std::vector<int> position(size_t(ROWS) * COLS, -1);
+    for (size_t k = 0; k < network.topologicalOrder().size(); k++)
+        position[network.topologicalOrder()[k]] = int(k);
+    for (int cell : network.topologicalOrder()) {
+        const int down = network.downstream(cell);
+        if (down >= 0)
+            QVERIFY(position[cell] < position[down]);
+    }
+}
+
+void TestDrainageNetwork::incrementalOutletsMatchRebuild()
+{
+    const std::vector<double> z = syntheticDem();
+    DrainageNetwork incremental;
+    DrainageNetwork rebuilt;
+    incremental.build(z, ROWS, COLS);
+    rebuilt.build(z, ROWS, COLS);
+    compareWithRebuild(incremental, rebuilt);
+}
+
+void TestDrainageNetwork::incrementalOutletsMatchRebuildQuantized()
+{
+    // Centimetre levels from -5 m, like the Int32 storage of ElevationGrid
+    const std::vector<double> z = syntheticDem();
+    std::vector<int32_t> levels(z.size());
+    for (size_t c = 0; c < z.size(); c++)
+        levels[c] = (z[c] <= -999998.0) ? DrainageNetwork::NO_DATA_LEVEL : int32_t(std::lround((z[c] + 5.0) / 0.01));
+    DrainageNetwork incremental;
+    DrainageNetwork rebuilt;
+    incremental.buildQuantized(levels, ROWS, COLS, -5.0, 0.01);
+    rebuilt.buildQuantized(levels, ROWS, COLS, -5.0, 0.01);
+    compareWithRebuild(incremental, rebuilt);
+}
+
+QTEST_APPLESS_MAIN(TestDrainageNetwork)
+#include "tst_drainagenetwork.moc"
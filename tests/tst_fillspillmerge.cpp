@@ -0,0 +1,155 @@
+/**
+ * @file tst_fillspillmerge.cpp
+ * @brief Fill-Spill-Merge mass conservation on a synthetic two-pit DEM
+ */
+
+#include "FillSpillMerge.h"
+#include "DrainageNetwork.h"
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+
+const int ROWS = 13;
+const int COLS = 23;
+const double CELL_AREA = 25.0;
+
+const int PIT_A = 6 * COLS + 6;         ///< Deeper pit, bottom at 3 m
+const int PIT_B = 6 * COLS + 16;        ///< Shallower pit, bottom at 3.5 m
+const int NOTCH = 6 * COLS + COLS - 1;  ///< Low point of the rim, where the full DEM spills
+
+/**
+ * Two cones meeting at a saddle, inside a 10 m rim with a 6 m notch on the
+ * east edge. Each cone bottom is the only local minimum of its depression.
+ */
+std::vector<double> twoPitDem()
+{
+    std::vector<double> z(size_t(ROWS) * COLS);
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            const double a = 3.0 + 0.5 * std::hypot(i - 6.0, j - 6.0);
+            const double b = 3.5 + 0.5 * std::hypot(i - 6.0, j - 16.0);
+            const bool rim = i == 0 || j == 0 || i == ROWS - 1 || j == COLS - 1;
+            z[size_t(i) * COLS + j] = rim ? 10.0 : std::min(a, b);
+        }
+    }
+    z[NOTCH] = 6.0;
+    return z;
+}
+
+double validCells(const std::vector<double> &z)
+{
+    return double(std::count_if(z.begin(), z.end(), [](double v) { return v > -999998.0; }));
+}
+
+/// Runoff in equals ponded water plus everything that left, and the depths hold the ponded volume
+void checkBalance(const FillSpillMergeResult &result, double runoffDepth, double cells)
+{
+    double left = result.offGridVolume;
+    for (double volume : result.outletVolume)
+        left += volume;
+    const double runoff = runoffDepth * cells * CELL_AREA;
+    QVERIFY(std::abs(result.pondedVolume + left - runoff) <= 1e-9 * runoff);
+
+    double depthVolume = 0.0;
+    for (float h : result.depth)
+        depthVolume += double(h) * CELL_AREA;
+    QVERIFY(std::abs(depthVolume - result.pondedVolume) <= 1e-5 * std::max(1.0, result.pondedVolume));
+}
+
+/// Runoff depths from a few millimetres to far more than both pits hold
+std::vector<double> runoffDepths()
+{
+    std::vector<double> depths;
+    for (double d = 1e-3; d < 20.0; d *= 1.7)
+        depths.push_back(d);
+    return depths;
+}
+
+} // namespace
+
+class TestFillSpillMerge : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void findsBothPits();
+    void conservesMassWithoutOutlets();
+    void conservesMassWithRimOutlet();
+    void conservesMassWithOutletInPit();
+};
+
+void TestFillSpillMerge::findsBothPits()
+{
+    FillSpillMerge fsm;
+    fsm.build(twoPitDem(), ROWS, COLS);
+    QVERIFY(fsm.isBuilt());
+    QCOMPARE(fsm.depressionCount(), 2);
+}
+
+void TestFillSpillMerge::conservesMassWithoutOutlets()
+{
+    const std::vector<double> z = twoPitDem();
+    FillSpillMerge fsm;
+    fsm.build(z, ROWS, COLS);
+    DrainageNetwork network;
+
+    double previousPonded = 0.0;
+    for (double runoff : runoffDepths()) {
+        const FillSpillMergeResult result = fsm.route(runoff, CELL_AREA, network, std::vector<int>());
+        checkBalance(result, runoff, validCells(z));
+        // Ponding grows with the runoff until both pits are full to the notch
+        QVERIFY(result.pondedVolume >= previousPonded);
+        previousPonded = result.pondedVolume;
+    }
+
+    // Full: one flat surface at the notch over both pits
+    const FillSpillMergeResult full = fsm.route(100.0, CELL_AREA, network, std::vector<int>());
+    QVERIFY(std::abs(full.maxDepth - 3.0) <= 1e-5);
+    QVERIFY(std::abs((z[PIT_B] + full.depth[PIT_B]) - 6.0) <= 1e-5);
+    QVERIFY(std::abs(previousPonded - full.pondedVolume) <= 1e-9 * full.pondedVolume);
+}
+
+void TestFillSpillMerge::conservesMassWithRimOutlet()
+{
+    const std::vector<double> z = twoPitDem();
+    FillSpillMerge fsm;
+    fsm.build(z, ROWS, COLS);
+    DrainageNetwork network;
+    network.build(z, ROWS, COLS);
+    const std::vector<int> outlets = {NOTCH};
+    network.labelCatchments(outlets);
+
+    for (double runoff : runoffDepths()) {
+        const FillSpillMergeResult result = fsm.route(runoff, CELL_AREA, network, outlets);
+        checkBalance(result, runoff, validCells(z));
+    }
+    // Once the pits are full, their overflow crosses the notch into its catchment
+    const FillSpillMergeResult full = fsm.route(100.0, CELL_AREA, network, outlets);
+    QVERIFY(full.outletVolume[0] > full.pondedVolume);
+}
+
+void TestFillSpillMerge::conservesMassWithOutletInPit()
+{
+    const std::vector<double> z = twoPitDem();
+    FillSpillMerge fsm;
+    fsm.build(z, ROWS, COLS);
+    DrainageNetwork network;
+    network.build(z, ROWS, COLS);
+    const std::vector<int> outlets = {PIT_A};
+    network.labelCatchments(outlets);
+
+    for (double runoff : runoffDepths()) {
+        const FillSpillMergeResult result = fsm.route(runoff, CELL_AREA, network, outlets);
+        checkBalance(result, runoff, validCells(z));
+        // Pit A drains through its outlet and never ponds
+        QCOMPARE(result.depth[PIT_A], 0.0f);
+        QVERIFY(result.outletVolume[0] > 0.0);
+    }
+}
+
+QTEST_APPLESS_MAIN(TestFillSpillMerge)
+#include "tst_fillspillmerge.moc"
@@ -0,0 +1,163 @@
+/**
+ * @file tst_kinematicwavekernel.cpp
+ * @brief Implicit reservoir solve and mass balance of the kinematic-wave routing
+ */
+
+#include "KinematicWaveKernel.h"
+#include "DrainageNetwork.h"
+#include "ElevationGrid.h"
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace
+{
+
+const int ROWS = 9;
+const int COLS = 14;
+const double RESOLUTION = 5.0;
+const double MANNING_N = 0.04;
+const double INITIAL_DEPTH = 0.05;
+
+/// Valley draining east, with cross slopes so some cells route diagonally
+std::vector<double> valleyDem()
+{
+    std::vector<double> z(size_t(ROWS) * COLS);
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++)
+            z[size_t(i) * COLS + j] = 20.0 - 0.4 * j + 0.3 * std::abs(i - ROWS / 2);
+    }
+    return z;
+}
+
+/// Whole-grid domain with optional outlet cells, uniform initial depth
+struct Setup {
+    DrainageNetwork network;
+    ElevationGrid dem;
+    PaddedGrid<uint8_t> mask;
+    KinematicWaveKernel<double> kernel;
+
+    explicit Setup(const std::vector<int> &outlets)
+    {
+        const std::vector<double> z = valleyDem();
+        network.build(z, ROWS, COLS);
+        dem.allocate(ROWS, COLS, 0.0, 30.0);
+        mask.assign(ROWS, COLS, DOMAIN_ACTIVE, DOMAIN_INACTIVE);
+        std::vector<CellSpan> spans;
+        std::vector<int> rowSpans(ROWS + 1, 0);
+        for (int i = 0; i < ROWS; i++) {
+            rowSpans[i] = int(spans.size());
+            int begin = 0;
+            for (int j = 0; j < COLS; j++) {
+                dem.set(i, j, z[size_t(i) * COLS + j]);
+                if (std::find(outlets.begin(), outlets.end(), i * COLS + j) == outlets.end())
+                    continue;
+                if (j > begin)
+                    spans.push_back({i, begin, j, DOMAIN_ACTIVE, false});
+                spans.push_back({i, j, j + 1, DOMAIN_ACTIVE, true});
+                begin = j + 1;
+            }
+            if (begin < COLS)
+                spans.push_back({i, begin, COLS, DOMAIN_ACTIVE, false});
+        }
+        rowSpans[ROWS] = int(spans.size());
+
+        kernel.setDrainageNetwork(&network);
+        kernel.reset(ROWS, COLS);
+        kernel.setDomain(spans, rowSpans);
+        kernel.buildFaceCoefficients(dem, mask, RESOLUTION, MANNING_N);
+        const std::vector<float> row(COLS, float(INITIAL_DEPTH));
+        for (int i = 0; i < ROWS; i++)
+            kernel.loadDepthRow(i, row.data());
+    }
+};
+
+KernelStepParameters stepParameters(double dt)
+{
+    return {0.0, 0.0, 0.0, dt, RESOLUTION * RESOLUTION};
+}
+
+double initialVolume()
+{
+    return double(float(INITIAL_DEPTH)) * ROWS * COLS * RESOLUTION * RESOLUTION;
+}
+
+} // namespace
+
+class TestKinematicWaveKernel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void headwaterCellsSolveReservoirEquation();
+    void conservesMassWithoutOutlets();
+    void conservesMassWithOutlet();
+};
+
+/**
+ * A cell nothing drains into keeps h' with h' + k h'^(5/3) = h, over time
+ * steps from fractions of a second to days (k from ~1e-2 to ~1e6).
+ */
+void TestKinematicWaveKernel::headwaterCellsSolveReservoirEquation()
+{
+    for (double dt : {0.01, 1.0, 100.0, 1.0e4, 1.0e6}) {
+        Setup setup({});
+        std::vector<int> inflows(size_t(ROWS) * COLS, 0);
+        for (int cell = 0; cell < ROWS * COLS; cell++) {
+            if (setup.network.downstream(cell) >= 0)
+                inflows[setup.network.downstream(cell)]++;
+        }
+        setup.kernel.applySourcesAndOutflow(stepParameters(dt));
+        setup.kernel.updateDepths(stepParameters(dt), [](int, int, double h) { return h; });
+
+        const double h = double(float(INITIAL_DEPTH));
+        int checked = 0;
+        for (int cell = 0; cell < ROWS * COLS; cell++) {
+            const int down = setup.network.downstream(cell);
+            if (inflows[cell] > 0 || down < 0)
+                continue;
+            const int code = setup.network.flowDirections()[cell];
+            const double length = (code % 2) ? RESOLUTION * std::sqrt(2.0) : RESOLUTION;
+            const double slope = std::max(KinematicWaveKernel<double>::MIN_SLOPE,
+                                          (setup.network.filledElevation(cell) - setup.network.filledElevation(down)) / length);
+            const double k = dt * std::sqrt(slope) / (MANNING_N * RESOLUTION);
+            const double remaining = setup.kernel.depth(cell / COLS, cell % COLS);
+            QVERIFY(remaining > 0.0 && remaining < h);
+            QVERIFY(std::abs(remaining + k * std::pow(remaining, 5.0 / 3.0) - h) <= 1e-5 * h);
+            checked++;
+        }
+        QVERIFY(checked > 0);
+    }
+}
+
+void TestKinematicWaveKernel::conservesMassWithoutOutlets()
+{
+    Setup setup({});
+    KernelStatistics stats = {};
+    for (int step = 0; step < 50; step++) {
+        setup.kernel.applySourcesAndOutflow(stepParameters(10.0));
+        stats = setup.kernel.updateDepths(stepParameters(10.0), [](int, int, double h) { return h; });
+    }
+    QVERIFY(std::abs(stats.storedVolume - initialVolume()) <= 1e-9 * initialVolume());
+}
+
+void TestKinematicWaveKernel::conservesMassWithOutlet()
+{
+    // The valley floor at the east edge collects the whole central flow line
+    Setup setup({(ROWS / 2) * COLS + COLS - 2});
+    double drained = 0.0;
+    KernelStatistics stats = {};
+    for (int step = 0; step < 50; step++) {
+        setup.kernel.applySourcesAndOutflow(stepParameters(10.0));
+        stats = setup.kernel.updateDepths(stepParameters(10.0), [&](int, int, double h) {
+            drained += h * RESOLUTION * RESOLUTION;
+            return 0.0;
+        });
+    }
+    QVERIFY(drained > 0.0);
+    QVERIFY(std::abs(stats.storedVolume + drained - initialVolume()) <= 1e-9 * initialVolume());
+}
+
+QTEST_APPLESS_MAIN(TestKinematicWaveKernel)
+#include "tst_kinematicwavekernel.moc"
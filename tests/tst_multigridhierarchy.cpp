@@ -0,0 +1,137 @@
+/**
+ * @file tst_multigridhierarchy.cpp
+ * @brief Volume identity of the multigrid depth prolongation
+ */
+
+#include "MultigridHierarchy.h"
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+// Odd sizes, so the last coarse row and column cover partial blocks
+const int ROWS = 37;
+const int COLS = 29;
+
+/// Uneven terrain with a NoData corner block and scattered NoData cells
+std::vector<double> syntheticDem()
+{
+    std::mt19937 random(5);
+    std::uniform_real_distribution<double> noise(0.0, 0.5);
+    std::vector<double> z(size_t(ROWS) * COLS);
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            const bool noData = (i < 9 && j < 7) || (i * 31 + j * 17) % 23 == 0;
+            z[size_t(i) * COLS + j] = noData ? -999999.0 : 100.0 + 0.1 * i + 0.05 * j + noise(random);
+        }
+    }
+    return z;
+}
+
+/**
+ * Prolongates random depths from every level and restricts the result back
+ * by summing each 2 x 2 block: the block must hold 4 coarse depths of water
+ * at one flat surface, unless it has no valid cell.
+ */
+void checkVolumeIdentity(MultigridAggregation aggregation)
+{
+    const std::vector<double> z = syntheticDem();
+    MultigridHierarchy hierarchy;
+    hierarchy.build(z, ROWS, COLS, MultigridHierarchy::MAX_LEVELS, aggregation);
+    QCOMPARE(hierarchy.levelCount(), MultigridHierarchy::MAX_LEVELS);
+
+    std::mt19937 random(9);
+    std::uniform_real_distribution<float> depthOf(0.0f, 2.0f);
+    for (int level = 1; level <= hierarchy.levelCount(); level++) {
+        const int rows = hierarchy.rowCount(level);
+        const int cols = hierarchy.columnCount(level);
+        const std::vector<double> &finerElevations = (level == 1) ? z : hierarchy.elevations(level - 1);
+        const int finerRows = (level == 1) ? ROWS : hierarchy.rowCount(level - 1);
+        const int finerCols = (level == 1) ? COLS : hierarchy.columnCount(level - 1);
+
+        std::vector<float> depth(size_t(rows) * cols, 0.0f);
+        for (size_t c = 0; c < depth.size(); c++) {
+            if (hierarchy.elevations(level)[c] > -999998.0 && c % 5 != 0)
+                depth[c] = depthOf(random);
+        }
+        std::vector<float> finerDepth;
+        const double handedOver = hierarchy.prolongate(level, depth, finerElevations, finerDepth);
+        QCOMPARE(finerDepth.size(), size_t(finerRows) * finerCols);
+
+        double coarseVolume = 0.0;
+        double finerVolume = 0.0;
+        for (int ci = 0; ci < rows; ci++) {
+            for (int cj = 0; cj < cols; cj++) {
+                const double h = depth[size_t(ci) * cols + cj];
+                double blockVolume = 0.0;
+                double surfaceMin = 1e300;
+                double surfaceMax = -1e300;
+                for (int i = 2 * ci; i < std::min(2 * ci + 2, finerRows); i++) {
+                    for (int j = 2 * cj; j < std::min(2 * cj + 2, finerCols); j++) {
+                        const size_t f = size_t(i) * finerCols + j;
+                        if (finerElevations[f] <= -999998.0) {
+                            QCOMPARE(finerDepth[f], 0.0f);
+                            continue;
+                        }
+                        blockVolume += finerDepth[f];
+                        if (finerDepth[f] > 0.0f) {
+                            surfaceMin = std::min(surfaceMin, finerElevations[f] + finerDepth[f]);
+                            surfaceMax = std::max(surfaceMax, finerElevations[f] + finerDepth[f]);
+                        }
+                    }
+                }
+                QVERIFY(std::abs(blockVolume - 4.0 * h) <= 1e-5 * (1.0 + 4.0 * h));
+                QVERIFY(surfaceMax - surfaceMin <= 1e-4 || h == 0.0);
+                coarseVolume += 4.0 * h;
+                finerVolume += blockVolume;
+            }
+        }
+        QVERIFY(coarseVolume > 0.0);
+        QVERIFY(std::abs(handedOver - coarseVolume) <= 1e-9 * coarseVolume);
+        QVERIFY(std::abs(finerVolume - coarseVolume) <= 1e-6 * coarseVolume);
+    }
+}
+
+} // namespace
+
+class TestMultigridHierarchy : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void coarseCellsCoverTwoByTwoBlocks();
+    void prolongationConservesVolumeMin();
+    void prolongationConservesVolumeMean();
+};
+
+void TestMultigridHierarchy::coarseCellsCoverTwoByTwoBlocks()
+{
+    MultigridHierarchy hierarchy;
+    hierarchy.build(syntheticDem(), ROWS, COLS, MultigridHierarchy::MAX_LEVELS, MultigridAggregation::Min);
+    QCOMPARE(hierarchy.rowCount(1), 19);
+    QCOMPARE(hierarchy.columnCount(1), 15);
+    for (int level = 2; level <= hierarchy.levelCount(); level++) {
+        QCOMPARE(hierarchy.rowCount(level), (hierarchy.rowCount(level - 1) + 1) / 2);
+        QCOMPARE(hierarchy.columnCount(level), (hierarchy.columnCount(level - 1) + 1) / 2);
+    }
+    // The NoData corner block is NoData on level 1, its edge cells are not
+    QVERIFY(hierarchy.elevations(1)[0] <= -999998.0);
+    QVERIFY(hierarchy.elevations(1)[size_t(4) * hierarchy.columnCount(1) + 3] > -999998.0);
+}
+
+void TestMultigridHierarchy::prolongationConservesVolumeMin()
+{
+    checkVolumeIdentity(MultigridAggregation::Min);
+}
+
+void TestMultigridHierarchy::prolongationConservesVolumeMean()
+{
+    checkVolumeIdentity(MultigridAggregation::Mean);
+}
+
+QTEST_APPLESS_MAIN(TestMultigridHierarchy)
+#include "tst_multigridhierarchy.moc"
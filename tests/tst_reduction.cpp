@@ -0,0 +1,209 @@
+/**
+ * @file tst_reduction.cpp
+ * @brief ReproducibleSum order independence and thread-count independent kernel totals
+ */
+
+#include "Reduction.h"
+#include "TileScheduler.h"
+#include "FlowSolverRegistry.h"
+#include "ElevationGrid.h"
+#include "PaddedGrid.h"
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+quint64 bits(double value)
+{
+    quint64 result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+/// Terms spanning 15 orders of magnitude with mixed signs, like per-cell depths and volumes
+std::vector<double> mixedTerms(size_t count)
+{
+    std::mt19937_64 random(20250425);
+    std::uniform_real_distribution<double> exponent(-9.0, 6.0);
+    std::vector<double> terms(count);
+    for (size_t k = 0; k < count; k++)
+        terms[k] = std::pow(10.0, exponent(random)) * ((random() & 3) == 0 ? -1.0 : 1.0);
+    return terms;
+}
+
+/// Per-chunk partials merged in chunk order: the shape of a tiled kernel reduction
+double chunkedSum(const std::vector<double> &terms, int threads)
+{
+    TileScheduler scheduler(threads);
+    const int chunks = 3 * scheduler.threadCount();
+    std::vector<ReproducibleSum> partial(chunks);
+    std::vector<int> tasks(chunks);
+    for (int k = 0; k < chunks; k++)
+        tasks[k] = k;
+    scheduler.run(tasks, [&](int chunk) {
+        const size_t first = terms.size() * size_t(chunk) / size_t(chunks);
+        const size_t last = terms.size() * size_t(chunk + 1) / size_t(chunks);
+        for (size_t k = first; k < last; k++)
+            partial[chunk].add(terms[k]);
+    });
+    ReproducibleSum total;
+    for (const ReproducibleSum &sum : partial)
+        total.add(sum);
+    return total.value();
+}
+
+/// Volume totals and depths of a short rain event on a synthetic DEM
+struct KernelRun {
+    std::vector<double> sourcedVolume;
+    std::vector<double> storedVolume;
+    std::vector<double> drained;
+    std::vector<float> depth;
+};
+
+KernelRun runKernel(const QString &solver, KernelLayout layout, int threads)
+{
+    const int rows = 150;
+    const int cols = 200;
+    const double resolution = 10.0;
+
+    // Tilted plane with a valley along the middle row, a NoData corner and one outlet
+    ElevationGrid dem;
+    dem.allocate(rows, cols, 0.0, 100.0);
+    PaddedGrid<uint8_t> mask;
+    mask.assign(rows, cols, DOMAIN_INACTIVE, DOMAIN_INACTIVE);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            if (i < 20 && j < 30)
+                continue;
+            dem.set(i, j, 10.0 + 0.02 * j + 0.05 * std::abs(i - rows / 2) + 0.3 * std::sin(0.3 * i) * std::cos(0.2 * j));
+            mask[i][j] = DOMAIN_ACTIVE;
+        }
+    }
+    const int outletRow = rows / 2;
+    std::vector<CellSpan> spans;
+    std::vector<int> rowSpans(rows + 1, 0);
+    for (int i = 0; i < rows; i++) {
+        rowSpans[i] = int(spans.size());
+        const int begin = (i < 20) ? 30 : 0;
+        if (i == outletRow) {
+            spans.push_back({i, 0, 1, DOMAIN_ACTIVE, true});
+            spans.push_back({i, 1, cols, DOMAIN_ACTIVE, false});
+        } else {
+            spans.push_back({i, begin, cols, DOMAIN_ACTIVE, false});
+        }
+    }
+    rowSpans[rows] = int(spans.size());
+
+    KernelOptions options = {KernelPrecision::Double, layout, 64, threads};
+    std::unique_ptr<FlowKernel> kernel = FlowSolverRegistry::instance().create(solver, options);
+    kernel->reset(rows, cols);
+    kernel->setDomain(spans, rowSpans);
+    kernel->buildFaceCoefficients(dem, mask, resolution, 0.03);
+
+    KernelRun run;
+    KernelStepParameters params = {0.0, 0.0, 0.001, 1.0, resolution * resolution};
+    for (int step = 0; step < 60; step++) {
+        // An exaggerated 1 mm/s burst, so the water moves within a minute of model time
+        params.rainfallRate = (step < 30) ? 1.0e-3 : 0.0;
+        params.dt = std::min(1.0, kernel->stableTimeStep());
+        double drained = 0.0;
+        run.sourcedVolume.push_back(kernel->applySourcesAndOutflow(params));
+        const KernelStatistics stats = kernel->updateDepths(params, [&](int, int, double h) {
+            drained += h;
+            return 0.0;
+        });
+        run.storedVolume.push_back(stats.storedVolume);
+        run.drained.push_back(drained);
+    }
+    run.depth.resize(size_t(rows) * cols);
+    for (int i = 0; i < rows; i++)
+        kernel->copyDepthRow(i, run.depth.data() + size_t(i) * cols);
+    return run;
+}
+
+void compareRuns(const KernelRun &a, const KernelRun &b)
+{
+    QCOMPARE(a.storedVolume.size(), b.storedVolume.size());
+    for (size_t k = 0; k < a.storedVolume.size(); k++) {
+        QCOMPARE(bits(a.sourcedVolume[k]), bits(b.sourcedVolume[k]));
+        QCOMPARE(bits(a.storedVolume[k]), bits(b.storedVolume[k]));
+        QCOMPARE(bits(a.drained[k]), bits(b.drained[k]));
+    }
+    QVERIFY(a.depth == b.depth);
+}
+
+} // namespace
+
+class TestReduction : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void sumIgnoresOrder();
+    void sumIgnoresThreadCount();
+    void tiledKernelTotalsIgnoreThreadCount();
+    void inertialKernelTotalsIgnoreThreadCount();
+};
+
+void TestReduction::sumIgnoresOrder()
+{
+    std::vector<double> terms = mixedTerms(100000);
+    ReproducibleSum forward;
+    for (double term : terms)
+        forward.add(term);
+
+    std::reverse(terms.begin(), terms.end());
+    ReproducibleSum backward;
+    for (double term : terms)
+        backward.add(term);
+
+    std::shuffle(terms.begin(), terms.end(), std::mt19937(7));
+    ReproducibleSum even;
+    ReproducibleSum odd;
+    for (size_t k = 0; k < terms.size(); k++)
+        (k % 2 ? odd : even).add(terms[k]);
+    ReproducibleSum merged;
+    merged.add(odd);
+    merged.add(even);
+
+    QCOMPARE(bits(backward.value()), bits(forward.value()));
+    QCOMPARE(bits(merged.value()), bits(forward.value()));
+}
+
+void TestReduction::sumIgnoresThreadCount()
+{
+    const std::vector<double> terms = mixedTerms(200000);
+    const double reference = chunkedSum(terms, 1);
+    for (int threads : {2, 3, 4, 8})
+        QCOMPARE(bits(chunkedSum(terms, threads)), bits(reference));
+
+    // The exact total stays within rounding of the plain double sum
+    double plain = 0.0;
+    for (double term : terms)
+        plain += term;
+    QVERIFY(std::abs(plain - reference) < 1e-6 * std::abs(reference));
+}
+
+void TestReduction::tiledKernelTotalsIgnoreThreadCount()
+{
+    for (const char *solver : {"diffusive", "ca"}) {
+        const KernelRun reference = runKernel(solver, KernelLayout::Tiled, 1);
+        QVERIFY(reference.storedVolume.back() > 0.0);
+        compareRuns(runKernel(solver, KernelLayout::Tiled, 4), reference);
+    }
+}
+
+void TestReduction::inertialKernelTotalsIgnoreThreadCount()
+{
+    const KernelRun reference = runKernel("inertial", KernelLayout::RowMajor, 1);
+    QVERIFY(reference.storedVolume.back() > 0.0);
+    compareRuns(runKernel("inertial", KernelLayout::RowMajor, 4), reference);
+}
+
+QTEST_APPLESS_MAIN(TestReduction)
+#include "tst_reduction.moc"
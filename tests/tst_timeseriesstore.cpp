@@ -0,0 +1,103 @@
+/**
+ * @file tst_timeseriesstore.cpp
+ * @brief TimeSeriesStore reads across the ring buffer and the spill file
+ */
+
+#include "TimeSeriesStore.h"
+#include <QtTest>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+const int SAMPLES = 5000;
+const int RING_CAPACITY = 256;      ///< Small ring, so most samples go to the spill file
+
+double valueOf(int index, int channel)
+{
+    return std::sin(0.01 * index) * (channel + 1) + (index == 3217 ? 50.0 : 0.0);
+}
+
+void fill(TimeSeriesStore &store)
+{
+    for (int k = 0; k < SAMPLES; k++) {
+        const double values[2] = {valueOf(k, 0), valueOf(k, 1)};
+        store.append(0.5 * k, values);
+    }
+}
+
+} // namespace
+
+class TestTimeSeriesStore : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void readsEverySample();
+    void pollsOnlyNewSamples();
+    void decimationKeepsPeaks();
+    void clearRestartsIndices();
+};
+
+void TestTimeSeriesStore::readsEverySample()
+{
+    TimeSeriesStore store(2, RING_CAPACITY);
+    fill(store);
+    QCOMPARE(store.size(), qint64(SAMPLES));
+    for (int k = 0; k < SAMPLES; k++) {
+        double time = -1.0;
+        QCOMPARE(store.valueAt(k, 1, &time), valueOf(k, 1));
+        QCOMPARE(time, 0.5 * k);
+    }
+    QCOMPARE(store.lastValue(0), valueOf(SAMPLES - 1, 0));
+}
+
+void TestTimeSeriesStore::pollsOnlyNewSamples()
+{
+    TimeSeriesStore store(2, RING_CAPACITY);
+    fill(store);
+    // Starts in the spill file and ends in the ring
+    const QVector<QPair<double, double>> samples = store.samplesSince(4000, 0);
+    QCOMPARE(int(samples.size()), SAMPLES - 4000);
+    for (int k = 0; k < samples.size(); k++) {
+        QCOMPARE(samples[k].first, 0.5 * (4000 + k));
+        QCOMPARE(samples[k].second, valueOf(4000 + k, 0));
+    }
+    QVERIFY(store.samplesSince(SAMPLES).isEmpty());
+}
+
+void TestTimeSeriesStore::decimationKeepsPeaks()
+{
+    TimeSeriesStore store(2, RING_CAPACITY);
+    fill(store);
+    for (int maxPoints : {8, 64, 400}) {
+        const QVector<QPair<double, double>> view = store.decimated(maxPoints, 0);
+        QVERIFY(!view.isEmpty());
+        QVERIFY(view.size() <= maxPoints);
+        double peak = -1e300;
+        double previousTime = -1.0;
+        for (const QPair<double, double> &point : view) {
+            QVERIFY(point.first >= previousTime);
+            previousTime = point.first;
+            peak = std::max(peak, point.second);
+        }
+        QCOMPARE(peak, valueOf(3217, 0));
+    }
+}
+
+void TestTimeSeriesStore::clearRestartsIndices()
+{
+    TimeSeriesStore store(2, RING_CAPACITY);
+    fill(store);
+    store.clear();
+    QVERIFY(store.isEmpty());
+    const double values[2] = {1.0, 2.0};
+    store.append(7.0, values);
+    double time = 0.0;
+    QCOMPARE(store.valueAt(0, 1, &time), 2.0);
+    QCOMPARE(time, 7.0);
+}
+
+QTEST_APPLESS_MAIN(TestTimeSeriesStore)
+#include "tst_timeseriesstore.moc"